@@ -21,15 +21,12 @@
 #include <ocli/ocli.h>
 #include "democli.h"
 
-int
-main(int argc, char **argv)
+/*
+ * Register all commands, or only bind callbacks to a loaded syntax image
+ */
+static void
+register_cmds(void)
 {
-	/* Always init ocli_rl_init first */
-	ocli_rl_init();
-
-	/* Create my customized lex types */
-	mylex_init();
-
 	/* Create libocli builtin command "man" and "no" */
 	cmd_manual_init();
 	cmd_undo_init();
@@ -44,6 +41,41 @@ main(int argc, char **argv)
 	cmd_show_init();
 	/* Create "interface" commands */
 	cmd_interface_init();
+}
+
+int
+main(int argc, char **argv)
+{
+	/* Optional syntax image, loaded if present, otherwise saved */
+	char	*image = (argc > 1) ? argv[1] : NULL;
+	int	loaded = 0;
+
+	/* Always init ocli_rl_init first */
+	ocli_rl_init();
+
+	/* Create my customized lex types */
+	mylex_init();
+
+	/* No more lex types, make lex registry read only */
+	lex_freeze();
+
+	/* With syntax image loaded, cmd_xxx_init() only bind callbacks */
+	if (image)
+		loaded = (ocli_load_image(image, DEMOCLI_GRAMMAR) == 0);
+
+	register_cmds();
+
+	/* No more commands, compact syntax trees and make them read only */
+	if (ocli_freeze() < 0 && loaded) {
+		/* Stale image is discarded, register again and save it */
+		loaded = 0;
+		register_cmds();
+		ocli_freeze();
+	}
+
+	/* Save syntax image for a faster start next time */
+	if (image && !loaded)
+		ocli_save_image(image, DEMOCLI_GRAMMAR);
 
 	/* Auto exec "exit" for EOF when CTRL-D being pressed */
 	ocli_rl_set_eof_cmd("exit");
@@ -24,11 +24,19 @@
 
 #define INTERFACE_VIEW	0x08
 
+/*
+ * grammar hash of syntax image, change it to drop images of older builds,
+ * e.g. when customized lex types change. changes of commands are found
+ * by ocli_freeze() itself.
+ */
+#define DEMOCLI_GRAMMAR	0x20221001
+
 /* customized lex type */
 #define	LEX_IFINDEX	LEX_CUSTOM_TYPE(0)	
 #define	LEX_ETH_IFNAME	LEX_CUSTOM_TYPE(1)	
 
 extern int mylex_init();
+extern int refresh_eth_ifnames();
 
 /* interface of sys.c module */
 extern void democli_set_view(int view);
@@ -19,48 +19,35 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <net/if.h>
 #include <ocli/lex.h>
 #include "democli.h"
 
-static int eth_ifnum = 0;
+#define	MAX_ETH_IFNUM	256
 
 /*
  * The ifindex is a natural number without precedent '0' except it equals 0
  */
+#define	IFINDEX_PATTERN	"^(0|([1-9][0-9]*))$"
+
 int
 is_ifindex(char *str)
 {
 	return (str && str[0] &&
-		pcre_custom_match(str, LEX_IFINDEX, "^(0|([1-9][0-9]*))$") == 1);
+		pcre_custom_match(str, LEX_IFINDEX, IFINDEX_PATTERN) == 1);
 }
 
 /*
- * Linux ethernet interface name of "eth<0-x>" format
- */
-int
-is_eth_ifname(char *str)
-{
-	char	*ptr;
-	int	ifindex;
-
-	if (!str || !str[0] || eth_ifnum <= 0 ||
-	    strncmp(str, "eth", 3) != 0 ||
-	    !(*(ptr = (str + 3))) || !is_ifindex(ptr)) {
-		return 0;
-	}
-	return ((ifindex = atoi(ptr)) >= 0 && ifindex < eth_ifnum);
-}
-
-/*
- * Get number of interface by prefix, e.g. "eth", "tun", "ppp"
+ * Load names of Linux interfaces with given prefix, e.g. "eth", "tun",
+ * "ppp" into names[]. Return number of names, -1 on error.
  */
 static int
-get_dev_ifnum(char *prefix)
+get_dev_ifnames(char *prefix, char names[][IFNAMSIZ], int max)
 {
 	FILE	*fp;
 	char	line[256];
 	char	*tok;
-	int	len, n, ifidx = -1;
+	int	len, n = 0;
 
 	if (!prefix || !prefix[0]) return -1;
 	len = strlen(prefix);
@@ -71,33 +58,47 @@ get_dev_ifnum(char *prefix)
 		return -1;
 	}
 
-	while (fgets(line, sizeof(line), fp)) {
+	while (n < max && fgets(line, sizeof(line), fp)) {
 		tok = strtok(line, " \t:");
 		if (tok == NULL) continue;
-		if (strncmp(tok, prefix, len) != 0) continue;
-		if (*(tok + len) && (n = atoi(tok + len)) > ifidx)
-			ifidx = n;
+		if (strncmp(tok, prefix, len) != 0 || !*(tok + len)) continue;
+		snprintf(names[n++], IFNAMSIZ, "%s", tok);
 	}
 	fclose(fp);
 
-	return ((ifidx < 0) ? 0 : (ifidx + 1));
+	return n;
 }
 
 /*
- * Register customized lex types
+ * Reload the set of Linux ethernet interface names, ETH_IFNAME accepts
+ * only names present now. It is safe to call while other threads are
+ * parsing, e.g. on a netlink link event.
  */
 int
-mylex_init()
+refresh_eth_ifnames()
 {
-	char	help[80];
+	char	names[MAX_ETH_IFNUM][IFNAMSIZ];
+	char	*vals[MAX_ETH_IFNUM];
+	int	i, n;
 
-	eth_ifnum = get_dev_ifnum("eth");
+	if ((n = get_dev_ifnames("eth", names, MAX_ETH_IFNUM)) < 0)
+		return -1;
+	for (i = 0; i < n; i++)
+		vals[i] = names[i];
+
+	return lex_enum_replace(LEX_ETH_IFNAME, vals, n);
+}
 
+/*
+ * Register customized lex types
+ */
+int
+mylex_init()
+{
 	set_custom_lex_ent(LEX_IFINDEX, "IFINDEX", is_ifindex, "Interface index", NULL);
+	pcre_custom_compile(LEX_IFINDEX, IFINDEX_PATTERN);
 
-	if (eth_ifnum > 0) {
-		snprintf(help, sizeof(help), "eth<0-%d>", eth_ifnum - 1);
-		set_custom_lex_ent(LEX_ETH_IFNAME, "ETH_IFNAME", is_eth_ifname, help, "eth");
-	}
+	set_enum_lex_ent(LEX_ETH_IFNAME, "ETH_IFNAME", "Ethernet interface name");
+	refresh_eth_ifnames();
 	return 0;
 }
@@ -22,26 +22,524 @@
  * lex.c, the lexical parsing module of libocli
  */
 
+#ifndef _GNU_SOURCE
+#define	_GNU_SOURCE	/* writer preferring rwlock of enum sets */
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <sys/types.h>
 #include <string.h>
-#include <pcre.h>
+#include <stdint.h>
+#include <pthread.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+#define	PCRE2_CODE_UNIT_WIDTH	8
+#include <pcre2.h>
+
+/* x86 vector kernels, picked by cpu features at lex_init() */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    !defined(LEX_NO_SIMD)
+#define	LEX_SIMD
+#include <immintrin.h>
+#endif
+
 #include "lex.h"
 
 static int	lex_init_ok = 0;
 
-/* pcre precompile local cache */
-static pcre	*pcre_cache[MAX_LEX_TYPE];
+/*
+ * once frozen, lex entries and the name index are never written again
+ * until lex_exit(), so that validators can be called from any thread
+ * lock-free. an empty pcre cache slot is still filled once, see
+ * pcre_cache_pattern().
+ */
+static int	lex_frozen = 0;
+
+#define	LEX_FROZEN()	__atomic_load_n(&lex_frozen, __ATOMIC_ACQUIRE)
+
+/* pcre precompile local cache of built-in types */
+static pcre2_code *pcre_cache[LEX_CUSTOM_BASE_TYPE];
+
+/*
+ * step budget of one pcre match, a token exceeding it is rejected.
+ * build with -DLEX_MATCH_LIMIT=n to change the default.
+ */
+#ifndef	LEX_MATCH_LIMIT
+#define	LEX_MATCH_LIMIT	100000
+#endif
+
+static u_int32_t lex_match_limit = LEX_MATCH_LIMIT;
+static pcre2_match_context *lex_mctx = NULL;
+
+/*
+ * match by pcre2_dfa_match() instead of backtracking, so time is linear
+ * in the length of token. it needs a workspace per thread, which starts
+ * in TLS and doubles on the heap up to LEX_DFA_WS_MAX ints. a token that
+ * needs more is rejected.
+ */
+#define	LEX_DFA_WS_SIZE	1024
+#ifndef	LEX_DFA_WS_MAX
+#define	LEX_DFA_WS_MAX	(64 * 1024)
+#endif
+
+static int	lex_dfa = 0;
+static __thread int dfa_ws_tls[LEX_DFA_WS_SIZE];
+static __thread int *dfa_ws = NULL;
+static __thread int dfa_ws_size = 0;
+static pthread_key_t dfa_ws_key;
+
+/*
+ * per thread match data, only the result of match is concerned so one
+ * ovector pair is enough. released by the key destructor on thread exit.
+ */
+static __thread pcre2_match_data *match_data = NULL;
+static pthread_key_t match_data_key;
+static pthread_once_t match_data_once = PTHREAD_ONCE_INIT;
+
+/* built-in lex entries */
+static struct lex_ent lex_ent[LEX_CUSTOM_BASE_TYPE];
+
+/* customized lex entries, allocated on registration */
+static struct lex_ent **custom_ent = NULL;
+static int custom_ent_num = 0;
+
+/*
+ * name to type index of registered entries, open addressing with linear
+ * probing, a slot holds type + 1 or 0 if empty. kept at most half full.
+ */
+static int	*lex_name_hash = NULL;
+static u_int	lex_name_hash_size = 0;
+static u_int	lex_name_hash_used = 0;
+
+/*
+ * pcre state of customized types, allocated on registration or by
+ * pcre_custom_compile(), so the table is not grown once frozen
+ */
+struct custom_pcre {
+	pcre2_code *code;	/* precompile cache */
+	char	*pattern;	/* pattern compiled by pcre_custom_compile() */
+};
+
+static struct custom_pcre **custom_pcre = NULL;
+static int custom_pcre_num = 0;
+
+#define	CUSTOM_PATTERN(i) \
+	((i) < custom_pcre_num && custom_pcre[i] ? custom_pcre[i]->pattern : NULL)
+
+/*
+ * combined matcher of customized patterns, opt-in by lex_combine_custom().
+ * each pattern is an atomic branch followed by a callout of its index,
+ * and a final (*FAIL) forces all branches to be tried in one pcre2_match().
+ */
+static pcre2_code *combined_code = NULL;
+static pcre2_match_context *combined_mctx = NULL;
+static custom_lexmask_t combined_set;	/* types inside combined_code */
+static int	combined_gen = 0;	/* bumped on each combining */
+
+#define	COMBINED_TOK_LEN	128
+
+/* the combined matcher backtracks, it is bypassed in dfa mode */
+#define	COMBINED_ON()	(combined_code != NULL && !lex_dfa)
+
+/* types matched by the last token in this thread */
+static __thread struct {
+	int	gen;
+	char	tok[COMBINED_TOK_LEN];
+	custom_lexmask_t mask;
+} combined_last;
+
+/* mask set by combined_callout() */
+static __thread custom_lexmask_t *combined_mask;
+
+/*
+ * regular expressions of built-in lex types, all precompiled by lex_init()
+ */
+static char *lex_pattern[LEX_CUSTOM_BASE_TYPE] = {
+	[LEX_IP_ADDR] =
+		"^(([01]?\\d\\d?|2[0-4]\\d|25[0-5])\\.){3}"
+		"([01]?\\d\\d?|2[0-4]\\d|25[0-5])$",
+	[LEX_IP_PREFIX] =
+		"^(([01]?\\d\\d?|2[0-4]\\d|25[0-5])\\.){3}"
+		"([01]?\\d\\d?|2[0-4]\\d|25[0-5])"
+		"(/[0-2]?\\d|/3[0-2])$",
+	[LEX_IP_BLOCK] =
+		"^(([01]?\\d\\d?|2[0-4]\\d|25[0-5])\\.){3}"
+		"([01]?\\d\\d?|2[0-4]\\d|25[0-5])"
+		"(/[0-2]?\\d|/3[0-2])?$",
+	[LEX_IP_RANGE] =
+		"^(([01]?\\d\\d?|2[0-4]\\d|25[0-5])\\.){3}"
+		"([01]?\\d\\d?|2[0-4]\\d|25[0-5])"
+		"(\\-(([01]?\\d\\d?|2[0-4]\\d|25[0-5])\\.){3}"
+		"([01]?\\d\\d?|2[0-4]\\d|25[0-5]))?$",
+	[LEX_PORT] =
+		"^(([0-9]{1,4})|([0-5][0-9]{1,4})|"
+		"(6[0-4][0-9][0-9][0-9])|(65[0-4][0-9][0-9])|"
+		"(655[0-2][0-9])|(6553[0-5]))$",
+	[LEX_PORT_RANGE] =
+		"^(([0-9]{1,4})|([0-5][0-9]{1,4})|"
+		"(6[0-4][0-9][0-9][0-9])|(65[0-4][0-9][0-9])|"
+		"(655[0-2][0-9])|(6553[0-5]))"
+		"(-(([0-9]{1,4})|([0-5][0-9]{1,4})|"
+		"(6[0-4][0-9][0-9][0-9])|(65[0-4][0-9][0-9])|"
+		"(655[0-2][0-9])|(6553[0-5])))?$",
+	[LEX_VLAN_ID] =
+		"^(([0]*[1-9])|([0]*[1-9][0-9]{1,2})|"
+		"([0]*[1-3][0-9]{1,3})|"
+		"([0]*40[0-8][0-9])|"
+		"([0]*409[0-4]))$",
+	[LEX_MAC_ADDR] =
+		"^(([A-Fa-f0-9]{10})|(([A-Fa-f0-9]{2}[:\\-]){5}))"
+		"([A-Fa-f0-9]{2})$",
+	[LEX_WORD] =
+		"^([a-zA-Z]+)(\\w|-)*$",
+	[LEX_WORDS] =
+		"^[\\w\\W]+$",
+	[LEX_INT] =
+		"^(\\d+)$",
+	[LEX_SINT] =
+		"^(-?\\d+)$",
+	[LEX_HEX] =
+		"^(0[xX])?([\\da-fA-F]{1,16})$",
+	[LEX_DECIMAL] =
+		"^(\\d+)(\\.\\d*)?$",
+	[LEX_HOST_NAME] =
+		"^(\\w[\\w\\-]*)"
+		"((\\.\\w[\\w\\-]*)*(\\.[A-Za-z]+))?$",
+	[LEX_DOMAIN_NAME] =
+		"^(\\w[\\w\\-]*\\.)+"
+		"([A-Za-z0-9]+)$",
+	[LEX_EMAIL_ADDR] =
+		"^(\\w[\\w\\-\\.]*@)"
+		"(\\w[\\w\\-]*\\.)+"
+		"([A-Za-z]+)$",
+	[LEX_HTTP_URL] =
+		"^[hH][tT][tT][pP]:\\/\\/"
+		"([\\w\\-]+\\.)+\\w+"
+		"(:(([0-9]{1,4})|([0-5][0-9]{1,4})|(6[0-5][0-5][0-3][0-5])))?"
+		"(\\/[\\w\\.\\-\\?#%=+&]*)*\\/?$",
+	[LEX_HTTPS_URL] =
+		"^[hH][tT][tT][pP][sS]:\\/\\/"
+		"([\\w\\-]+\\.)+\\w+"
+		"(:(([0-9]{1,4})|([0-5][0-9]{1,4})|(6[0-5][0-5][0-3][0-5])))?"
+		"(\\/[\\w\\.\\-\\?#%=+&]*)*\\/?$",
+	[LEX_FTP_URL] =
+		"^[fF][tT][pP]:\\/\\/"
+		"([\\w\\-]+[\\.]?\\w+:[\\w\\-\\.]+@)?"
+		"([\\w\\-]+\\.)+\\w+"
+		"(\\/[\\w\\.\\-]+)+$",
+	[LEX_SCP_URL] =
+		"^[sS][cC][pP]:\\/\\/"
+		"[\\w\\-]+(\\.\\w+)?@"
+		"([\\w\\-]+\\.)+\\w+"
+		"(:(([0-9]{1,4})|([0-5][0-9]{1,4})|(6[0-5][0-5][0-3][0-5])))?"
+		"(\\/[\\w\\.\\-]+)+$",
+	[LEX_TFTP_URL] =
+		"^[tT][fF][tT][pP]:\\/\\/"
+		"([\\w\\-]+\\.)+\\w+"
+		"(\\/[\\w\\.\\-]+)+$",
+	[LEX_FILE_NAME] =
+		"^(\\w[\\w+\\-\\_\\.]*\\w)$",
+	[LEX_FILE_PATH] =
+		"^[\\/]?(\\w[\\w+\\-\\_\\.]*\\/)*"
+		"(\\w[\\w+\\-\\_\\.]*\\w)$",
+	[LEX_UID] =
+		"^(\\w[\\w\\.\\-]*\\w)$",
+	[LEX_NET_UID] =
+		"^(\\w[\\w\\.\\-]*\\w)"
+		"(@\\w(\\w*\\.)+\\w+)$",
+	[LEX_DATE_TIME] =
+		"^(20((1[5-9])|([2-9][0-9]))"
+		"((0[1-9])|(1[0-2]))"
+		"((0[1-9])|([1-2][0-9])|3[0-1])"
+		"(([0-1][0-9])|(2[0-3]))"
+		"([0-5][0-9]))"
+		"(\\.[0-5][0-9])?$",
+};
+
+/*
+ * use native scanners instead of pcre for the simple built-in types,
+ * build with -DLEX_PCRE_ONLY to start with the pcre path by default.
+ */
+#ifdef	LEX_PCRE_ONLY
+static int	lex_native = 0;
+#else
+static int	lex_native = 1;
+#endif
+
+/* pcre '$' matches at the very end, or right before a final newline */
+#define	AT_EOS(p)	(*(p) == '\0' || (*(p) == '\n' && *((p) + 1) == '\0'))
+
+#define	IS_DIGIT(c)	((u_char)((c) - '0') < 10)
+#define	IS_XDIGIT(c)	(IS_DIGIT(c) || (u_char)(((c) | 0x20) - 'a') < 6)
+#define	IS_LETTER(c)	((u_char)(((c) | 0x20) - 'a') < 26)
+#define	IS_WORD(c)	(IS_DIGIT(c) || IS_LETTER(c) || (c) == '_')
+
+/* char classes summarized by lex_classify() */
+#define	CC_DIGIT	0x0001
+#define	CC_XALPHA	0x0002	/* a-f A-F */
+#define	CC_ALPHA	0x0004	/* other letters */
+#define	CC_UNDER	0x0008	/* '_' */
+#define	CC_DOT		0x0010
+#define	CC_DASH		0x0020
+#define	CC_COLON	0x0040
+#define	CC_SLASH	0x0080
+#define	CC_AT		0x0100
+#define	CC_PLUS		0x0200
+#define	CC_OTHER	0x8000
+
+#define	CC_LETTER	(CC_XALPHA | CC_ALPHA)
+#define	CC_WORD		(CC_DIGIT | CC_LETTER | CC_UNDER)	/* pcre \w */
+
+/* all the summarized classes are inside set s */
+#define	CC_ONLY(cc, s)	(((cc) & ~(s)) == 0)
+
+static u_short	lex_cc[256];
+
+/* fails to compile once built-in types exceed the bits of lexmask_t */
+typedef char lexmask_check_t[(LEX_CUSTOM_BASE_TYPE <= 64) ? 1 : -1];
+
+/*
+ * compile a pattern, with JIT if enabled.
+ * JIT is optional, pcre2_match() falls back to the interpreter without it.
+ */
+static pcre2_code *
+pcre_compile_opts(char *pattern, uint32_t options, int jit)
+{
+	pcre2_code *code;
+	PCRE2_UCHAR errbuf[128];
+	PCRE2_SIZE erroffset = 0;
+	int	errcode = 0;
+
+	code = pcre2_compile((PCRE2_SPTR) pattern, PCRE2_ZERO_TERMINATED,
+			     options, &errcode, &erroffset, NULL);
+	if (code == NULL) {
+		pcre2_get_error_message(errcode, errbuf, sizeof(errbuf));
+		fprintf(stderr, "pcre2_compile: %s at offset %d\n",
+			(char *) errbuf, (int) erroffset);
+		return NULL;
+	}
+
+	if (jit)
+		pcre2_jit_compile(code, PCRE2_JIT_COMPLETE | PCRE2_JIT_PARTIAL_SOFT);
+	return code;
+}
+
+static pcre2_code *
+pcre_compile_jit(char *pattern, int jit)
+{
+	return pcre_compile_opts(pattern, 0, jit);
+}
+
+/*
+ * allocate the pcre state of a customized type, grow the table if needed
+ */
+static struct custom_pcre *
+alloc_custom_pcre(int type)
+{
+	struct custom_pcre **cps;
+	int	i = type - LEX_CUSTOM_BASE_TYPE, num;
+
+	if (i >= custom_pcre_num) {
+		num = (custom_pcre_num) ? custom_pcre_num : 16;
+		while (num <= i) num *= 2;
+		if (num > MAX_CUSTOM_LEX_NUM) num = MAX_CUSTOM_LEX_NUM;
+
+		if ((cps = realloc(custom_pcre, sizeof(*cps) * num)) == NULL)
+			return NULL;
+		bzero(&cps[custom_pcre_num],
+		      sizeof(*cps) * (num - custom_pcre_num));
+		custom_pcre = cps;
+		custom_pcre_num = num;
+	}
+
+	if (custom_pcre[i] == NULL)
+		custom_pcre[i] = calloc(1, sizeof(struct custom_pcre));
+	return custom_pcre[i];
+}
+
+/*
+ * get the cache slot of type idx, allocated on demand until frozen.
+ * return NULL if the type has none.
+ */
+static pcre2_code **
+pcre_cache_slot(int idx)
+{
+	struct custom_pcre *cp;
+	int	i = idx - LEX_CUSTOM_BASE_TYPE;
+
+	if (IS_BUILTIN_LEX_TYPE(idx))
+		return &pcre_cache[idx];
+	if (!IS_CUSTOM_LEX_TYPE(idx))
+		return NULL;
+
+	if (i < custom_pcre_num && custom_pcre[i] != NULL)
+		return &custom_pcre[i]->code;
+	if (LEX_FROZEN() || (cp = alloc_custom_pcre(idx)) == NULL)
+		return NULL;
+	return &cp->code;
+}
+
+/*
+ * get cached code of type idx from slot, compile pattern into it on a
+ * miss. a slot is written only once by compare and swap, so that a
+ * customized pattern missed before lex_freeze() is still cached by the
+ * first thread matching it. return NULL if pattern does not compile.
+ */
+static pcre2_code *
+pcre_cache_pattern(pcre2_code **slot, int idx, char *pattern)
+{
+	pcre2_code *code, *empty = NULL;
+
+	if ((code = __atomic_load_n(slot, __ATOMIC_ACQUIRE)) != NULL)
+		return code;
+
+	if (!pattern || !pattern[0] ||
+	    (code = pcre_compile_jit(pattern, 1)) == NULL)
+		return NULL;
+
+	if (!__atomic_compare_exchange_n(slot, &empty, code, 0,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		/* another thread cached it first */
+		pcre2_code_free(code);
+		return empty;
+	}
+
+	if (LEX_FROZEN())
+		fprintf(stderr, "lex: pattern of type %d compiled after "
+			"lex_freeze(), precompile it by pcre_custom_compile()\n",
+			idx);
+	return code;
+}
+
+static void
+free_match_data(void *md)
+{
+	pcre2_match_data_free((pcre2_match_data *) md);
+}
+
+static void
+create_match_data_key(void)
+{
+	pthread_key_create(&match_data_key, free_match_data);
+	pthread_key_create(&dfa_ws_key, free);
+}
+
+/*
+ * get match data of current thread, create it at the first call
+ */
+static pcre2_match_data *
+get_match_data(void)
+{
+	if (match_data != NULL)
+		return match_data;
+
+	pthread_once(&match_data_once, create_match_data_key);
+
+	if ((match_data = pcre2_match_data_create(1, NULL)) == NULL) {
+		fprintf(stderr, "pcre2_match_data_create: no memory\n");
+		return NULL;
+	}
+	pthread_setspecific(match_data_key, match_data);
+	return match_data;
+}
+
+/*
+ * double the dfa workspace of current thread on heap, return 0 if it
+ * would exceed LEX_DFA_WS_MAX or no memory.
+ */
+static int
+grow_dfa_ws(void)
+{
+	int	size = dfa_ws_size * 2;
+	int	*ws;
+
+	if (size > LEX_DFA_WS_MAX)
+		return 0;
+
+	/* the old contents are scratch, no need to realloc */
+	if ((ws = malloc(size * sizeof(int))) == NULL) {
+		fprintf(stderr, "lex: no memory for dfa workspace\n");
+		return 0;
+	}
+	if (dfa_ws != dfa_ws_tls)
+		free(dfa_ws);
+	dfa_ws = ws;
+	dfa_ws_size = size;
+	pthread_setspecific(dfa_ws_key, ws);
+	return 1;
+}
+
+/*
+ * match code over str, by the dfa matcher if enabled. a token which
+ * needs a workspace over LEX_DFA_WS_MAX gets PCRE2_ERROR_DFA_WSSIZE.
+ * the items it does not support, e.g. back references, fall back to
+ * pcre2_match(), which is bounded by the step budget.
+ */
+static int
+pcre_run(pcre2_code *code, char *str, uint32_t options, pcre2_match_data *md)
+{
+	size_t	len = strlen(str);
+	int	res;
+
+	if (lex_dfa) {
+		if (dfa_ws == NULL) {
+			/* the key is created along with match data */
+			dfa_ws = dfa_ws_tls;
+			dfa_ws_size = LEX_DFA_WS_SIZE;
+		}
+		/* any match of an anchored pattern will do */
+		while ((res = pcre2_dfa_match(code, (PCRE2_SPTR) str, len, 0,
+				options ? options : PCRE2_DFA_SHORTEST,
+				md, lex_mctx, dfa_ws, dfa_ws_size)) ==
+		       PCRE2_ERROR_DFA_WSSIZE) {
+			if (!grow_dfa_ws())
+				return res;
+		}
+		if (res > PCRE2_ERROR_DFA_BADRESTART ||
+		    res < PCRE2_ERROR_DFA_UITEM)
+			return res;
+	}
+
+	return pcre2_match(code, (PCRE2_SPTR) str, len, 0, options, md,
+			   lex_mctx);
+}
+
+/*
+ * run pattern over str with pcre2_match() options, return its result,
+ * or PCRE2_ERROR_NOMEMORY if the pattern is unusable.
+ */
+static int
+pcre_exec_opts(char *str, int idx, char *pattern, uint32_t options)
+{
+	pcre2_code *code, **slot;
+	pcre2_match_data *md;
+	int	res;
+
+	if ((md = get_match_data()) == NULL)
+		return PCRE2_ERROR_NOMEMORY;
+
+	/* try cache before compile */
+	if ((slot = pcre_cache_slot(idx)) != NULL) {
+		if ((code = pcre_cache_pattern(slot, idx, pattern)) == NULL)
+			return PCRE2_ERROR_NOMEMORY;
+
+	} else if ((code = pcre_compile_jit(pattern, 0)) == NULL) {
+		return PCRE2_ERROR_NOMEMORY;
+	}
+			    
+	res = pcre_run(code, str, options, md);
 
-#define	OVECSIZE	30	/* man pcre said: must be multiple of 3 */
+	/* not cached, release it immediately */
+	if (slot == NULL) {
+		pcre2_code_free(code);
+	}
 
-static struct lex_ent lex_ent[MAX_LEX_TYPE];
+	return res;
+}
 
 /*
  * pcre match function
@@ -49,665 +547,2469 @@ static struct lex_ent lex_ent[MAX_LEX_TYPE];
 static int
 pcre_match(char *str, int idx, char *pattern)
 {
-	static pcre *pcre = NULL;
-	const char *errptr = NULL;
-	int	erroffset = 0;
-	int	ovector[OVECSIZE];
 	int	res;
-	
+
 	if (!str || !str[0] || !pattern || !pattern[0])
 		return 0;
 
-	/* try cache before compile */
-	if (idx >= 0 && idx < MAX_LEX_TYPE && pcre_cache[idx] != NULL) {
-		pcre = pcre_cache[idx];
+	if ((res = pcre_exec_opts(str, idx, pattern, 0)) == PCRE2_ERROR_NOMEMORY)
+		return -1;
 
-	} else {
-		pcre = pcre_compile(pattern, 0, &errptr, &erroffset, NULL);
-		if (pcre == NULL) {
-			fprintf(stderr, "pcre_comile: %s\n", errptr);
-			return -1;
+	return (res >= 0);
+}
+
+/*
+ * pcre partial match, is str a complete match or could it become one
+ * when more chars are appended ?
+ */
+static int
+pcre_partial(char *str, int idx, char *pattern)
+{
+	int	res;
+
+	if (!pattern || !pattern[0])
+		return 0;
+	if (!str || !str[0])
+		return 1;
+
+	res = pcre_exec_opts(str, idx, pattern, PCRE2_PARTIAL_SOFT);
+	if (res == PCRE2_ERROR_NOMEMORY || res == PCRE2_ERROR_MATCHLIMIT ||
+	    res == PCRE2_ERROR_DEPTHLIMIT || res == PCRE2_ERROR_HEAPLIMIT)
+		return -1;
+
+	return (res >= 0 || res == PCRE2_ERROR_PARTIAL);
+}
+
+/*
+ * scan 1 ~ max_len decimal digits and set back the value.
+ * return pointer to the char after the digits, or NULL if there is no
+ * digit or more than max_len digits.
+ */
+static char *
+scan_digits(char *p, int max_len, u_int *val)
+{
+	u_int	v = 0;
+	int	n;
+
+	for (n = 0; n < max_len && IS_DIGIT(p[n]); n++)
+		v = v * 10 + (p[n] - '0');
+
+	if (n == 0 || IS_DIGIT(p[n]))
+		return NULL;
+
+	*val = v;
+	return (p + n);
+}
+
+/*
+ * scan a dotted ipv4 address, each octet is 1 ~ 3 digits not above 255.
+ * return pointer to the char after the address, or NULL if unmatched.
+ */
+static char *
+scan_ip4(char *p, u_int *addr)
+{
+	u_int	v, a = 0;
+	int	i;
+
+	for (i = 0; i < 4; i++) {
+		if (i > 0 && *p++ != '.')
+			return NULL;
+		if ((p = scan_digits(p, 3, &v)) == NULL || v > 255)
+			return NULL;
+		a = (a << 8) | v;
+	}
+
+	if (addr) *addr = a;
+	return p;
+}
+
+/*
+ * scan a "/<0-32>" mask bits suffix, 1 ~ 2 digits.
+ */
+static char *
+scan_ip4_bits(char *p)
+{
+	u_int	v;
+
+	if (*p != '/' || (p = scan_digits(p + 1, 2, &v)) == NULL || v > 32)
+		return NULL;
+	return p;
+}
+
+/*
+ * scan a port number <0-65535>, 1 ~ 5 digits.
+ */
+static char *
+scan_port(char *p)
+{
+	u_int	v;
+
+	if ((p = scan_digits(p, 5, &v)) == NULL || v > 65535)
+		return NULL;
+	return p;
+}
+
+/*
+ * scan the dotted ipv4 tail of an ipv6 address, no leading '0' is
+ * allowed in an octet as inet_pton() does.
+ */
+static char *
+scan_ip6_ip4(char *p, u_char *addr)
+{
+	u_int	v;
+	int	i;
+
+	for (i = 0; i < 4; i++) {
+		if (i > 0 && *p++ != '.')
+			return NULL;
+		if (p[0] == '0' && IS_DIGIT(p[1]))
+			return NULL;
+		if ((p = scan_digits(p, 3, &v)) == NULL || v > 255)
+			return NULL;
+		addr[i] = v;
+	}
+	return p;
+}
+
+/*
+ * scan an ipv6 address in a single pass, accepting the same strings as
+ * inet_pton(). set back the address if ia6 is not NULL. return pointer
+ * to the char after the address, or NULL if unmatched.
+ */
+static char *
+scan_ip6(char *p, struct in6_addr *ia6)
+{
+	u_char	addr[16];
+	u_int	v;
+	int	n, len = 0, gap = -1;
+
+	if (p[0] == ':') {
+		if (p[1] != ':')
+			return NULL;
+		gap = 0;
+		p += 2;
+	}
+
+	for (;;) {
+		for (n = 0, v = 0; n < 5 && IS_XDIGIT(p[n]); n++)
+			v = (v << 4) | (IS_DIGIT(p[n]) ?
+				p[n] - '0' : (p[n] | 0x20) - 'a' + 10);
+
+		/* nothing follows "::" */
+		if (n == 0)
+			break;
+		if (n > 4)
+			return NULL;
+
+		/* ipv4 in the last 32 bits */
+		if (p[n] == '.') {
+			if (len + 4 > 16 || (p = scan_ip6_ip4(p, &addr[len])) == NULL)
+				return NULL;
+			len += 4;
+			break;
 		}
-		/* store it if never cache before */
-		if (idx >= 0 && idx < MAX_LEX_TYPE && pcre_cache[idx] == NULL) {
-			pcre_cache[idx] = pcre;
+
+		if (len + 2 > 16)
+			return NULL;
+		addr[len++] = v >> 8;
+		addr[len++] = v & 0xff;
+		p += n;
+
+		if (p[0] != ':')
+			break;
+		if (p[1] == ':') {
+			if (gap >= 0)
+				return NULL;
+			gap = len;
+			p += 2;
+		} else if (!IS_XDIGIT(p[1])) {
+			return NULL;
+		} else {
+			p++;
 		}
 	}
-			    
-	res = pcre_exec(pcre, NULL, str, strlen(str), 0, 0, ovector, OVECSIZE);
 
-	/* out of cache range, release it immediately */
-	if (idx < 0 || idx >= MAX_LEX_TYPE) {
-		pcre_free(pcre);
+	/* "::" stands for one or more zero groups */
+	if (gap >= 0) {
+		if (len == 16)
+			return NULL;
+		memmove(&addr[16 - (len - gap)], &addr[gap], len - gap);
+		bzero(&addr[gap], 16 - len);
+	} else if (len != 16) {
+		return NULL;
 	}
 
-	return (res >= 0);
+	if (ia6) memcpy(ia6, addr, 16);
+	return p;
 }
 
 /*
- * wrapped pcre_match only for customized lex types
+ * parse an ipv6 address with an optional "/<0-128>" prefix length.
+ * return 1 if str is an address, 2 if an address with prefix length, or
+ * 0 if neither. the prefix length is 128 if there is none.
  */
-int
-pcre_custom_match(char *str, int idx, char *pattern)
+static int
+parse_ip6(char *str, struct in6_addr *ia6, int *pfx_len)
 {
-	if (!IS_CUSTOM_LEX_TYPE(idx)) {
-		fprintf(stderr, "invalid customized lex index %d\n", idx);
+	char	*p;
+	u_int	v = 0;
+
+	if ((p = scan_ip6(str, ia6)) == NULL)
+		return 0;
+
+	if (*p == '\0') {
+		if (pfx_len) *pfx_len = 128;
+		return 1;
+	}
+
+	/* any number of digits as atoi() reads them */
+	if (*p++ != '/' || !IS_DIGIT(*p))
 		return 0;
+	for (; IS_DIGIT(*p); p++) {
+		if ((v = v * 10 + (*p - '0')) > 128)
+			v = 129;
 	}
-	return pcre_match(str, idx, pattern);
+	if (v > 128 || !AT_EOS(p))
+		return 0;
+
+	if (pfx_len) *pfx_len = v;
+	return 2;
 }
 
 /*
- * is str an ipv4 address ?
+ * char sets of URL scanners, bit c of the two words for an ascii char c.
+ * one test per char keeps the scanning loops free of compare chains.
  */
-int
-is_ip_addr(char *str)
+static const u_int64_t uri_word[2] =		/* \w */
+	{ 0x03ff000000000000ULL, 0x07fffffe87fffffeULL };
+static const u_int64_t uri_label[2] =		/* [\w-] */
+	{ 0x03ff200000000000ULL, 0x07fffffe87fffffeULL };
+static const u_int64_t uri_file[2] =		/* [\w.-] */
+	{ 0x03ff600000000000ULL, 0x07fffffe87fffffeULL };
+static const u_int64_t uri_http_path[2] =	/* [\w/.?#%=+&-] */
+	{ 0xa3ffe86800000000ULL, 0x07fffffe87fffffeULL };
+
+#define	IN_URI_SET(c, set) \
+	((u_char) (c) < 128 && ((set)[(u_char) (c) >> 6] >> ((c) & 63) & 1))
+
+/*
+ * scan a host of URLs, labels of [\w-]+ joined by '.', at least two
+ * labels and the last one without '-'.
+ */
+static char *
+scan_uri_host(char *p)
 {
-	int	res;
+	int	n, dots = 0;
+
+	for (;;) {
+		for (n = 0; IN_URI_SET(p[n], uri_label); n++);
+		if (n == 0)
+			return NULL;
+		if (p[n] != '.')
+			break;
+		p += n + 1;
+		dots++;
+	}
+	return (dots > 0 && !memchr(p, '-', n)) ? p + n : NULL;
+}
 
-	if (!str || !str[0]) return 0;
+/*
+ * scan a port of URLs, 1 ~ 4 digits, 5 digits starting with 0 ~ 5, or
+ * 6[0-5][0-5][0-3][0-5] as the patterns do.
+ */
+static char *
+scan_uri_port(char *p)
+{
+	int	n;
 
-	res = pcre_match(str, LEX_IP_ADDR,
-			 "^(([01]?\\d\\d?|2[0-4]\\d|25[0-5])\\.){3}"
-			 "([01]?\\d\\d?|2[0-4]\\d|25[0-5])$");
-	return (res == 1);
+	for (n = 0; n < 6 && IS_DIGIT(p[n]); n++);
+
+	if (n >= 1 && n <= 4)
+		return (p + n);
+	if (n == 5 && (p[0] <= '5' || (p[0] == '6' && p[1] <= '5' &&
+	    p[2] <= '5' && p[3] <= '3' && p[4] <= '5')))
+		return (p + n);
+	return NULL;
 }
 
 /*
- * is str an ipv4 mask ?
+ * scan a path of ftp, scp and tftp URLs, one or more "/[\w.-]+"
+ */
+static char *
+scan_uri_file_path(char *p)
+{
+	int	n, num = 0;
+
+	while (*p == '/') {
+		for (n = 1; IN_URI_SET(p[n], uri_file); n++);
+		if (n == 1)
+			return NULL;
+		p += n;
+		num++;
+	}
+	return (num > 0) ? p : NULL;
+}
+
+/* schemes of LEX_HTTP_URL ~ LEX_TFTP_URL */
+static const char *uri_scheme[] = { "http", "https", "ftp", "scp", "tftp" };
+
+#define	SET_SPAN(sp, start, end) \
+	do { (sp).off = (start) - str; (sp).len = (end) - (start); } while (0)
+
+/*
+ * validate an URL and split it into spans of elements in a single pass,
+ * str is never modified. accept the same strings as the patterns of the
+ * LEX_*_URL types. set back the spans if uri is not NULL, and return the
+ * lex type of the URL, or -1 if str is not an URL.
  */
 int
-is_ip_mask(char *str)
+get_uri_spans(char *str, uri_spans_t *uri)
 {
-	u_int	ia;
-	u_int	m = 0xffffffff;	/* init as a all one mask */
-	int	i;
+	uri_spans_t spans;
+	char	*p, *q, *r;
+	int	type;
 
-	if (!is_ip_addr(str)) return 0;
+	if (!str || !str[0]) return -1;
+	if (!uri) uri = &spans;
+	bzero(uri, sizeof(uri_spans_t));
 
-	ia = ntohl(inet_addr(str));
+	/* pick the scheme by its length, then compare it once */
+	for (p = str; IS_LETTER(*p) && p - str < 5; p++);
+	if (p[0] != ':' || p[1] != '/' || p[2] != '/')
+		return -1;
+	switch (p - str) {
+	case 3:
+		type = ((str[0] | 0x20) == 'f') ? LEX_FTP_URL : LEX_SCP_URL;
+		break;
+	case 4:
+		type = ((str[0] | 0x20) == 'h') ? LEX_HTTP_URL : LEX_TFTP_URL;
+		break;
+	case 5:
+		type = LEX_HTTPS_URL;
+		break;
+	default:
+		return -1;
+	}
+	if (strncasecmp(str, uri_scheme[type - LEX_HTTP_URL], p - str) != 0)
+		return -1;
+
+	SET_SPAN(uri->scheme, str, p);
+	p += 3;
+
+	if (type == LEX_FTP_URL) {
+		/* [\w-]+\.?\w+:[\w.-]+@ is optional */
+		for (q = p; IN_URI_SET(*q, uri_file); q++);
+		if (*q == ':') {
+			for (r = q + 1; IN_URI_SET(*r, uri_file); r++);
+			if (r == q + 1 || *r != '@')
+				return -1;
+			if ((r = memchr(p, '.', q - p)) != NULL) {
+				if (r == p || !IS_WORD(r[1]) ||
+				    memchr(r + 1, '.', q - r - 1))
+					return -1;
+				for (r++; r < q && IS_WORD(*r); r++);
+				if (r != q)
+					return -1;
+			} else if (q - p < 2 || !IS_WORD(q[-1])) {
+				return -1;
+			}
+			SET_SPAN(uri->user, p, q);
+			for (r = q + 1; *r != '@'; r++);
+			SET_SPAN(uri->password, q + 1, r);
+			SET_SPAN(uri->userinfo, p, r);
+			p = r + 1;
+		}
+	} else if (type == LEX_SCP_URL) {
+		/* [\w-]+(\.\w+)?@ is required */
+		for (q = p; IN_URI_SET(*q, uri_label); q++);
+		if (q == p)
+			return -1;
+		if (*q == '.') {
+			for (r = q + 1; IN_URI_SET(*r, uri_word); r++);
+			if (r == q + 1)
+				return -1;
+			q = r;
+		}
+		if (*q != '@')
+			return -1;
+		SET_SPAN(uri->user, p, q);
+		SET_SPAN(uri->userinfo, p, q);
+		p = q + 1;
+	}
+
+	if ((q = scan_uri_host(p)) == NULL)
+		return -1;
+	SET_SPAN(uri->host, p, q);
+	p = q;
+
+	if (*p == ':' && type != LEX_FTP_URL && type != LEX_TFTP_URL) {
+		if ((q = scan_uri_port(p + 1)) == NULL)
+			return -1;
+		SET_SPAN(uri->port, p + 1, q);
+		p = q;
+	}
+
+	if (type == LEX_HTTP_URL || type == LEX_HTTPS_URL) {
+		q = p;
+		if (*q == '/')
+			while (IN_URI_SET(*q, uri_http_path)) q++;
+	} else if ((q = scan_uri_file_path(p)) == NULL) {
+		return -1;
+	}
+	if (!AT_EOS(q))
+		return -1;
+
+	/* path and file as get_uri_elements() splits them */
+	if (*p == '/') {
+		SET_SPAN(uri->path, p + 1, q);
+		for (r = q; r[-1] != '/'; r--);
+		SET_SPAN(uri->file, r, q);
+	}
+
+	return type;
+}
+
+#ifdef LEX_SIMD
+/*
+ * char class bitmasks of a token up to 32 chars, bit i for char i
+ */
+struct tok_mask {
+	u_int	xdigit;		/* 0-9 a-f A-F */
+	u_int	sep;		/* ':' or '-' */
+};
+
+typedef void (*tok_mask_fun_t)(const u_char *buf, struct tok_mask *tm);
+
+/* NULL if cpu has no usable vector unit, then scalar scanners are used */
+static tok_mask_fun_t tok_mask_fun = NULL;
+
+__attribute__((target("sse4.2")))
+static void
+tok_mask_sse42(const u_char *buf, struct tok_mask *tm)
+{
+	const __m128i xdigit = _mm_setr_epi8('0', '9', 'a', 'f', 'A', 'F', 0, 0,
+					     0, 0, 0, 0, 0, 0, 0, 0);
+	__m128i	v;
+	int	i;
+
+	bzero(tm, sizeof(struct tok_mask));
+	for (i = 0; i < 32; i += 16) {
+		v = _mm_loadu_si128((const __m128i *) (buf + i));
+		tm->xdigit |= (u_int) _mm_cvtsi128_si32(_mm_cmpistrm(xdigit, v,
+			_SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_BIT_MASK)) << i;
+		tm->sep |= (u_int) _mm_movemask_epi8(_mm_or_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8(':')),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('-')))) << i;
+	}
+}
+
+__attribute__((target("avx2")))
+static void
+tok_mask_avx2(const u_char *buf, struct tok_mask *tm)
+{
+	__m256i	v, d, x, is_d, is_x;
+
+	v = _mm256_loadu_si256((const __m256i *) buf);
+
+	/* unsigned (c - '0') <= 9, and ((c | 0x20) - 'a') <= 5 */
+	d = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+	is_d = _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+	x = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)),
+			    _mm256_set1_epi8('a'));
+	is_x = _mm256_cmpeq_epi8(_mm256_min_epu8(x, _mm256_set1_epi8(5)), x);
+
+	tm->xdigit = (u_int) _mm256_movemask_epi8(_mm256_or_si256(is_d, is_x));
+	tm->sep = (u_int) _mm256_movemask_epi8(_mm256_or_si256(
+		_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+		_mm256_cmpeq_epi8(v, _mm256_set1_epi8('-'))));
+}
+
+/*
+ * pick vector kernel by cpu features
+ */
+static void
+init_tok_mask(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		tok_mask_fun = tok_mask_avx2;
+	else if (__builtin_cpu_supports("sse4.2"))
+		tok_mask_fun = tok_mask_sse42;
+	else
+		tok_mask_fun = NULL;
+}
+
+#define	LOW_BITS(n)	((1U << (n)) - 1)
+
+/*
+ * get char class masks of the token at str, bits beyond it are cleared.
+ * the kernels load 32 bytes, so the token is copied into a zero padded
+ * buffer first and nothing past its terminating nul is read.
+ * return token length without a final newline, or -1 if it is longer
+ * than max_len.
+ */
+static int
+get_tok_mask(char *str, struct tok_mask *tm, int max_len)
+{
+	u_char	buf[32] = { 0 };
+	u_int	low;
+	int	len;
+
+	/* max_len is below 31, one more char for a final newline */
+	for (len = 0; str[len]; len++) {
+		if (len > max_len)
+			return -1;
+		buf[len] = str[len];
+	}
+	tok_mask_fun(buf, tm);
+
+	if (len > 0 && str[len - 1] == '\n')
+		len--;
+	if (len > max_len)
+		return -1;
+
+	low = LOW_BITS(len);
+	tm->xdigit &= low;
+	tm->sep &= low;
+	return len;
+}
+
+/*
+ * vector versions of native scanners of mac and hex. ipv4 address is
+ * left to scan_ip4(), which is faster than the vector scanner on short
+ * dotted-quads once the token is copied for the kernels.
+ */
+static int
+simd_mac_addr(char *str)
+{
+	struct tok_mask tm;
+	int	n;
+
+	/* most bad tokens fail on the first chars, before any copy */
+	if (!isxdigit((u_char) str[0]) || !isxdigit((u_char) str[1]) ||
+	    (n = get_tok_mask(str, &tm, 17)) < 0)
+		return 0;
+
+	/* 12 continual %x chars */
+	if (n == 12)
+		return (tm.xdigit == LOW_BITS(12));
+
+	/* or each %02x separated by ':' or '-', at char 2, 5, 8, 11, 14 */
+	return (n == 17 && tm.sep == 0x4924 &&
+		tm.xdigit == (LOW_BITS(17) & ~0x4924));
+}
+
+static int
+simd_hex(char *str)
+{
+	struct tok_mask tm;
+	int	n, start = 0;
+
+	if (!isxdigit((u_char) str[0]) || (n = get_tok_mask(str, &tm, 18)) < 0)
+		return 0;
+
+	if (n >= 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X'))
+		start = 2;
+
+	return (n - start >= 1 && n - start <= 16 &&
+		(tm.xdigit >> start) == LOW_BITS(n - start));
+}
+#endif	/* LEX_SIMD */
+
+/*
+ * native scanners, each one accepts exactly the same strings as the
+ * pcre pattern of its is_xxx() counterpart, without calling pcre_exec().
+ */
+static int
+native_ip_addr(char *str)
+{
+	char	*p;
+
+	return ((p = scan_ip4(str, NULL)) != NULL && AT_EOS(p));
+}
+
+static int
+native_ip_prefix(char *str)
+{
+	char	*p;
+
+	return ((p = scan_ip4(str, NULL)) != NULL &&
+		(p = scan_ip4_bits(p)) != NULL && AT_EOS(p));
+}
+
+static int
+native_ip_block(char *str)
+{
+	char	*p;
+
+	if ((p = scan_ip4(str, NULL)) == NULL)
+		return 0;
+	if (AT_EOS(p))
+		return 1;
+	return ((p = scan_ip4_bits(p)) != NULL && AT_EOS(p));
+}
+
+static int
+native_ip_range(char *str)
+{
+	char	*p;
+
+	if ((p = scan_ip4(str, NULL)) == NULL)
+		return 0;
+	if (AT_EOS(p))
+		return 1;
+	return (*p == '-' && (p = scan_ip4(p + 1, NULL)) != NULL && AT_EOS(p));
+}
+
+static int
+native_int(char *str)
+{
+	char	*p = str;
+
+	while (IS_DIGIT(*p)) p++;
+	return (p != str && AT_EOS(p));
+}
+
+static int
+native_sint(char *str)
+{
+	if (*str == '-') str++;
+	return native_int(str);
+}
+
+static int
+native_hex(char *str)
+{
+	char	*p = str;
+	int	n = 0;
+
+#ifdef LEX_SIMD
+	if (tok_mask_fun)
+		return simd_hex(str);
+#endif
+
+	if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+		p += 2;
+
+	while (n <= 16 && IS_XDIGIT(p[n])) n++;
+	return (n >= 1 && n <= 16 && AT_EOS(p + n));
+}
+
+static int
+native_decimal(char *str)
+{
+	char	*p = str;
+
+	while (IS_DIGIT(*p)) p++;
+	if (p == str)
+		return 0;
+	if (*p == '.') {
+		p++;
+		while (IS_DIGIT(*p)) p++;
+	}
+	return AT_EOS(p);
+}
+
+static int
+native_port(char *str)
+{
+	char	*p;
+
+	return ((p = scan_port(str)) != NULL && AT_EOS(p));
+}
+
+static int
+native_port_range(char *str)
+{
+	char	*p;
+
+	if ((p = scan_port(str)) == NULL)
+		return 0;
+	if (AT_EOS(p))
+		return 1;
+	return (*p == '-' && (p = scan_port(p + 1)) != NULL && AT_EOS(p));
+}
+
+static int
+native_vlan_id(char *str)
+{
+	char	*p = str;
+	u_int	v;
+
+	/* any number of leading '0', then 1 ~ 4 digits not starting with '0' */
+	while (*p == '0') p++;
+	return ((p = scan_digits(p, 4, &v)) != NULL &&
+		v >= 1 && v <= 4094 && AT_EOS(p));
+}
+
+static int
+native_mac_addr(char *str)
+{
+	int	i;
+
+#ifdef LEX_SIMD
+	if (tok_mask_fun)
+		return simd_mac_addr(str);
+#endif
+
+	/* 12 continual %x chars */
+	for (i = 0; i < 12 && IS_XDIGIT(str[i]); i++);
+	if (i == 12)
+		return AT_EOS(str + 12);
+
+	/* or each %02x separated by ':' or '-' */
+	for (i = 0; i < 17; i++) {
+		if (i % 3 == 2) {
+			if (str[i] != ':' && str[i] != '-')
+				return 0;
+		} else if (!IS_XDIGIT(str[i])) {
+			return 0;
+		}
+	}
+	return AT_EOS(str + 17);
+}
+
+/*
+ * enable or disable the native scanners, the pcre path is used if disabled
+ */
+void
+lex_set_native(int enabled)
+{
+	if (LEX_FROZEN()) {
+		fprintf(stderr, "lex_set_native: lex registry is frozen\n");
+		return;
+	}
+	lex_native = (enabled != 0);
+}
+
+/*
+ * set step budget of each pcre match, 0 for the pcre2 default.
+ * a token exceeding it is rejected, and is unknown to lex_partial().
+ */
+int
+lex_set_match_limit(u_int32_t limit)
+{
+	if (LEX_FROZEN()) {
+		fprintf(stderr, "lex_set_match_limit: lex registry is frozen\n");
+		return -1;
+	}
+	if (limit == 0)
+		pcre2_config(PCRE2_CONFIG_MATCHLIMIT, &limit);
+
+	if (lex_mctx == NULL &&
+	    (lex_mctx = pcre2_match_context_create(NULL)) == NULL) {
+		fprintf(stderr, "lex_set_match_limit: no memory\n");
+		return -1;
+	}
+	lex_match_limit = limit;
+	pcre2_set_match_limit(lex_mctx, limit);
+	if (combined_mctx != NULL)
+		pcre2_set_match_limit(combined_mctx, limit);
+	return 0;
+}
+
+/*
+ * enable or disable the dfa matcher for patterns. it never backtracks,
+ * the combined matcher of customized patterns is bypassed when enabled.
+ */
+void
+lex_set_dfa(int enabled)
+{
+	if (LEX_FROZEN()) {
+		fprintf(stderr, "lex_set_dfa: lex registry is frozen\n");
+		return;
+	}
+	lex_dfa = (enabled != 0);
+}
+
+/*
+ * drop the combined matcher, when a combined pattern is replaced or on exit
+ */
+static void
+drop_combined(void)
+{
+	if (combined_code != NULL) {
+		pcre2_code_free(combined_code);
+		combined_code = NULL;
+	}
+	bzero(&combined_set, sizeof(combined_set));
+	combined_gen++;
+}
+
+/*
+ * precompile the pattern of a customized lex type, so that the first
+ * pcre_custom_match() call needs not to compile it.
+ */
+int
+pcre_custom_compile(int idx, char *pattern)
+{
+	struct custom_pcre *cp;
+
+	if (!IS_CUSTOM_LEX_TYPE(idx)) {
+		fprintf(stderr, "invalid customized lex index %d\n", idx);
+		return -1;
+	}
+	if (LEX_FROZEN()) {
+		fprintf(stderr, "pcre_custom_compile: lex registry is frozen\n");
+		return -1;
+	}
+	if (!pattern || !pattern[0])
+		return -1;
+
+	if ((cp = alloc_custom_pcre(idx)) == NULL) {
+		fprintf(stderr, "pcre_custom_compile: no memory\n");
+		return -1;
+	}
+
+	/* a new pattern of the type replaces the cached and combined ones */
+	if (cp->pattern == NULL || strcmp(cp->pattern, pattern) != 0) {
+		if (cp->code != NULL) {
+			pcre2_code_free(cp->code);
+			cp->code = NULL;
+		}
+		if (cp->pattern != NULL && CUSTOM_LEX_ISSET(&combined_set, idx))
+			drop_combined();
+		if (cp->pattern != NULL) {
+			free(cp->pattern);
+			cp->pattern = NULL;
+		}
+	}
+
+	if (pcre_cache_pattern(&cp->code, idx, pattern) == NULL)
+		return -1;
+
+	/* keep it for combining */
+	if (cp->pattern == NULL && (cp->pattern = strdup(pattern)) == NULL) {
+		fprintf(stderr, "pcre_custom_compile: no memory\n");
+		return -1;
+	}
+	return 0;
+}
+
+static int
+combined_callout(pcre2_callout_block *cb, void *data)
+{
+	PCRE2_SIZE i;
+	int	idx = 0;
+
+	/* string callout (?C{idx}), numbered ones stop at 255 */
+	for (i = 0; i < cb->callout_string_length; i++)
+		idx = idx * 10 + (cb->callout_string[i] - '0');
+
+	CUSTOM_LEX_SET(combined_mask, LEX_CUSTOM_TYPE(idx));
+	return 0;
+}
+
+/*
+ * callout enumerator of pattern_combinable(), visiting each item of the
+ * pattern in data. return 1 to stop on an item which can not be combined.
+ */
+static int
+combinable_item(pcre2_callout_enumerate_block *cb, void *data)
+{
+	char	*p = (char *) data + cb->pattern_position;
+
+	/* recursion and subroutine calls, callouts */
+	if (p[0] == '(' && p[1] == '?' &&
+	    (p[2] == 'R' || p[2] == '&' || p[2] == 'C' || IS_DIGIT(p[2]) ||
+	     ((p[2] == '+' || p[2] == '-') && IS_DIGIT(p[3])) ||
+	     (p[2] == 'P' && p[3] == '>')))
+		return 1;
+
+	/* \g<n> and \g'n' subroutine calls */
+	if (p[0] == '\\' && p[1] == 'g' && (p[2] == '<' || p[2] == '\''))
+		return 1;
+
+	/* backtracking verbs may end the combined match early */
+	if (p[0] == '(' && p[1] == '*')
+		return 1;
+
+	return 0;
+}
+
+/*
+ * can pattern be combined ? groups of all patterns are numbered together
+ * and share one name table, so the pattern is compiled alone to see that
+ * it has no back references, named groups, recursion or subroutine calls.
+ */
+static int
+pattern_combinable(char *pattern)
+{
+	pcre2_code *code;
+	uint32_t backref = 0, names = 0;
+	int	ok;
+
+	if ((code = pcre_compile_opts(pattern, PCRE2_AUTO_CALLOUT, 0)) == NULL)
+		return 0;
+
+	pcre2_pattern_info(code, PCRE2_INFO_BACKREFMAX, &backref);
+	pcre2_pattern_info(code, PCRE2_INFO_NAMECOUNT, &names);
+	ok = (backref == 0 && names == 0 &&
+	      pcre2_callout_enumerate(code, combinable_item, pattern) == 0);
+
+	pcre2_code_free(code);
+	return ok;
+}
+
+/*
+ * compile all customized patterns precompiled by pcre_custom_compile()
+ * into one combined matcher, then pcre_custom_match() and
+ * pcre_custom_match_all() get verdicts of all customized types of a
+ * token in a single pass. call it after registering, before lex_freeze().
+ * return number of combined types, or -1 on error.
+ */
+int
+lex_combine_custom(void)
+{
+	pcre2_code *code;
+	char	*buf, *p, *pat;
+	int	i, len = 0, num = 0;
+	custom_lexmask_t set;
+
+	if (LEX_FROZEN()) {
+		fprintf(stderr, "lex_combine_custom: lex registry is frozen\n");
+		return -1;
+	}
+
+	bzero(&set, sizeof(set));
+	for (i = 0; i < custom_pcre_num; i++) {
+		if ((pat = CUSTOM_PATTERN(i)) == NULL || !pattern_combinable(pat))
+			continue;
+		CUSTOM_LEX_SET(&set, LEX_CUSTOM_TYPE(i));
+		len += strlen(pat) + 20;
+		num++;
+	}
+	if (num == 0) return 0;
+
+	if ((buf = malloc(len + 16)) == NULL) {
+		fprintf(stderr, "lex_combine_custom: no memory\n");
+		return -1;
+	}
+
+	/* (?:(?>pat0)(?C{0})|(?>pat1)(?C{1})|...)(*FAIL) */
+	p = buf + sprintf(buf, "(?:");
+	for (i = 0; i < custom_pcre_num; i++) {
+		if (!CUSTOM_LEX_ISSET(&set, LEX_CUSTOM_TYPE(i)))
+			continue;
+		p += sprintf(p, "%s(?>%s)(?C{%d})", (p == buf + 3) ? "" : "|",
+			     CUSTOM_PATTERN(i), i);
+	}
+	sprintf(p, ")(*FAIL)");
+
+	code = pcre_compile_opts(buf, PCRE2_NO_START_OPTIMIZE, 1);
+	free(buf);
+	if (code == NULL) return -1;
+
+	if (combined_mctx == NULL &&
+	    (combined_mctx = pcre2_match_context_create(NULL)) == NULL) {
+		fprintf(stderr, "lex_combine_custom: no memory\n");
+		pcre2_code_free(code);
+		return -1;
+	}
+	pcre2_set_callout(combined_mctx, combined_callout, NULL);
+	pcre2_set_match_limit(combined_mctx, lex_match_limit);
+
+	if (combined_code) pcre2_code_free(combined_code);
+	combined_code = code;
+	combined_set = set;
+	combined_gen++;
+	return num;
+}
+
+/*
+ * run combined matcher over str, the last token of each thread is cached
+ */
+static int
+combined_match(char *str, custom_lexmask_t *mask)
+{
+	pcre2_match_data *md;
+	int	res, cache;
+
+	cache = (strlen(str) < COMBINED_TOK_LEN);
+	if (cache && combined_last.gen == combined_gen &&
+	    strcmp(combined_last.tok, str) == 0) {
+		*mask = combined_last.mask;
+		return 0;
+	}
+
+	if ((md = get_match_data()) == NULL)
+		return -1;
+
+	bzero(mask, sizeof(custom_lexmask_t));
+	combined_mask = mask;
+	res = pcre2_match(combined_code, (PCRE2_SPTR) str, strlen(str), 0, 0,
+			  md, combined_mctx);
+	combined_mask = NULL;
+	if (res < 0 && res != PCRE2_ERROR_NOMATCH)
+		return -1;
+
+	if (cache) {
+		combined_last.gen = combined_gen;
+		strcpy(combined_last.tok, str);
+		combined_last.mask = *mask;
+	}
+	return 0;
+}
+
+/*
+ * get all the customized types whose patterns match str.
+ * return number of matched types, or -1 on error.
+ */
+int
+pcre_custom_match_all(char *str, custom_lexmask_t *mask)
+{
+	int	i, n = 0;
+
+	if (!mask) return -1;
+	bzero(mask, sizeof(custom_lexmask_t));
+	if (!str || !str[0]) return 0;
+
+	if (COMBINED_ON() && combined_match(str, mask) < 0)
+		return -1;
+
+	for (i = 0; i < custom_pcre_num; i++) {
+		if (!CUSTOM_PATTERN(i)) continue;
+		if (!COMBINED_ON() ||
+		    !CUSTOM_LEX_ISSET(&combined_set, LEX_CUSTOM_TYPE(i))) {
+			if (pcre_match(str, LEX_CUSTOM_TYPE(i),
+				       CUSTOM_PATTERN(i)) == 1)
+				CUSTOM_LEX_SET(mask, LEX_CUSTOM_TYPE(i));
+		}
+		if (CUSTOM_LEX_ISSET(mask, LEX_CUSTOM_TYPE(i)))
+			n++;
+	}
+	return n;
+}
+
+/*
+ * wrapped pcre_match only for customized lex types
+ */
+int
+pcre_custom_match(char *str, int idx, char *pattern)
+{
+	custom_lexmask_t mask;
+	char	*cp;
+
+	if (!IS_CUSTOM_LEX_TYPE(idx)) {
+		fprintf(stderr, "invalid customized lex index %d\n", idx);
+		return 0;
+	}
+
+	/* verdicts of all combined types come from one pass */
+	if (COMBINED_ON() && str && str[0] &&
+	    CUSTOM_LEX_ISSET(&combined_set, idx) &&
+	    (cp = CUSTOM_PATTERN(idx - LEX_CUSTOM_BASE_TYPE)) != NULL &&
+	    pattern && strcmp(cp, pattern) == 0 &&
+	    combined_match(str, &mask) == 0)
+		return (CUSTOM_LEX_ISSET(&mask, idx) != 0);
+
+	return pcre_match(str, idx, pattern);
+}
+
+/*
+ * is str an ipv4 address ?
+ */
+int
+is_ip_addr(char *str)
+{
+	int	res;
+
+	if (!str || !str[0]) return 0;
+
+	if (lex_native)
+		return native_ip_addr(str);
+
+	res = pcre_match(str, LEX_IP_ADDR, lex_pattern[LEX_IP_ADDR]);
+	return (res == 1);
+}
+
+/*
+ * is a verified ipv4 address str also a mask ?
+ */
+static int
+ip4_is_mask(char *str)
+{
+	u_int	ia;
+	u_int	m = 0xffffffff;	/* init as a all one mask */
+	int	i;
+
+	ia = ntohl(inet_addr(str));
+
+	if (ia == m) return 1;
+
+	for (i = 0; i < 32; i++) {
+		m <<= 1;
+		if (ia == m) return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * is str an ipv4 mask ?
+ */
+int
+is_ip_mask(char *str)
+{
+	return (is_ip_addr(str) && ip4_is_mask(str));
+}
+
+/*
+ * is str an ipv4 with mask bit prefix? ip/mask_bits 
+ */
+int
+is_ip_prefix(char *str)
+{
+	int	res;
+
+	if (!str || !str[0]) return 0;
+
+	if (lex_native)
+		return native_ip_prefix(str);
+
+	res = pcre_match(str, LEX_IP_PREFIX, lex_pattern[LEX_IP_PREFIX]);
+	return (res == 1);
+}
+
+/*
+ * is str an ipv4 network block ? net[/mask_bits]
+ */
+int
+is_ip_block(char *str)
+{
+	int	res;
+
+	if (!str || !str[0]) return 0;
+
+	if (lex_native)
+		return native_ip_block(str);
+
+	res = pcre_match(str, LEX_IP_BLOCK, lex_pattern[LEX_IP_BLOCK]);
+	return (res == 1);
+}
+
+/*
+ * is str an ipv4 range ? ip1[-ip2]
+ */
+int
+is_ip_range(char *str)
+{
+	int	res;
+
+	if (!str || !str[0]) return 0;
+
+	if (lex_native)
+		return native_ip_range(str);
+
+	res = pcre_match(str, LEX_IP_RANGE, lex_pattern[LEX_IP_RANGE]);
+	return (res == 1);
+}
+
+/*
+ * is str an ipv6 address ?
+ */
+int
+is_ip6_addr(char *str)
+{
+	struct in6_addr ia6;
+
+	if (!str || !str[0]) return 0;
+
+	if (lex_native)
+		return (parse_ip6(str, NULL, NULL) == 1);
+
+	return (inet_pton(AF_INET6, str, &ia6) == 1);
+}
+
+/*
+ * is str an ipv6 prefix ? 
+ */
+int
+is_ip6_prefix(char *str)
+{
+	char	addr6[INET6_ADDRSTRLEN], *slash;
+	int	len;
+
+	if (!str || !str[0]) return 0;
+
+	if (lex_native)
+		return (parse_ip6(str, NULL, NULL) == 2);
+
+	if ((slash = strchr(str, '/')) == NULL) return 0;
+	if (!isdigit(*(slash + 1))) return 0;
+	if (slash - str >= INET6_ADDRSTRLEN) return 0;
+
+	bzero(addr6, sizeof(addr6));
+	strncpy(addr6, str, slash - str);
+
+	if (!is_ip6_addr(addr6) || !is_int(slash + 1)) return 0;
+
+	len = atoi(slash + 1);
+
+	return (len >= 0 && len <= 128);
+}
+
+/*
+ * is str an ipv6 ACL block ? 
+ */
+int
+is_ip6_block(char *str)
+{
+	if (!str || !str[0]) return 0;
+
+	if (lex_native)
+		return (parse_ip6(str, NULL, NULL) != 0);
+
+	return (is_ip6_addr(str) || is_ip6_prefix(str));
+}
+
+/*
+ * parse and get back ipv6 address and prefix info
+ */
+int
+get_ip6_addr_pfx(char *str, struct in6_addr *ia6, int *pfx_len)
+{
+	if (!str || !ia6 || !pfx_len) return 0;
+
+	return (parse_ip6(str, ia6, pfx_len) != 0);
+}
+
+/*
+ * is str an host name ?
+ */
+int
+is_host_name(char *str)
+{
+	int	res;
+
+	if (!str || !str[0] || is_ip_addr(str)) return 0;
+
+	/*
+	 * host name with optional domain
+	 * if domain presents, the top layer domain must be all alphabets
+	 */
+	res = pcre_match(str, LEX_HOST_NAME, lex_pattern[LEX_HOST_NAME]);
+
+	return (res == 1);
+}
+
+/*
+ * is str an host name or IP ?
+ */
+int
+is_host(char *str)
+{
+	return (is_ip_addr(str) || is_host_name(str));
+}
+
+/*
+ * is str an host name or IP4/6 address ?
+ */
+int
+is_host6(char *str)
+{
+	return (is_host(str) || is_ip6_addr(str));
+}
+
+/*
+ * is str an domain name ?
+ */
+int
+is_domain_name(char *str)
+{
+	int	res;
+
+	if (!str || !str[0] || is_ip_addr(str)) return 0;
+
+	/*
+	 * host name with at least one layer domain
+	 * XXX the top layer domain must be all alphabets
+	 */
+	res = pcre_match(str, LEX_DOMAIN_NAME, lex_pattern[LEX_DOMAIN_NAME]);
+
+	return (res == 1);
+}
+
+/*
+ * is str an email address ?
+ */
+int
+is_email_addr(char *str)
+{
+	int	res;
+
+	if (!str || !str[0] || is_ip_addr(str)) return 0;
+
+	res = pcre_match(str, LEX_EMAIL_ADDR, lex_pattern[LEX_EMAIL_ADDR]);
+
+	return (res == 1);
+}
+
+/*
+ * is str an integer ?
+ */
+int
+is_int(char *str)
+{
+	int	res;
+
+	if (!str || !str[0]) return 0;
+
+	if (lex_native)
+		return native_int(str);
+
+	res = pcre_match(str, LEX_INT, lex_pattern[LEX_INT]);
+
+	return (res == 1);
+}
+
+/*
+ * is str a signed integer ?
+ */
+int
+is_sint(char *str)
+{
+	int	res;
+
+	if (!str || !str[0]) return 0;
+
+	if (lex_native)
+		return native_sint(str);
+
+	res = pcre_match(str, LEX_SINT, lex_pattern[LEX_SINT]);
+
+	return (res == 1);
+}
+
+/*
+ * is str an hexadicimal ?
+ */
+int
+is_hex(char *str)
+{
+	int	res;
+
+	if (!str || !str[0]) return 0;
+
+	if (lex_native)
+		return native_hex(str);
+
+	res = pcre_match(str, LEX_HEX, lex_pattern[LEX_HEX]);
+
+	return (res == 1);
+}
+
+/*
+ * is str an decimal ?
+ */
+int
+is_decimal(char *str)
+{
+	int	res;
+
+	if (!str || !str[0]) return 0;
+
+	if (lex_native)
+		return native_decimal(str);
+
+	res = pcre_match(str, LEX_DECIMAL, lex_pattern[LEX_DECIMAL]);
+
+	return (res == 1);
+}
+
+/*
+ * is str a layer-4 TCP/UDP port number <0-65535> ?
+ */
+int
+is_port(char *str)
+{
+	int	res;
+
+	if (!str || !str[0]) return 0;
+
+	if (lex_native)
+		return native_port(str);
+
+	res = pcre_match(str, LEX_PORT, lex_pattern[LEX_PORT]);
+
+	return (res == 1);
+}
+
+/*
+ * is str a layer-4 TCP/UDP port range port1[-port2] ?
+ */
+int
+is_port_range(char *str)
+{
+	int	res;
+
+	if (!str || !str[0]) return 0;
+
+	if (lex_native)
+		return native_port_range(str);
+
+	res = pcre_match(str, LEX_PORT_RANGE, lex_pattern[LEX_PORT_RANGE]);
+
+	return (res == 1);
+}
+
+/*
+ * is str an VLAN ID <1-4094> ?
+ */
+int
+is_vlan_id(char *str)
+{
+	int	res;
+
+	if (!str || !str[0]) return 0;
+
+	if (lex_native)
+		return native_vlan_id(str);
+
+	res = pcre_match(str, LEX_VLAN_ID, lex_pattern[LEX_VLAN_ID]);
+
+	return (res == 1);
+}
+
+/*
+ * is str a MAC address ?
+ * 12 continual %x chars, or separated each %02x with ":" or "-"
+ */
+int
+is_mac_addr(char *str)
+{
+	int	res;
+
+	if (!str || !str[0]) return 0;
+
+	if (lex_native)
+		return native_mac_addr(str);
+
+	res = pcre_match(str, LEX_MAC_ADDR, lex_pattern[LEX_MAC_ADDR]);
+
+	return (res == 1);
+}
+
+/*
+ * is str a word ?
+ */
+int
+is_word(char *str)
+{
+	int	res;
+
+	if (!str || !str[0]) return 0;
+
+	res = pcre_match(str, LEX_WORD, lex_pattern[LEX_WORD]);
+
+	return (res == 1);
+}
+
+/*
+ * arbitrary str ?
+ */
+int
+is_words(char *str)
+{
+	int	res;
+
+	if (!str || !str[0]) return 0;
+
+	res = pcre_match(str, LEX_WORDS, lex_pattern[LEX_WORDS]);
+
+	return (res == 1);
+}
+
+/*
+ * is str a HTTP URL ?
+ */
+int
+is_http_url(char *str)
+{
+	int	res;
+
+	if (!str || !str[0]) return 0;
+
+	if (lex_native)
+		return (get_uri_spans(str, NULL) == LEX_HTTP_URL);
+
+	res = pcre_match(str, LEX_HTTP_URL, lex_pattern[LEX_HTTP_URL]);
+
+	return (res == 1);
+}
+
+/*
+ * is str a HTTPS URL ?
+ */
+int
+is_https_url(char *str)
+{
+	int	res;
+
+	if (!str || !str[0]) return 0;
+
+	if (lex_native)
+		return (get_uri_spans(str, NULL) == LEX_HTTPS_URL);
+
+	res = pcre_match(str, LEX_HTTPS_URL, lex_pattern[LEX_HTTPS_URL]);
+
+	return (res == 1);
+}
+
+/*
+ * is str a FTP file URL ?
+ */
+int
+is_ftp_url(char *str)
+{
+	int	res;
+
+	if (!str || !str[0]) return 0;
+
+	/* support user:passwd@ inside FTP url */
+	if (lex_native)
+		return (get_uri_spans(str, NULL) == LEX_FTP_URL);
+
+	res = pcre_match(str, LEX_FTP_URL, lex_pattern[LEX_FTP_URL]);
+
+	return (res == 1);
+}
+
+/*
+ * is str a SCP file URL ?
+ */
+int
+is_scp_url(char *str)
+{
+	int	res;
+
+	if (!str || !str[0]) return 0;
+
+	/* must have user@ inside SCP url */
+	if (lex_native)
+		return (get_uri_spans(str, NULL) == LEX_SCP_URL);
+
+	res = pcre_match(str, LEX_SCP_URL, lex_pattern[LEX_SCP_URL]);
+
+	return (res == 1);
+}
+
+/*
+ * is str a TFTP file URL ?
+ */
+int
+is_tftp_url(char *str)
+{
+	int	res;
+
+	if (!str || !str[0]) return 0;
 
-	if (ia == m) return 1;
+	if (lex_native)
+		return (get_uri_spans(str, NULL) == LEX_TFTP_URL);
 
-	for (i = 0; i < 32; i++) {
-		m <<= 1;
-		if (ia == m) return 1;
-	}
+	res = pcre_match(str, LEX_TFTP_URL, lex_pattern[LEX_TFTP_URL]);
 
-	return 0;
+	return (res == 1);
 }
 
 /*
- * is str an ipv4 with mask bit prefix? ip/mask_bits 
+ * is str a file name (no space supported) ?
  */
 int
-is_ip_prefix(char *str)
+is_file_name(char *str)
 {
 	int	res;
 
 	if (!str || !str[0]) return 0;
 
-	res = pcre_match(str, LEX_IP_PREFIX,
-			 "^(([01]?\\d\\d?|2[0-4]\\d|25[0-5])\\.){3}"
-			 "([01]?\\d\\d?|2[0-4]\\d|25[0-5])"
-			 "(/[0-2]?\\d|/3[0-2])$");
+	res = pcre_match(str, LEX_FILE_NAME, lex_pattern[LEX_FILE_NAME]);
+
 	return (res == 1);
 }
 
 /*
- * is str an ipv4 network block ? net[/mask_bits]
+ * is str a file path (no space ./ ../ supported) ?
  */
 int
-is_ip_block(char *str)
+is_file_path(char *str)
 {
 	int	res;
 
 	if (!str || !str[0]) return 0;
 
-	res = pcre_match(str, LEX_IP_BLOCK,
-			 "^(([01]?\\d\\d?|2[0-4]\\d|25[0-5])\\.){3}"
-			 "([01]?\\d\\d?|2[0-4]\\d|25[0-5])"
-			 "(/[0-2]?\\d|/3[0-2])?$");
+	res = pcre_match(str, LEX_FILE_PATH, lex_pattern[LEX_FILE_PATH]);
+
 	return (res == 1);
 }
 
 /*
- * is str an ipv4 range ? ip1[-ip2]
+ * is str a admin user id ?
  */
 int
-is_ip_range(char *str)
+is_uid(char *str)
 {
 	int	res;
 
 	if (!str || !str[0]) return 0;
 
-	res = pcre_match(str, LEX_IP_RANGE,
-			 "^(([01]?\\d\\d?|2[0-4]\\d|25[0-5])\\.){3}"
-			 "([01]?\\d\\d?|2[0-4]\\d|25[0-5])"
-			 "(\\-(([01]?\\d\\d?|2[0-4]\\d|25[0-5])\\.){3}"
-			 "([01]?\\d\\d?|2[0-4]\\d|25[0-5]))?$");
+	res = pcre_match(str, LEX_UID, lex_pattern[LEX_UID]);
+
 	return (res == 1);
 }
 
 /*
- * is str an ipv6 address ?
+ * is str a user@domain id ?
  */
 int
-is_ip6_addr(char *str)
+is_net_uid(char *str)
 {
-	struct in6_addr ia6;
+	int	res;
 
 	if (!str || !str[0]) return 0;
-	return (inet_pton(AF_INET6, str, &ia6) == 1);
+
+	res = pcre_match(str, LEX_NET_UID, lex_pattern[LEX_NET_UID]);
+
+	return (res == 1);
 }
 
 /*
- * is str an ipv6 prefix ? 
+ * is str a user@ip6addr id ?
  */
 int
-is_ip6_prefix(char *str)
+is_net6_uid(char *str)
 {
-	char	addr6[INET6_ADDRSTRLEN], *slash;
+	char	name[128], *at, *addr;
 	int	len;
 
 	if (!str || !str[0]) return 0;
 
-	if ((slash = strchr(str, '/')) == NULL) return 0;
-	if (!isdigit(*(slash + 1))) return 0;
-
-	bzero(addr6, sizeof(addr6));
-	strncpy(addr6, str, slash - str);
+	if ((at = strchr(str, '@')) == NULL) return 0;
+	if ((len = at - str) == 0) return 0;
+	if (!isxdigit(*(at + 1)) && *(at + 1) != ':') return 0;
 
-	if (!is_ip6_addr(addr6) || !is_int(slash + 1)) return 0;
+	addr = at + 1;
 
-	len = atoi(slash + 1);
+	if (len >= sizeof(name)) return 0;
+	bzero(name, sizeof(name));
+	strncpy(name, str, len);
 
-	return (len >= 0 && len <= 128);
+	return (is_uid(name) && is_ip6_addr(addr));
 }
 
 /*
- * is str an ipv6 ACL block ? 
+ * is str a YYYYMMDDhhmm[ss] date time ?
  */
 int
-is_ip6_block(char *str)
+is_date_time(char *str)
 {
-	return (is_ip6_addr(str) || is_ip6_prefix(str));
+	int	res;
+
+	if (!str || !str[0]) return 0;
+
+	/* XXX since 2015 that libocli started */
+	res = pcre_match(str, LEX_DATE_TIME, lex_pattern[LEX_DATE_TIME]);
+
+	return (res == 1);
 }
 
 /*
- * parse and get back ipv6 address and prefix info
+ * is str a empty line ?
  */
 int
-get_ip6_addr_pfx(char *str, struct in6_addr *ia6, int *pfx_len)
+is_empty_line(char *str)
 {
-	char	addr6[INET6_ADDRSTRLEN], *slash;
-
-	if (!str || !ia6 || !pfx_len) return 0;
-	if (!is_ip6_block(str)) return 0;
+	if (!str || !str[0]) return 1;
 
-	if ((slash = strchr(str, '/')) != NULL) {
-		bzero(addr6, sizeof(addr6));
-		strncpy(addr6, str, slash - str);
-		inet_pton(AF_INET6, addr6, ia6);
-		*pfx_len = atoi(slash + 1);
-	} else {
-		inet_pton(AF_INET6, str, ia6);
-		*pfx_len = 128;
+	while (*str) {
+		if (!isspace(*str++))
+			return 0;
 	}
-
 	return 1;
 }
 
 /*
- * is str an host name ?
+ * classify str against all built-in lex types in one go.
+ * classes of all chars are summarized in a single pass first, so that
+ * only validators which str could possibly match are called, and the
+ * composite types are derived from bits of their member types.
+ * set back the mask of matched types, return number of matched types.
  */
 int
-is_host_name(char *str)
+lex_classify(char *str, lexmask_t *mask)
 {
-	int	res;
+	lexmask_t m = 0;
+	u_int	cc = 0, first;
+	char	*p, *q;
+	int	i, n;
 
-	if (!str || !str[0] || is_ip_addr(str)) return 0;
+	if (!mask) return -1;
+	*mask = 0;
 
-	/*
-	 * host name with optional domain
-	 * if domain presents, the top layer domain must be all alphabets
-	 */
-	res = pcre_match(str, LEX_HOST_NAME,
-			 "^(\\w[\\w\\-]*)"
-			 "((\\.\\w[\\w\\-]*)*(\\.[A-Za-z]+))*$");
+	if (!str || !str[0]) return 0;
 
-	return (res == 1);
+	/* pcre path, ask each validator */
+	if (!lex_native) {
+		for (i = 0; i < LEX_CUSTOM_BASE_TYPE; i++) {
+			if (lex_ent[i].fun && lex_ent[i].fun(str) == 1)
+				m |= LEX_MASK(i);
+		}
+		goto out;
+	}
+
+	/* a final newline is allowed by pcre '$', exclude it from classes */
+	n = strlen(str);
+	if (str[n - 1] == '\n') n--;
+
+	for (i = 0; i < n; i++)
+		cc |= lex_cc[(u_char) str[i]];
+	first = lex_cc[(u_char) str[0]];
+
+	/* matches any non-empty string */
+	m |= LEX_MASK(LEX_WORDS);
+
+	if (n == 0) goto out;
+
+	/* ipv4 family shares one address scan */
+	if ((first & CC_DIGIT) &&
+	    CC_ONLY(cc, CC_DIGIT | CC_DOT | CC_SLASH | CC_DASH) &&
+	    (p = scan_ip4(str, NULL)) != NULL) {
+		if (AT_EOS(p)) {
+			m |= LEX_MASK(LEX_IP_ADDR) | LEX_MASK(LEX_IP_BLOCK) |
+			     LEX_MASK(LEX_IP_RANGE);
+			if (ip4_is_mask(str))
+				m |= LEX_MASK(LEX_IP_MASK);
+		} else if ((q = scan_ip4_bits(p)) != NULL && AT_EOS(q)) {
+			m |= LEX_MASK(LEX_IP_PREFIX) | LEX_MASK(LEX_IP_BLOCK);
+		} else if (*p == '-' &&
+			   (q = scan_ip4(p + 1, NULL)) != NULL && AT_EOS(q)) {
+			m |= LEX_MASK(LEX_IP_RANGE);
+		}
+	}
+
+	/* numbers */
+	if (CC_ONLY(cc, CC_DIGIT)) {
+		m |= LEX_MASK(LEX_INT) | LEX_MASK(LEX_SINT);
+		if (native_port(str))
+			m |= LEX_MASK(LEX_PORT) | LEX_MASK(LEX_PORT_RANGE);
+		if (native_vlan_id(str))
+			m |= LEX_MASK(LEX_VLAN_ID);
+	} else if (CC_ONLY(cc, CC_DIGIT | CC_DASH)) {
+		if (native_port_range(str))
+			m |= LEX_MASK(LEX_PORT_RANGE);
+		if (native_sint(str))
+			m |= LEX_MASK(LEX_SINT);
+	}
+	if (CC_ONLY(cc, CC_DIGIT | CC_DOT)) {
+		if (native_decimal(str))
+			m |= LEX_MASK(LEX_DECIMAL);
+		if (str[0] == '2' &&
+		    pcre_match(str, LEX_DATE_TIME, lex_pattern[LEX_DATE_TIME]) == 1)
+			m |= LEX_MASK(LEX_DATE_TIME);
+	}
+	if (CC_ONLY(cc, CC_DIGIT | CC_LETTER) && native_hex(str))
+		m |= LEX_MASK(LEX_HEX);
+	if ((n == 12 || n == 17) &&
+	    CC_ONLY(cc, CC_DIGIT | CC_XALPHA | CC_COLON | CC_DASH) &&
+	    native_mac_addr(str))
+		m |= LEX_MASK(LEX_MAC_ADDR);
+
+	/* ipv6 */
+	if ((cc & CC_COLON) &&
+	    CC_ONLY(cc, CC_DIGIT | CC_XALPHA | CC_COLON | CC_DOT | CC_SLASH)) {
+		n = parse_ip6(str, NULL, NULL);
+		if (n == 1)
+			m |= LEX_MASK(LEX_IP6_ADDR) | LEX_MASK(LEX_IP6_BLOCK);
+		else if (n == 2)
+			m |= LEX_MASK(LEX_IP6_PREFIX) | LEX_MASK(LEX_IP6_BLOCK);
+	}
+
+	/* names and ids, all start with a \w char */
+	if ((first & CC_WORD)) {
+		if ((first & CC_LETTER) && CC_ONLY(cc, CC_WORD | CC_DASH) &&
+		    pcre_match(str, LEX_WORD, lex_pattern[LEX_WORD]) == 1)
+			m |= LEX_MASK(LEX_WORD);
+
+		if (!(m & LEX_MASK(LEX_IP_ADDR)) &&
+		    CC_ONLY(cc, CC_WORD | CC_DASH | CC_DOT)) {
+			if (pcre_match(str, LEX_HOST_NAME,
+				       lex_pattern[LEX_HOST_NAME]) == 1)
+				m |= LEX_MASK(LEX_HOST_NAME);
+			if ((cc & CC_DOT) &&
+			    pcre_match(str, LEX_DOMAIN_NAME,
+				       lex_pattern[LEX_DOMAIN_NAME]) == 1)
+				m |= LEX_MASK(LEX_DOMAIN_NAME);
+		}
+
+		if (CC_ONLY(cc, CC_WORD | CC_PLUS | CC_DASH | CC_DOT) &&
+		    pcre_match(str, LEX_FILE_NAME, lex_pattern[LEX_FILE_NAME]) == 1)
+			m |= LEX_MASK(LEX_FILE_NAME);
+
+		if (CC_ONLY(cc, CC_WORD | CC_DASH | CC_DOT) &&
+		    pcre_match(str, LEX_UID, lex_pattern[LEX_UID]) == 1)
+			m |= LEX_MASK(LEX_UID);
+
+		if ((cc & CC_AT)) {
+			if (!(m & LEX_MASK(LEX_IP_ADDR)) &&
+			    CC_ONLY(cc, CC_WORD | CC_DASH | CC_DOT | CC_AT) &&
+			    pcre_match(str, LEX_EMAIL_ADDR,
+				       lex_pattern[LEX_EMAIL_ADDR]) == 1)
+				m |= LEX_MASK(LEX_EMAIL_ADDR);
+			if (CC_ONLY(cc, CC_WORD | CC_DASH | CC_DOT | CC_AT) &&
+			    pcre_match(str, LEX_NET_UID,
+				       lex_pattern[LEX_NET_UID]) == 1)
+				m |= LEX_MASK(LEX_NET_UID);
+			if ((cc & CC_COLON) && is_net6_uid(str))
+				m |= LEX_MASK(LEX_NET6_UID);
+		}
+	}
+
+	if (((first & CC_WORD) || str[0] == '/') &&
+	    CC_ONLY(cc, CC_WORD | CC_PLUS | CC_DASH | CC_DOT | CC_SLASH) &&
+	    pcre_match(str, LEX_FILE_PATH, lex_pattern[LEX_FILE_PATH]) == 1)
+		m |= LEX_MASK(LEX_FILE_PATH);
+
+	/* URLs, picked by scheme */
+	if ((first & CC_LETTER) && (cc & CC_COLON) && (cc & CC_SLASH) &&
+	    (n = get_uri_spans(str, NULL)) >= 0)
+		m |= LEX_MASK(n);
+
+	/* composite types */
+	if ((m & (LEX_MASK(LEX_IP_ADDR) | LEX_MASK(LEX_HOST_NAME))))
+		m |= LEX_MASK(LEX_HOST);
+	if ((m & (LEX_MASK(LEX_HOST) | LEX_MASK(LEX_IP6_ADDR))))
+		m |= LEX_MASK(LEX_HOST6);
+
+out:
+	*mask = m;
+	for (n = 0; m; m &= m - 1) n++;
+	return n;
 }
 
 /*
- * is str an host name or IP ?
+ * native scanner of a built-in type, called directly by batch validation
  */
-int
-is_host(char *str)
+static lex_fun_t
+native_fun(int type)
 {
-	return (is_ip_addr(str) || is_host_name(str));
+	switch (type) {
+	case LEX_IP_ADDR:	return native_ip_addr;
+	case LEX_IP_PREFIX:	return native_ip_prefix;
+	case LEX_IP_BLOCK:	return native_ip_block;
+	case LEX_IP_RANGE:	return native_ip_range;
+	case LEX_INT:		return native_int;
+	case LEX_SINT:		return native_sint;
+	case LEX_HEX:		return native_hex;
+	case LEX_DECIMAL:	return native_decimal;
+	case LEX_PORT:		return native_port;
+	case LEX_PORT_RANGE:	return native_port_range;
+	case LEX_VLAN_ID:	return native_vlan_id;
+	case LEX_MAC_ADDR:	return native_mac_addr;
+	default:		return NULL;
+	}
 }
 
 /*
- * is str an host name or IP4/6 address ?
+ * parse value of a verified token of a built-in type
  */
-int
-is_host6(char *str)
+static void
+parse_lex_value(int type, char *str, lex_value_t *val)
 {
-	return (is_host(str) || is_ip6_addr(str));
+	u_int	a, b;
+	char	*p;
+
+	bzero(val, sizeof(lex_value_t));
+
+	switch (type) {
+	case LEX_IP_ADDR:
+	case LEX_IP_MASK:
+		scan_ip4(str, &a);
+		val->ip.addr.s_addr = htonl(a);
+		val->ip.mask.s_addr = bits_to_netmask(32);
+		break;
+	case LEX_IP_PREFIX:
+	case LEX_IP_BLOCK:
+		/* same as get_subnet_mask(), 0.0.0.0 has a zero mask */
+		p = scan_ip4(str, &a);
+		val->ip.addr.s_addr = htonl(a);
+		if (a != 0)
+			val->ip.mask.s_addr =
+				bits_to_netmask((*p == '/') ? atoi(p + 1) : 32);
+		break;
+	case LEX_IP_RANGE:
+		p = scan_ip4(str, &a);
+		b = a;
+		if (*p == '-') scan_ip4(p + 1, &b);
+		val->ip_range.from.s_addr = htonl((a < b) ? a : b);
+		val->ip_range.to.s_addr = htonl((a < b) ? b : a);
+		break;
+	case LEX_IP6_ADDR:
+	case LEX_IP6_PREFIX:
+	case LEX_IP6_BLOCK:
+		get_ip6_addr_pfx(str, &val->ip6.addr, &val->ip6.pfx_len);
+		break;
+	case LEX_INT:
+	case LEX_PORT:
+	case LEX_VLAN_ID:
+		val->num = strtoull(str, NULL, 10);
+		break;
+	case LEX_HEX:
+		val->num = strtoull(str, NULL, 16);
+		break;
+	case LEX_SINT:
+		val->inum = strtoll(str, NULL, 10);
+		break;
+	case LEX_DECIMAL:
+		val->dec = strtod(str, NULL);
+		break;
+	case LEX_PORT_RANGE:
+		a = b = strtoul(str, &p, 10);
+		if (*p == '-') b = strtoul(p + 1, NULL, 10);
+		val->port_range.from = (a < b) ? a : b;
+		val->port_range.to = (a < b) ? b : a;
+		break;
+	case LEX_MAC_ADDR:
+		get_binary_mac(str, val->mac, sizeof(val->mac));
+		break;
+	default:
+		break;
+	}
 }
 
 /*
- * is str an domain name ?
+ * enum lex types, the valid values are a string set which is replaced
+ * as a whole by the application, e.g. interface or profile names. a set
+ * table is never modified once published, lex_enum_replace() builds a
+ * new one and swaps it in under the write lock, so lookups hold the
+ * read lock only for one hash probe.
  */
-int
-is_domain_name(char *str)
-{
-	int	res;
-
-	if (!str || !str[0] || is_ip_addr(str)) return 0;
-
-	/*
-	 * host name with at least one layer domain
-	 * XXX the top layer domain must be all alphabets
-	 */
-	res = pcre_match(str, LEX_DOMAIN_NAME,
-			 "^(\\w[\\w\\-]*\\.)+"
-			 "([A-Za-z0-9]+)$");
-
-	return (res == 1);
-}
+struct enum_tab {
+	int	num;		/* number of values */
+	u_int	size;		/* hash slots, power of 2 */
+	int	*slots;		/* index of value + 1, 0 if empty */
+	char	**vals;		/* values in ascending order */
+};
+
+struct lex_enum {
+	pthread_rwlock_t lock;
+	struct enum_tab *tab;
+};
 
 /*
- * is str an email address ?
+ * FNV-1a hash of an enum value, case sensitive
  */
-int
-is_email_addr(char *str)
+static u_int
+enum_hashval(char *str)
 {
-	int	res;
-
-	if (!str || !str[0] || is_ip_addr(str)) return 0;
+	u_int	h = 2166136261u;
 
-	res = pcre_match(str, LEX_EMAIL_ADDR,
-			 "^(\\w[\\w\\-\\.]*@)"
-			 "(\\w[\\w\\-]*\\.)+"
-			 "([A-Za-z]+)$");
+	while (*str) {
+		h ^= (u_char) *str++;
+		h *= 16777619u;
+	}
+	return h;
+}
 
-	return (res == 1);
+static int
+enum_val_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char **) a, *(char **) b);
 }
 
 /*
- * is str an integer ?
+ * build a set table in one allocation: header, sorted value pointers,
+ * hash slots, then the value strings. empty and duplicate values are
+ * dropped.
  */
-int
-is_int(char *str)
+static struct enum_tab *
+enum_tab_build(char **vals, int n)
 {
-	int	res;
-
-	if (!str || !str[0]) return 0;
+	struct enum_tab *tab;
+	size_t	len = 0;
+	u_int	size, h;
+	char	*p;
+	int	i, num;
+
+	for (i = 0; i < n; i++) {
+		if (vals[i] && vals[i][0])
+			len += strlen(vals[i]) + 1;
+	}
+	for (size = 16; size < (u_int) n * 2; size <<= 1);
+
+	tab = malloc(sizeof(struct enum_tab) + sizeof(char *) * n +
+		     sizeof(int) * size + len);
+	if (tab == NULL) return NULL;
+
+	tab->size = size;
+	tab->vals = (char **) (tab + 1);
+	tab->slots = (int *) (tab->vals + n);
+	p = (char *) (tab->slots + size);
+	bzero(tab->slots, sizeof(int) * size);
+
+	for (i = 0, num = 0; i < n; i++) {
+		if (!vals[i] || !vals[i][0]) continue;
+		tab->vals[num++] = p;
+		strcpy(p, vals[i]);
+		p += strlen(p) + 1;
+	}
+	qsort(tab->vals, num, sizeof(char *), enum_val_cmp);
 
-	res = pcre_match(str, LEX_INT, "^(\\d+)$");
+	for (i = 0, tab->num = 0; i < num; i++) {
+		if (tab->num > 0 &&
+		    strcmp(tab->vals[tab->num - 1], tab->vals[i]) == 0)
+			continue;
+		tab->vals[tab->num++] = tab->vals[i];
+	}
 
-	return (res == 1);
+	for (i = 0; i < tab->num; i++) {
+		h = enum_hashval(tab->vals[i]) & (size - 1);
+		while (tab->slots[h])
+			h = (h + 1) & (size - 1);
+		tab->slots[h] = i + 1;
+	}
+	return tab;
 }
 
 /*
- * is str an hexadicimal ?
+ * is str in the set table
  */
-int
-is_hex(char *str)
+static int
+enum_tab_find(struct enum_tab *tab, char *str)
 {
-	int	res;
-
-	if (!str || !str[0]) return 0;
-
-	res = pcre_match(str, LEX_HEX, "^(0[xX])?([\\da-fA-F]{1,16})$");
+	u_int	h, mask;
+	int	i;
 
-	return (res == 1);
+	if (tab == NULL) return 0;
+	mask = tab->size - 1;
+	for (h = enum_hashval(str) & mask; (i = tab->slots[h]); h = (h + 1) & mask) {
+		if (strcmp(tab->vals[i - 1], str) == 0)
+			return 1;
+	}
+	return 0;
 }
 
 /*
- * is str an decimal ?
+ * index of the first value not less than prefix, values with the prefix
+ * are all in a row from there
  */
-int
-is_decimal(char *str)
+static int
+enum_tab_lower(struct enum_tab *tab, char *prefix)
 {
-	int	res;
-
-	if (!str || !str[0]) return 0;
-
-	res = pcre_match(str, LEX_DECIMAL, "^(\\d+)(\\.\\d*)?$");
+	int	lo = 0, hi = tab->num, mid;
 
-	return (res == 1);
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (strcmp(tab->vals[mid], prefix) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
 }
 
 /*
- * is str a layer-4 TCP/UDP port number <0-65535> ?
+ * replace all values of an enum lex type by vals[0 .. n-1]. it is allowed
+ * after lex_freeze(), lookups from other threads see either the old set
+ * or the new one, never a mix. return number of distinct values.
  */
 int
-is_port(char *str)
+lex_enum_replace(int type, char **vals, int n)
 {
-	int	res;
+	struct lex_ent *lex;
+	struct enum_tab *tab, *old;
 
-	if (!str || !str[0]) return 0;
+	if ((lex = get_lex_ent(type)) == NULL || !lex->set) {
+		fprintf(stderr, "lex_enum_replace: type %d is not enum\n", type);
+		return -1;
+	}
+	if (n < 0 || (n > 0 && !vals)) {
+		fprintf(stderr, "lex_enum_replace: invalid parm\n");
+		return -1;
+	}
+	if ((tab = enum_tab_build(vals, n)) == NULL) {
+		fprintf(stderr, "lex_enum_replace: no memory\n");
+		return -1;
+	}
 
-	res = pcre_match(str, LEX_PORT,
-			 "^(([0-9]{1,4})|([0-5][0-9]{1,4})|"
-			 "(6[0-4][0-9][0-9][0-9])|(65[0-4][0-9][0-9])|"
-			 "(655[0-2][0-9])|(6553[0-5]))$");
+	pthread_rwlock_wrlock(&lex->set->lock);
+	old = lex->set->tab;
+	lex->set->tab = tab;
+	pthread_rwlock_unlock(&lex->set->lock);
 
-	return (res == 1);
+	free(old);
+	return tab->num;
 }
 
 /*
- * is str a layer-4 TCP/UDP port range port1[-port2] ?
+ * set back strdup'ed values of an enum lex type starting with prefix,
+ * in ascending order. return number of matches.
  */
 int
-is_port_range(char *str)
+lex_enum_matches(int type, char *prefix, char **matches, int limit)
 {
-	int	res;
-
-	if (!str || !str[0]) return 0;
-
-	res = pcre_match(str, LEX_PORT_RANGE,
-			 "^(([0-9]{1,4})|([0-5][0-9]{1,4})|"
-			 "(6[0-4][0-9][0-9][0-9])|(65[0-4][0-9][0-9])|"
-			 "(655[0-2][0-9])|(6553[0-5]))"
+	struct lex_ent *lex;
+	struct enum_tab *tab;
+	size_t	len;
+	int	i, num = 0;
 
-			 "(-(([0-9]{1,4})|([0-5][0-9]{1,4})|"
-			 "(6[0-4][0-9][0-9][0-9])|(65[0-4][0-9][0-9])|"
-			 "(655[0-2][0-9])|(6553[0-5])))?$");
+	if ((lex = get_lex_ent(type)) == NULL || !lex->set || !matches)
+		return 0;
+	if (!prefix) prefix = "";
+	len = strlen(prefix);
+
+	pthread_rwlock_rdlock(&lex->set->lock);
+	if ((tab = lex->set->tab) != NULL) {
+		for (i = enum_tab_lower(tab, prefix);
+		     i < tab->num && num < limit &&
+		     strncmp(tab->vals[i], prefix, len) == 0; i++) {
+			if ((matches[num] = strdup(tab->vals[i])) != NULL)
+				num++;
+		}
+	}
+	pthread_rwlock_unlock(&lex->set->lock);
 
-	return (res == 1);
+	return num;
 }
 
 /*
- * is str an VLAN ID <1-4094> ?
+ * could prefix become a value of an enum lex type
  */
-int
-is_vlan_id(char *str)
+static int
+lex_enum_partial(struct lex_enum *set, char *prefix)
 {
-	int	res;
-
-	if (!str || !str[0]) return 0;
-
-	res = pcre_match(str, LEX_VLAN_ID,
-			 "^(([0]*[1-9])|([0]*[1-9][0-9]{1,2})|"
-			 "([0]*[1-3][0-9]{1,3})|"
-			 "([0]*40[0-8][0-9])|"
-			 "([0]*409[0-4]))$");
+	struct enum_tab *tab;
+	int	i, res = 0;
+
+	pthread_rwlock_rdlock(&set->lock);
+	if ((tab = set->tab) != NULL) {
+		i = enum_tab_lower(tab, prefix);
+		res = (i < tab->num &&
+		       strncmp(tab->vals[i], prefix, strlen(prefix)) == 0);
+	}
+	pthread_rwlock_unlock(&set->lock);
 
-	return (res == 1);
+	return res;
 }
 
 /*
- * is str a MAC address ?
- * 12 continual %x chars, or separated each %02x with ":" or "-"
+ * is str valid for a lex type, by enum set or by parsing function
  */
 int
-is_mac_addr(char *str)
+lex_match(int type, char *str)
 {
+	struct lex_ent *lex;
 	int	res;
 
-	if (!str || !str[0]) return 0;
-
-	res = pcre_match(str, LEX_MAC_ADDR,
-			 "^(([A-Fa-f0-9]{10})|(([A-Fa-f0-9]{2}[:\\-]){5}))"
-			 "([A-Fa-f0-9]{2})$");
+	if (!str || (lex = get_lex_ent(type)) == NULL)
+		return 0;
 
-	return (res == 1);
+	if (lex->set) {
+		pthread_rwlock_rdlock(&lex->set->lock);
+		res = enum_tab_find(lex->set->tab, str);
+		pthread_rwlock_unlock(&lex->set->lock);
+		return res;
+	}
+	return (lex->fun && lex->fun(str) == 1);
 }
 
 /*
- * is str a word ?
+ * validate n tokens against one lex type in a tight loop, e.g. a column
+ * of a config being imported. the validator is resolved once, and native
+ * scanners are called directly. set back verdicts[i] to 1 if toks[i] is
+ * valid, else 0, and if values is not NULL, the parsed values of valid
+ * tokens of built-in types. return number of valid tokens, or -1 on error.
  */
 int
-is_word(char *str)
+lex_validate_many(int type, char **toks, int n, u_int8_t *verdicts,
+		  lex_value_t *values)
 {
-	int	res;
+	struct lex_ent *lex;
+	lex_fun_t fun = NULL;
+	int	i, num = 0;
 
-	if (!str || !str[0]) return 0;
+	if ((lex = get_lex_ent(type)) == NULL || !lex->name[0]) {
+		fprintf(stderr, "lex_validate_many: type %d not registered\n",
+			type);
+		return -1;
+	}
+	if (n < 0 || (n > 0 && (!toks || !verdicts))) {
+		fprintf(stderr, "lex_validate_many: invalid parm\n");
+		return -1;
+	}
 
-	res = pcre_match(str, LEX_WORD, "^([a-zA-Z]+)(\\w|-)*$");
+	if (lex_native) fun = native_fun(type);
+	if (fun == NULL) fun = lex->fun;
 
-	return (res == 1);
+	for (i = 0; i < n; i++) {
+		if (fun)
+			verdicts[i] = (toks[i] && toks[i][0] && fun(toks[i]) == 1);
+		else
+			verdicts[i] = (toks[i] && toks[i][0] && lex_match(type, toks[i]));
+		num += verdicts[i];
+	}
+
+	if (values && IS_BUILTIN_LEX_TYPE(type)) {
+		for (i = 0; i < n; i++) {
+			if (verdicts[i])
+				parse_lex_value(type, toks[i], &values[i]);
+			else
+				bzero(&values[i], sizeof(lex_value_t));
+		}
+	} else if (values) {
+		bzero(values, sizeof(lex_value_t) * n);
+	}
+
+	return num;
 }
 
 /*
- * arbitrary str ?
+ * partial scanners, is str a prefix of a string accepted by the type ?
+ * they may accept a prefix which can not complete, but never reject one
+ * which can, so that callers can safely prune by them.
  */
-int
-is_words(char *str)
-{
-	int	res;
-
-	if (!str || !str[0]) return 0;
-
-	res = pcre_match(str, LEX_WORDS, "^(\\w|\\W)+$");
-
-	return (res == 1);
-}
 
 /*
- * is str a HTTP URL ?
+ * scan a prefix of dotted ipv4 address. return 0 if it can never be one,
+ * or 1 with pointer to the char after a complete address set back, which
+ * is NULL if str ends before the address completes.
  */
-int
-is_http_url(char *str)
+static int
+scan_ip4_partial(char *p, char **endp)
 {
-	int	res;
-
-	if (!str || !str[0]) return 0;
-
-	res = pcre_match(str, LEX_HTTP_URL,
-			 "^[hH][tT][tT][pP]:\\/\\/"
-                         "([\\w\\-]+\\.)+\\w+"
-			 "(:(([0-9]{1,4})|([0-5][0-9]{1,4})|(6[0-5][0-5][0-3][0-5])))?"
-			 "(\\/[\\w\\.\\-\\?#%=+&]*)*\\/?$");
+	u_int	v;
+	int	i, n;
 
-	return (res == 1);
+	*endp = NULL;
+	for (i = 0; i < 4; i++) {
+		if (i > 0) {
+			if (*p == '\0') return 1;
+			if (*p++ != '.') return 0;
+		}
+		for (n = 0, v = 0; n < 3 && IS_DIGIT(p[n]); n++)
+			v = v * 10 + (p[n] - '0');
+		if (p[n] == '\0' && (n == 0 || i < 3))
+			return (v <= 255);
+		if (n == 0 || IS_DIGIT(p[n]) || v > 255)
+			return 0;
+		p += n;
+	}
+	*endp = p;
+	return 1;
 }
 
 /*
- * is str a HTTPS URL ?
+ * scan a prefix of "/<0-max>" suffix with up to max_len digits
  */
-int
-is_https_url(char *str)
+static int
+scan_bits_partial(char *p, int max_len, u_int max)
 {
-	int	res;
-
-	if (!str || !str[0]) return 0;
+	u_int	v;
+	int	n;
+
+	if (*p == '\0') return 1;
+	if (*p++ != '/') return 0;
+	for (n = 0, v = 0; n < max_len && IS_DIGIT(p[n]); n++)
+		v = v * 10 + (p[n] - '0');
+	return (v <= max && (p[n] == '\0' || (n > 0 && AT_EOS(p + n))));
+}
 
-	res = pcre_match(str, LEX_HTTPS_URL,
-			 "^[hH][tT][tT][pP][sS]:\\/\\/"
-                         "([\\w\\-]+\\.)+\\w+"
-			 "(:(([0-9]{1,4})|([0-5][0-9]{1,4})|(6[0-5][0-5][0-3][0-5])))?"
-			 "(\\/[\\w\\.\\-\\?#%=+&]*)*\\/?$");
+static int
+partial_ip_addr(char *str)
+{
+	char	*p;
 
-	return (res == 1);
+	if (!scan_ip4_partial(str, &p)) return 0;
+	return (p == NULL || AT_EOS(p));
 }
 
-/*
- * is str a FTP file URL ?
- */
-int
-is_ftp_url(char *str)
+static int
+partial_ip_block(char *str)
 {
-	int	res;
+	char	*p;
 
-	if (!str || !str[0]) return 0;
+	if (!scan_ip4_partial(str, &p)) return 0;
+	return (p == NULL || AT_EOS(p) || scan_bits_partial(p, 2, 32));
+}
 
-	/* support user:passwd@ inside FTP url */
-	res = pcre_match(str, LEX_FTP_URL,
-			 "^[fF][tT][pP]:\\/\\/"
-			 "([\\w\\-]+[\\.]?\\w+:[\\w\\-\\.]+@)?"
-                         "([\\w\\-]+\\.)+\\w+"
-			 "(\\/[\\w\\.\\-]+)+$");
+static int
+partial_ip_range(char *str)
+{
+	char	*p;
 
-	return (res == 1);
+	if (!scan_ip4_partial(str, &p)) return 0;
+	if (p == NULL || AT_EOS(p)) return 1;
+	if (*p != '-' || !scan_ip4_partial(p + 1, &p)) return 0;
+	return (p == NULL || AT_EOS(p));
 }
 
 /*
- * is str a SCP file URL ?
+ * only hex digits, ':' and '.' of an embedded ipv4 address
  */
-int
-is_scp_url(char *str)
+static int
+partial_ip6_addr(char *str)
 {
-	int	res;
-
-	if (!str || !str[0]) return 0;
+	char	*p;
 
-	/* must have user@ inside SCP url */
-	res = pcre_match(str, LEX_SCP_URL,
-			 "^[sS][cC][pP]:\\/\\/"
-			 "[\\w\\-]+(\\.\\w+)?@"
-                         "([\\w\\-]+\\.)+\\w+"
-			 "(:(([0-9]{1,4})|([0-5][0-9]{1,4})|(6[0-5][0-5][0-3][0-5])))?"
-			 "(\\/[\\w\\.\\-]+)+$");
-
-	return (res == 1);
+	for (p = str; IS_XDIGIT(*p) || *p == ':' || *p == '.'; p++);
+	return ((p - str) < INET6_ADDRSTRLEN && *p == '\0');
 }
 
-/*
- * is str a TFTP file URL ?
- */
-int
-is_tftp_url(char *str)
+static int
+partial_ip6_block(char *str)
 {
-	int	res;
+	char	*p;
 
-	if (!str || !str[0]) return 0;
+	for (p = str; IS_XDIGIT(*p) || *p == ':' || *p == '.'; p++);
+	if ((p - str) >= INET6_ADDRSTRLEN) return 0;
+	return scan_bits_partial(p, 3, 128);
+}
 
-	res = pcre_match(str, LEX_TFTP_URL,
-			 "^[tT][fF][tT][pP]:\\/\\/"
-                         "([\\w\\-]+\\.)+\\w+"
-			 "(\\/[\\w\\.\\-]+)+$");
+static int
+partial_host(char *str)
+{
+	return (partial_ip_addr(str) ||
+		pcre_partial(str, LEX_HOST_NAME, lex_pattern[LEX_HOST_NAME]) == 1);
+}
 
-	return (res == 1);
+static int
+partial_host6(char *str)
+{
+	return (partial_host(str) || partial_ip6_addr(str));
 }
 
-/*
- * is str a file name (no space supported) ?
- */
-int
-is_file_name(char *str)
+static int
+partial_net6_uid(char *str)
 {
-	int	res;
+	char	name[128], *at;
+	int	len;
 
-	if (!str || !str[0]) return 0;
+	if ((at = strchr(str, '@')) == NULL)
+		return (pcre_partial(str, LEX_UID, lex_pattern[LEX_UID]) == 1);
 
-	res = pcre_match(str, LEX_FILE_NAME,
-			 "^(\\w[\\w+\\-\\_\\.]*\\w)$");
+	if ((len = at - str) == 0 || len >= sizeof(name)) return 0;
+	bzero(name, sizeof(name));
+	strncpy(name, str, len);
 
-	return (res == 1);
+	return (is_uid(name) && partial_ip6_addr(at + 1));
 }
 
 /*
- * is str a file path (no space ./ ../ supported) ?
+ * could str become a string of lex type by appending chars ?
+ * types without partial function fall back to partial matching of their
+ * pcre patterns. return 1 if it could, 0 if never, or -1 if unknown.
  */
 int
-is_file_path(char *str)
+lex_partial(int type, char *str)
 {
-	int	res;
-
-	if (!str || !str[0]) return 0;
-
-	res = pcre_match(str, LEX_FILE_PATH,
-			 "^[\\/]?(\\w[\\w+\\-\\_\\.]*\\/)*"
-			 "(\\w[\\w+\\-\\_\\.]*\\w)$");
+	struct lex_ent *lex;
 
-	return (res == 1);
+	if (!str || !str[0]) return 1;
+	if ((lex = get_lex_ent(type)) == NULL || !lex->name[0]) return 0;
+
+	if (lex->set)
+		return lex_enum_partial(lex->set, str);
+	if (lex->partial)
+		return (lex->partial(str) == 1);
+	if (IS_BUILTIN_LEX_TYPE(type) && lex_pattern[type])
+		return pcre_partial(str, type, lex_pattern[type]);
+	return -1;
 }
 
 /*
- * is str a admin user id ?
+ * set partial function of a lex type
  */
 int
-is_uid(char *str)
+set_lex_partial(int type, lex_fun_t partial)
 {
-	int	res;
-
-	if (!str || !str[0]) return 0;
+	struct lex_ent *lex;
 
-	res = pcre_match(str, LEX_UID, "^(\\w[\\w\\.\\-]*\\w+)$");
-
-	return (res == 1);
+	if ((lex = get_lex_ent(type)) == NULL || !lex->name[0]) {
+		fprintf(stderr, "set_lex_partial: type %d not registered\n", type);
+		return -1;
+	}
+	if (LEX_FROZEN()) {
+		fprintf(stderr, "set_lex_partial: lex registry is frozen\n");
+		return -1;
+	}
+	lex->partial = partial;
+	return 0;
 }
 
 /*
- * is str a user@domain id ?
+ * pcre partial match for customized lex types
  */
 int
-is_net_uid(char *str)
+pcre_custom_partial(char *str, int idx, char *pattern)
 {
-	int	res;
-
-	if (!str || !str[0]) return 0;
-
-	res = pcre_match(str, LEX_NET_UID,
-			 "^(\\w[\\w\\.\\-]*\\w+)"
-			 "(@\\w(\\w*\\.)+\\w+)$");
-
-	return (res == 1);
+	if (!IS_CUSTOM_LEX_TYPE(idx)) {
+		fprintf(stderr, "invalid customized lex index %d\n", idx);
+		return 0;
+	}
+	return pcre_partial(str, idx, pattern);
 }
 
 /*
- * is str a user@ip6addr id ?
+ * FNV-1a hash of a lex name, case insensitive
  */
-int
-is_net6_uid(char *str)
+static u_int
+lex_name_hashval(char *name)
 {
-	char	name[128], *at, *addr;
-	int	len;
-
-	if (!str || !str[0]) return 0;
-
-	if ((at = strchr(str, '@')) == NULL) return 0;
-	if ((len = at - str) == 0) return 0;
-	if (!isxdigit(*(at + 1)) && *(at + 1) != ':') return 0;
-
-	addr = at + 1;
+	u_int	h = 2166136261u;
 
-	bzero(name, sizeof(name));
-	strncpy(name, str, len);
-
-	return (is_uid(name) && is_ip6_addr(addr));
+	while (*name) {
+		h ^= (u_char) toupper(*name++);
+		h *= 16777619u;
+	}
+	return h;
 }
 
 /*
- * is str a YYYYMMDDhhmm[ss] date time ?
+ * get the slot of name in the index, or the empty slot to insert it
  */
-int
-is_date_time(char *str)
+static u_int
+lex_name_slot(int *tab, u_int size, char *name)
 {
-	int	res;
-
-	if (!str || !str[0]) return 0;
-
-	/* XXX since 2015 that libocli started */
-	res = pcre_match(str, LEX_DATE_TIME,
-			 "^(20((1[5-9])|([2-9][0-9]))"
-			 "((0[1-9])|(1[0-2]))"
-			 "((0[1-9])|([1-2][0-9])|3[0-1])"
-			 "(([0-1][0-9])|(2[0-3]))"
-			 "([0-5][0-9]))"
-			 "(\\.[0-5][0-9])?$");
+	struct lex_ent *lex;
+	u_int	h, mask = size - 1;
 
-	return (res == 1);
+	for (h = lex_name_hashval(name) & mask; tab[h]; h = (h + 1) & mask) {
+		lex = get_lex_ent(tab[h] - 1);
+		if (lex && strcasecmp(name, lex->name) == 0)
+			break;
+	}
+	return h;
 }
 
 /*
- * is str a empty line ?
+ * add a registered type to the name index, grow the index if needed
  */
-int
-is_empty_line(char *str)
+static int
+lex_name_insert(int type)
 {
-	if (!str || !str[0]) return 1;
+	int	*tab;
+	u_int	i, size;
 
-	while (*str) {
-		if (!isspace(*str++))
-			return 0;
+	if ((lex_name_hash_used + 1) * 2 > lex_name_hash_size) {
+		size = (lex_name_hash_size) ? lex_name_hash_size * 2 : 128;
+		if ((tab = calloc(size, sizeof(int))) == NULL) {
+			fprintf(stderr, "lex_name_insert: no memory\n");
+			return -1;
+		}
+		for (i = 0; i < lex_name_hash_size; i++) {
+			if (lex_name_hash[i])
+				tab[lex_name_slot(tab, size,
+				    get_lex_ent(lex_name_hash[i] - 1)->name)] =
+					lex_name_hash[i];
+		}
+		free(lex_name_hash);
+		lex_name_hash = tab;
+		lex_name_hash_size = size;
 	}
-	return 1;
+
+	i = lex_name_slot(lex_name_hash, lex_name_hash_size,
+			  get_lex_ent(type)->name);
+	lex_name_hash[i] = type + 1;
+	lex_name_hash_used++;
+	return 0;
 }
 
 /*
@@ -716,15 +3018,39 @@ is_empty_line(char *str)
 int
 get_lex_type(char *name)
 {
-	int	i;
+	u_int	i;
 
-	if (!name || !name[0]) return -1;
+	if (!name || !name[0] || lex_name_hash_size == 0) return -1;
+
+	i = lex_name_slot(lex_name_hash, lex_name_hash_size, name);
+	return (lex_name_hash[i]) ? lex_name_hash[i] - 1 : -1;
+}
 
-	for (i = 0; i < MAX_LEX_TYPE; i++) {
-		if (lex_ent[i].name[0] && strcasecmp(name, lex_ent[i].name) == 0)
-			return i;
+/*
+ * allocate the entry of a customized type, grow the entry table if needed
+ */
+static struct lex_ent *
+alloc_custom_ent(int type)
+{
+	struct lex_ent **ents;
+	int	i = type - LEX_CUSTOM_BASE_TYPE, num;
+
+	if (i >= custom_ent_num) {
+		num = (custom_ent_num) ? custom_ent_num : 16;
+		while (num <= i) num *= 2;
+		if (num > MAX_CUSTOM_LEX_NUM) num = MAX_CUSTOM_LEX_NUM;
+
+		if ((ents = realloc(custom_ent, sizeof(*ents) * num)) == NULL)
+			return NULL;
+		bzero(&ents[custom_ent_num],
+		      sizeof(*ents) * (num - custom_ent_num));
+		custom_ent = ents;
+		custom_ent_num = num;
 	}
-	return -1;
+
+	if (custom_ent[i] == NULL)
+		custom_ent[i] = calloc(1, sizeof(struct lex_ent));
+	return custom_ent[i];
 }
 
 /*
@@ -735,20 +3061,26 @@ set_lex_ent(int type, char *name, lex_fun_t fun, char *help, char *prefix)
 {
 	int	idx;
 	char	*ch;
+	struct lex_ent *lex;
 
 	if (type < 0 || type >= MAX_LEX_TYPE) {
 		fprintf(stderr, "set_lex_ent: invalid index %d\n", type);
 		return -1;
 	}
 
-	if (!name || !name[0] || !help || !help[0] || !fun) {
+	if (LEX_FROZEN()) {
+		fprintf(stderr, "set_lex_ent: lex registry is frozen\n");
+		return -1;
+	}
+
+	if (!name || !name[0] || !help || !help[0]) {
 		fprintf(stderr, "set_lex_ent: invalid parm\n");
 		return -1;
 	}
 
-	if (lex_ent[type].name[0]) {
+	if ((lex = get_lex_ent(type)) != NULL && lex->name[0]) {
 		fprintf(stderr, "set_lex_ent: type %d has been registered by \"%s\"\n",
-			type, lex_ent[type].name);
+			type, lex->name);
 		return -1;
 	}
 
@@ -758,17 +3090,33 @@ set_lex_ent(int type, char *name, lex_fun_t fun, char *help, char *prefix)
 		return -1;
 	}
 
-	bzero(&lex_ent[type], sizeof(struct lex_ent));
+	if (lex == NULL && (lex = alloc_custom_ent(type)) == NULL) {
+		fprintf(stderr, "set_lex_ent: no memory\n");
+		return -1;
+	}
+
+	/* pcre state too, so a pattern first matched once frozen is cached */
+	if (IS_CUSTOM_LEX_TYPE(type) && alloc_custom_pcre(type) == NULL) {
+		fprintf(stderr, "set_lex_ent: no memory\n");
+		return -1;
+	}
+
+	bzero(lex, sizeof(struct lex_ent));
 
-	strncpy(lex_ent[type].name, name, LEX_NAME_LEN-1);
-	ch = lex_ent[type].name;
+	strncpy(lex->name, name, LEX_NAME_LEN-1);
+	ch = lex->name;
 	while (ch && *ch) {*ch = toupper(*ch); ch++;}
 
-	lex_ent[type].fun = fun;
-	strncpy(lex_ent[type].help, help, LEX_TEXT_LEN-1);
+	lex->fun = fun;
+	strncpy(lex->help, help, LEX_TEXT_LEN-1);
 
 	if (prefix && prefix[0])
-		strncpy(lex_ent[type].prefix, prefix, LEX_TEXT_LEN-1);
+		strncpy(lex->prefix, prefix, LEX_TEXT_LEN-1);
+
+	if (lex_name_insert(type) < 0) {
+		bzero(lex, sizeof(struct lex_ent));
+		return -1;
+	}
 
 	return 0;
 }
@@ -783,22 +3131,173 @@ set_custom_lex_ent(int type, char *name, lex_fun_t fun, char *help, char *prefix
 		fprintf(stderr, "invalid customized lex index %d\n", type);
 		return -1;
 	}
+	if (!fun) {
+		fprintf(stderr, "set_custom_lex_ent: invalid parm\n");
+		return -1;
+	}
 
 	return set_lex_ent(type, name, fun, help, prefix);
 }
 
+/*
+ * register an enum lex type, its values are set by lex_enum_replace()
+ */
+int
+set_enum_lex_ent(int type, char *name, char *help)
+{
+	struct lex_ent *lex;
+	struct lex_enum *set;
+	pthread_rwlockattr_t attr;
+
+	if (!IS_CUSTOM_LEX_TYPE(type)) {
+		fprintf(stderr, "invalid customized lex index %d\n", type);
+		return -1;
+	}
+	if ((set = calloc(1, sizeof(struct lex_enum))) == NULL) {
+		fprintf(stderr, "set_enum_lex_ent: no memory\n");
+		return -1;
+	}
+	if (set_lex_ent(type, name, NULL, help, NULL) < 0) {
+		free(set);
+		return -1;
+	}
+
+	/* a refresh must not starve behind busy readers */
+	pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+	pthread_rwlockattr_setkind_np(&attr,
+		PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+	pthread_rwlock_init(&set->lock, &attr);
+	pthread_rwlockattr_destroy(&attr);
+
+	lex = get_lex_ent(type);
+	lex->set = set;
+	return 0;
+}
+
+/*
+ * freeze lex registry after all customized types are registered.
+ * from then on lex entries are read only, and all the
+ * is_xxx() validators and get_lex_ent() are safe to call from any thread.
+ * call it before starting threads which do parsing.
+ */
+int
+lex_freeze(void)
+{
+	if (!lex_init_ok) {
+		fprintf(stderr, "lex_freeze: lex module not initialized\n");
+		return -1;
+	}
+	__atomic_store_n(&lex_frozen, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/*
+ * is lex registry frozen ?
+ */
+int
+lex_is_frozen(void)
+{
+	return LEX_FROZEN();
+}
+
 /*
  * get lex_ent by type
  */
 struct lex_ent *
 get_lex_ent(int type)
 {
-	if (IS_VALID_LEX_TYPE(type))
+	if (IS_BUILTIN_LEX_TYPE(type))
 		return (&lex_ent[type]);
+	else if (IS_CUSTOM_LEX_TYPE(type) &&
+		 type - LEX_CUSTOM_BASE_TYPE < custom_ent_num)
+		return custom_ent[type - LEX_CUSTOM_BASE_TYPE];
 	else
 		return NULL;
 }
 
+/*
+ * validate str of an integer lex type and convert it in the same pass.
+ * LEX_INT, LEX_HEX, LEX_PORT and LEX_VLAN_ID are supported, a value
+ * above 64 bits is taken as invalid. return 1 with the value set back,
+ * or 0 if str is invalid.
+ */
+int
+get_lex_uint(int type, char *str, u_int64_t *val)
+{
+	u_int64_t v = 0;
+	char	*p = str, *q;
+	u_int	d;
+
+	if (!str || !str[0] || !val) return 0;
+
+	if (type == LEX_HEX) {
+		if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+			p += 2;
+		for (q = p; q - p < 16 && IS_XDIGIT(*q); q++)
+			v = (v << 4) | (IS_DIGIT(*q) ?
+				*q - '0' : (*q | 0x20) - 'a' + 10);
+	} else if (type == LEX_INT || type == LEX_PORT ||
+		   type == LEX_VLAN_ID) {
+		for (q = p; IS_DIGIT(*q); q++) {
+			d = *q - '0';
+			if (v > (UINT64_MAX - d) / 10)
+				return 0;
+			v = v * 10 + d;
+		}
+	} else {
+		return 0;
+	}
+
+	if (q == p || !AT_EOS(q))
+		return 0;
+	if (type == LEX_PORT && (q - p > 5 || v > 65535))
+		return 0;
+	if (type == LEX_VLAN_ID && (v < 1 || v > 4094))
+		return 0;
+
+	*val = v;
+	return 1;
+}
+
+/*
+ * validate str of an integer lex type and convert it in the same pass,
+ * LEX_SINT and the types of get_lex_uint() are supported. return 1 with
+ * the value set back, or 0 if str is invalid or out of 64-bit signed.
+ */
+int
+get_lex_int(int type, char *str, int64_t *val)
+{
+	u_int64_t v;
+	int	neg = 0;
+
+	if (!str || !val) return 0;
+
+	if (type == LEX_SINT) {
+		if (*str == '-') {
+			neg = 1;
+			str++;
+		}
+		type = LEX_INT;
+	}
+
+	if (!get_lex_uint(type, str, &v))
+		return 0;
+
+	if (neg) {
+		if (v > (u_int64_t) INT64_MAX + 1)
+			return 0;
+		*val = (v == (u_int64_t) INT64_MAX + 1) ?
+			INT64_MIN : -(int64_t) v;
+	} else {
+		if (v > INT64_MAX)
+			return 0;
+		*val = v;
+	}
+	return 1;
+}
+
 /*
  * translate bit mask into ia mask
  */
@@ -1087,19 +3586,75 @@ get_uri_elements(char *str, char **pproto, char **phost,
 	return 1;
 }
 
+/*
+ * init char class table
+ */
+static void
+init_lex_cc(void)
+{
+	int	c;
+
+	for (c = 0; c < 256; c++) {
+		if (IS_DIGIT(c))
+			lex_cc[c] = CC_DIGIT;
+		else if (IS_XDIGIT(c))
+			lex_cc[c] = CC_XALPHA;
+		else if (IS_LETTER(c))
+			lex_cc[c] = CC_ALPHA;
+		else if (c == '_')
+			lex_cc[c] = CC_UNDER;
+		else if (c == '.')
+			lex_cc[c] = CC_DOT;
+		else if (c == '-')
+			lex_cc[c] = CC_DASH;
+		else if (c == ':')
+			lex_cc[c] = CC_COLON;
+		else if (c == '/')
+			lex_cc[c] = CC_SLASH;
+		else if (c == '@')
+			lex_cc[c] = CC_AT;
+		else if (c == '+')
+			lex_cc[c] = CC_PLUS;
+		else
+			lex_cc[c] = CC_OTHER;
+	}
+}
+
 /*
  * init module
  */
 int
 lex_init(void)
 {
+	int	i;
+
 	if (lex_init_ok) return 0;
 
 	/* init pcre precompile memory */
 	bzero(&pcre_cache[0], sizeof(pcre_cache));
 
+	/* step budget of pcre matching */
+	if (lex_mctx == NULL &&
+	    (lex_mctx = pcre2_match_context_create(NULL)) != NULL)
+		pcre2_set_match_limit(lex_mctx, lex_match_limit);
+
+	/* precompile all built-in patterns */
+	for (i = 0; i < LEX_CUSTOM_BASE_TYPE; i++) {
+		if (lex_pattern[i] &&
+		    pcre_cache_pattern(&pcre_cache[i], i, lex_pattern[i]) == NULL)
+			fprintf(stderr, "lex_init: bad pattern of type %d\n", i);
+	}
+
+	/* init char class table of lex_classify() */
+	init_lex_cc();
+
+#ifdef LEX_SIMD
+	/* pick vector kernels of native scanners */
+	init_tok_mask();
+#endif
+
 	/* init lexicial paring entries */
-	bzero(&lex_ent[0], sizeof(struct lex_ent) * MAX_LEX_TYPE);
+	bzero(&lex_ent[0], sizeof(lex_ent));
 
 	set_lex_ent(LEX_IP_ADDR, "IP_ADDR", is_ip_addr, "a.b.c.d", NULL);
 	set_lex_ent(LEX_IP_MASK, "IP_MASK", is_ip_mask, "m.m.m.m", NULL);
@@ -1116,6 +3671,7 @@ lex_init(void)
 	set_lex_ent(LEX_WORD, "WORD", is_word, "Word", NULL);
 	set_lex_ent(LEX_WORDS, "WORDS", is_words, "\"Words...\"", NULL);
 	set_lex_ent(LEX_INT, "INT", is_int, "Integer", NULL);
+	set_lex_ent(LEX_HEX, "HEX", is_hex, "Hexadecimal", NULL);
 	set_lex_ent(LEX_DECIMAL, "DECIMAL", is_decimal, "Decimal", NULL);
 	set_lex_ent(LEX_HOST_NAME, "HOST_NAME", is_host_name, "Host", NULL);
 	set_lex_ent(LEX_HOST, "HOST", is_host, "Host|a.b.c.d", NULL);
@@ -1133,6 +3689,21 @@ lex_init(void)
 	set_lex_ent(LEX_NET_UID, "NET_UID", is_net_uid, "user@host", NULL);
 	set_lex_ent(LEX_NET6_UID, "NET6_UID", is_net6_uid, "user@IP6Addr", NULL);
 	set_lex_ent(LEX_DATE_TIME, "DATE_TIME", is_date_time, "YYYYMMDDhhmm[.ss]", NULL);
+	set_lex_ent(LEX_SINT, "SINT", is_sint, "[-]Integer", NULL);
+
+	/* partial functions of types not fully described by a pcre pattern */
+	set_lex_partial(LEX_IP_ADDR, partial_ip_addr);
+	set_lex_partial(LEX_IP_MASK, partial_ip_addr);
+	set_lex_partial(LEX_IP_PREFIX, partial_ip_block);
+	set_lex_partial(LEX_IP_BLOCK, partial_ip_block);
+	set_lex_partial(LEX_IP_RANGE, partial_ip_range);
+	set_lex_partial(LEX_IP6_ADDR, partial_ip6_addr);
+	set_lex_partial(LEX_IP6_PREFIX, partial_ip6_block);
+	set_lex_partial(LEX_IP6_BLOCK, partial_ip6_block);
+	set_lex_partial(LEX_HOST, partial_host);
+	set_lex_partial(LEX_HOST6, partial_host6);
+	set_lex_partial(LEX_NET6_UID, partial_net6_uid);
+	set_lex_partial(LEX_WORDS, is_words);
 
 	lex_init_ok = 1;
 	return 0;
@@ -1146,13 +3717,68 @@ lex_exit(void)
 {
 	int	i;
 
+	__atomic_store_n(&lex_frozen, 0, __ATOMIC_RELEASE);
+
+	/* free pcre state of customized types and the combined matcher */
+	for (i = 0; i < custom_pcre_num; i++) {
+		if (custom_pcre[i] == NULL) continue;
+		if (custom_pcre[i]->code != NULL)
+			pcre2_code_free(custom_pcre[i]->code);
+		free(custom_pcre[i]->pattern);
+		free(custom_pcre[i]);
+	}
+	free(custom_pcre);
+	custom_pcre = NULL;
+	custom_pcre_num = 0;
+	drop_combined();
+	if (combined_mctx != NULL) {
+		pcre2_match_context_free(combined_mctx);
+		combined_mctx = NULL;
+	}
+	if (lex_mctx != NULL) {
+		pcre2_match_context_free(lex_mctx);
+		lex_mctx = NULL;
+	}
+
+	/* free customized entries and the name index */
+	for (i = 0; i < custom_ent_num; i++) {
+		if (custom_ent[i] == NULL) continue;
+		if (custom_ent[i]->set != NULL) {
+			pthread_rwlock_destroy(&custom_ent[i]->set->lock);
+			free(custom_ent[i]->set->tab);
+			free(custom_ent[i]->set);
+		}
+		free(custom_ent[i]);
+	}
+	free(custom_ent);
+	custom_ent = NULL;
+	custom_ent_num = 0;
+
+	free(lex_name_hash);
+	lex_name_hash = NULL;
+	lex_name_hash_size = 0;
+	lex_name_hash_used = 0;
+
 	/* free all pcre precompile cache memory */
-	for (i = 0; i < MAX_LEX_TYPE; i++) {
+	for (i = 0; i < LEX_CUSTOM_BASE_TYPE; i++) {
 		if (pcre_cache[i] != NULL) {
-			pcre_free(pcre_cache[i]);
+			pcre2_code_free(pcre_cache[i]);
 			pcre_cache[i] = NULL;
 		}
 	}
+
+	/* other threads release their match data on exit */
+	if (match_data != NULL) {
+		pthread_setspecific(match_data_key, NULL);
+		pcre2_match_data_free(match_data);
+		match_data = NULL;
+	}
+	if (dfa_ws != NULL && dfa_ws != dfa_ws_tls) {
+		pthread_setspecific(dfa_ws_key, NULL);
+		free(dfa_ws);
+	}
+	dfa_ws = NULL;
+	dfa_ws_size = 0;
 	lex_init_ok = 0;
 }
 
@@ -1160,17 +3786,37 @@ lex_exit(void)
 int
 main(int argc, char **argv)
 {
-	int	i, j, k;
+	int	i, j, k, res;
 	struct in_addr ia_net, ia_mask;
 	struct in_addr ia_from, ia_to;
 	u_short	port_from, port_to;
 	u_char	mac[6];
+	lexmask_t mask;
 
 	lex_init();
 
 	for (i = 1; i < argc; i++) {
-		for (j = 1; j < MAX_LEX_TYPE; j++) {
+		/* cross check classifier against validators */
+		lex_classify(argv[i], &mask);
+		for (j = 0; j < LEX_CUSTOM_BASE_TYPE; j++) {
+			if (!lex_ent[j].fun) continue;
+			res = ((mask & LEX_MASK(j)) != 0);
+			if (lex_ent[j].fun(argv[i]) != res)
+				printf("%s(\"%s\") MISMATCH, classify = %d\n",
+					lex_ent[j].name, argv[i], res);
+		}
+
+		for (j = 0; j < LEX_CUSTOM_BASE_TYPE; j++) {
 			if (!lex_ent[j].name[0] || !lex_ent[j].fun) continue;
+
+			/* cross check native scanners against pcre */
+			lex_set_native(0);
+			res = lex_ent[j].fun(argv[i]);
+			lex_set_native(1);
+			if (lex_ent[j].fun(argv[i]) != res)
+				printf("%s(\"%s\") MISMATCH, pcre = %d\n",
+					lex_ent[j].name, argv[i], res);
+
 			if (lex_ent[j].fun(argv[i]) != 1) continue;
 
 			printf("%s(\"%s\") = true, "
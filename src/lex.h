@@ -27,7 +27,6 @@
 
 #include <sys/types.h>
 #include <string.h>
-#include <pcre.h>
 #include <netinet/in.h>
 
 typedef int (*lex_fun_t)(char *);
@@ -41,6 +40,8 @@ struct lex_ent {
 	lex_fun_t fun;			/* parsing function */
 	char	help[LEX_TEXT_LEN];	/* lexical help text */
 	char	prefix[LEX_TEXT_LEN];	/* prefix, eth, tun */
+	lex_fun_t partial;		/* could a prefix become valid */
+	struct lex_enum *set;		/* value set of enum types */
 };
 
 typedef enum lex_type {
@@ -77,10 +78,15 @@ typedef enum lex_type {
 	LEX_NET_UID,
 	LEX_NET6_UID,
 	LEX_DATE_TIME,
-	LEX_CUSTOM_BASE_TYPE	/* customized type starts here */
+	LEX_SINT,
+	/*
+	 * customized type starts here. a built-in type added above
+	 * renumbers customized types, bump SONAME in Makefile for it.
+	 */
+	LEX_CUSTOM_BASE_TYPE
 } lex_type_t;
 
-#define MAX_CUSTOM_LEX_NUM	128
+#define MAX_CUSTOM_LEX_NUM	1024
 
 #define LEX_CUSTOM_TYPE(x) (LEX_CUSTOM_BASE_TYPE + x)
 
@@ -93,7 +99,78 @@ typedef enum lex_type {
 	(type >= 0 && type < MAX_LEX_TYPE)
 
 #define IS_NUMERIC_LEX_TYPE(type) \
-	(type == LEX_INT || type == LEX_DECIMAL)
+	(type == LEX_INT || type == LEX_SINT || type == LEX_DECIMAL)
+
+#define IS_INTEGER_LEX_TYPE(type) \
+	(type == LEX_INT || type == LEX_SINT || type == LEX_HEX || \
+	 type == LEX_PORT || type == LEX_VLAN_ID)
+
+#define IS_BUILTIN_LEX_TYPE(type) \
+	(type >= 0 && type < LEX_CUSTOM_BASE_TYPE)
+
+/* bitmask of built-in lex types, set by lex_classify() */
+typedef u_int64_t lexmask_t;
+
+#define LEX_MASK(type)	((lexmask_t) 1 << (type))
+
+/* bitmask of customized lex types, set by pcre_custom_match_all() */
+#define CUSTOM_LEXMASK_WORDS	((MAX_CUSTOM_LEX_NUM + 63) / 64)
+
+typedef struct custom_lexmask {
+	u_int64_t bits[CUSTOM_LEXMASK_WORDS];
+} custom_lexmask_t;
+
+#define CUSTOM_LEX_BIT(type)	((type) - LEX_CUSTOM_BASE_TYPE)
+
+#define CUSTOM_LEX_SET(m, type) \
+	((m)->bits[CUSTOM_LEX_BIT(type) / 64] |= \
+	 (u_int64_t) 1 << (CUSTOM_LEX_BIT(type) % 64))
+
+#define CUSTOM_LEX_ISSET(m, type) \
+	((m)->bits[CUSTOM_LEX_BIT(type) / 64] & \
+	 ((u_int64_t) 1 << (CUSTOM_LEX_BIT(type) % 64)))
+
+/* parsed value of a token, set by lex_validate_many() */
+typedef union lex_value {
+	u_int64_t	num;		/* INT, HEX, PORT, VLAN_ID */
+	int64_t		inum;		/* SINT */
+	double		dec;		/* DECIMAL */
+	struct {
+		struct in_addr addr;
+		struct in_addr mask;
+	} ip;				/* IP_ADDR, IP_MASK, IP_PREFIX, IP_BLOCK */
+	struct {
+		struct in_addr from;
+		struct in_addr to;
+	} ip_range;			/* IP_RANGE */
+	struct {
+		struct in6_addr addr;
+		int	pfx_len;
+	} ip6;				/* IP6_ADDR, IP6_PREFIX, IP6_BLOCK */
+	struct {
+		u_short	from;
+		u_short	to;
+	} port_range;			/* PORT_RANGE */
+	u_char		mac[6];		/* MAC_ADDR */
+} lex_value_t;
+
+/* span of a string, len is 0 if absent */
+typedef struct lex_span {
+	int	off;
+	int	len;
+} lex_span_t;
+
+/* elements of an URL, set by get_uri_spans() */
+typedef struct uri_spans {
+	lex_span_t scheme;	/* http, https, ftp, scp, tftp */
+	lex_span_t userinfo;	/* user[:password] of ftp and scp */
+	lex_span_t user;
+	lex_span_t password;
+	lex_span_t host;
+	lex_span_t port;
+	lex_span_t path;	/* after the '/' following host */
+	lex_span_t file;	/* last element of path */
+} uri_spans_t;
 
 /*
  * module funcs
@@ -102,9 +179,27 @@ extern int lex_init(void);
 extern void lex_exit(void);
 extern struct lex_ent *get_lex_ent(int type);
 extern int get_lex_type(char *name);
+extern void lex_set_native(int enabled);
+extern void lex_set_dfa(int enabled);
+extern int lex_set_match_limit(u_int32_t limit);
+extern int lex_classify(char *str, lexmask_t *mask);
+extern int lex_validate_many(int type, char **toks, int n, u_int8_t *verdicts,
+			     lex_value_t *values);
+extern int lex_match(int type, char *str);
+extern int lex_partial(int type, char *str);
+extern int set_lex_partial(int type, lex_fun_t partial);
+extern int lex_freeze(void);
+extern int lex_is_frozen(void);
 
 extern int pcre_custom_match(char *str, int idx, char *pattern);
+extern int pcre_custom_compile(int idx, char *pattern);
+extern int pcre_custom_partial(char *str, int idx, char *pattern);
+extern int lex_combine_custom(void);
+extern int pcre_custom_match_all(char *str, custom_lexmask_t *mask);
 extern int set_custom_lex_ent(int type, char *name, lex_fun_t fun, char *help, char *prefix);
+extern int set_enum_lex_ent(int type, char *name, char *help);
+extern int lex_enum_replace(int type, char **vals, int n);
+extern int lex_enum_matches(int type, char *prefix, char **matches, int limit);
 
 /*
  * paring funcs, return TRUE (1) if matched, else return FALSE (0)
@@ -135,6 +230,7 @@ extern int is_scp_url(char *str);
 extern int is_tftp_url(char *str);
 
 extern int is_int(char *str);
+extern int is_sint(char *str);
 extern int is_hex(char *str);
 extern int is_decimal(char *str);
 extern int is_vlan_id(char *str);
@@ -159,11 +255,14 @@ extern int is_empty_line(char *str);
 extern in_addr_t bits_to_netmask(int bits);
 extern int netmask_to_bits(in_addr_t s_addr);
 extern int get_subnet_mask(char *str, struct in_addr *ia_net, struct in_addr *ia_mask, int fix_net);
+extern int get_lex_uint(int type, char *str, u_int64_t *val);
+extern int get_lex_int(int type, char *str, int64_t *val);
 extern int get_ip6_addr_pfx(char *str, struct in6_addr *ia6, int *pfx_len);
 extern int get_binary_mac(char *str, u_char *mac, int len);
 extern int get_formal_mac(char *str, char *mac_addr, int len);
 extern int get_ip_range(char *str, struct in_addr *ia_from, struct in_addr *ia_to);
 extern int get_port_range(char *str, u_short *port_from, u_short *port_to);
 extern int get_uri_elements(char *str, char **pproto, char **phost, char **ppath, char **pfile);
+extern int get_uri_spans(char *str, uri_spans_t *uri);
 
 #endif
@@ -0,0 +1,511 @@
+/*
+ *  libocli, A general C library to provide a open-source cisco style
+ *  command line interface.
+ *
+ *  Copyright (C) 2015-2022 Digger Wu (digger.wu@linkbroad.com)
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * lexbench.c, benchmark of lexical parsing functions, built by
+ * "make lexbench".
+ *
+ * every registered lex type is run over generated corpora of valid,
+ * near-miss and random tokens, with native scanners and with pcre, and
+ * ns/token, matches/sec, allocations/token are reported side by side.
+ *
+ * usage: lexbench [-n tokens] [-r rounds] [-s seed] [TYPE ...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "lex.h"
+
+#define	BENCH_TOK_LEN	64
+
+#define	CORPUS_VALID	0
+#define	CORPUS_NEAR	1
+#define	CORPUS_RANDOM	2
+#define	CORPUS_NUM	3
+
+static char *corpus_name[CORPUS_NUM] = {"valid", "near-miss", "random"};
+
+/* allocation counter, glibc only */
+static unsigned long alloc_cnt = 0;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *
+malloc(size_t size)
+{
+	alloc_cnt++;
+	return __libc_malloc(size);
+}
+
+void *
+calloc(size_t n, size_t size)
+{
+	alloc_cnt++;
+	return __libc_calloc(n, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+	alloc_cnt++;
+	return __libc_realloc(ptr, size);
+}
+#define	HAS_ALLOC_CNT	1
+#else
+#define	HAS_ALLOC_CNT	0
+#endif
+
+static const char *word_chars =
+	"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
+static const char *xdigit_chars = "0123456789abcdefABCDEF";
+static const char *tld[] = {"com", "net", "org", "cn", "io"};
+
+/* chars used to mutate a valid token into a near-miss one */
+static const char *near_chars = "0123456789aAfFgzx.:-/@_+ %";
+
+static int
+rnd(int n)
+{
+	return (n > 0) ? (rand() % n) : 0;
+}
+
+static int
+gen_word(char *buf, int size, int min_len, int max_len)
+{
+	int	i, len;
+
+	len = min_len + rnd(max_len - min_len + 1);
+	if (len >= size) len = size - 1;
+	for (i = 0; i < len; i++) {
+		buf[i] = (i == 0) ? word_chars[rnd(52)] : word_chars[rnd(63)];
+	}
+	buf[len] = '\0';
+	return len;
+}
+
+static int
+gen_ip(char *buf, int size)
+{
+	return snprintf(buf, size, "%d.%d.%d.%d",
+			rnd(256), rnd(256), rnd(256), rnd(256));
+}
+
+static int
+gen_ip6(char *buf, int size)
+{
+	int	i, len = 0, zero = rnd(8);
+
+	if (rnd(2)) {
+		/* compressed form */
+		for (i = 0; i < zero; i++)
+			len += snprintf(buf + len, size - len, "%x:", rnd(0x10000));
+		len += snprintf(buf + len, size - len, "%s", (zero) ? ":" : "::");
+		for (i = zero + 1; i < 7; i++)
+			len += snprintf(buf + len, size - len, "%x%s",
+					rnd(0x10000), (i < 6) ? ":" : "");
+	} else {
+		for (i = 0; i < 8; i++)
+			len += snprintf(buf + len, size - len, "%x%s",
+					rnd(0x10000), (i < 7) ? ":" : "");
+	}
+	return len;
+}
+
+static int
+gen_domain(char *buf, int size)
+{
+	int	i, len = 0, n = 1 + rnd(3);
+
+	for (i = 0; i < n; i++) {
+		len += gen_word(buf + len, size - len, 1, 8);
+		buf[len++] = '.';
+	}
+	len += snprintf(buf + len, size - len, "%s", tld[rnd(5)]);
+	return len;
+}
+
+/*
+ * generate a token valid for given lex type
+ */
+static int
+gen_valid(int type, char *buf, int size)
+{
+	int	i, len = 0;
+	u_int	mask;
+	char	sep;
+
+	switch (type) {
+	case LEX_IP_ADDR:
+		return gen_ip(buf, size);
+	case LEX_IP_MASK:
+		mask = (u_int) (0xffffffffULL << (32 - rnd(33)));
+		return snprintf(buf, size, "%u.%u.%u.%u", mask >> 24,
+				(mask >> 16) & 0xff, (mask >> 8) & 0xff,
+				mask & 0xff);
+	case LEX_IP_PREFIX:
+		len = gen_ip(buf, size);
+		return len + snprintf(buf + len, size - len, "/%d", rnd(33));
+	case LEX_IP_BLOCK:
+		len = gen_ip(buf, size);
+		if (rnd(2))
+			len += snprintf(buf + len, size - len, "/%d", rnd(33));
+		return len;
+	case LEX_IP_RANGE:
+		len = gen_ip(buf, size);
+		if (rnd(2)) {
+			buf[len++] = '-';
+			len += gen_ip(buf + len, size - len);
+		}
+		return len;
+	case LEX_IP6_ADDR:
+	case LEX_HOST6:
+		return gen_ip6(buf, size);
+	case LEX_IP6_PREFIX:
+		len = gen_ip6(buf, size);
+		return len + snprintf(buf + len, size - len, "/%d", rnd(129));
+	case LEX_IP6_BLOCK:
+		len = gen_ip6(buf, size);
+		if (rnd(2))
+			len += snprintf(buf + len, size - len, "/%d", rnd(129));
+		return len;
+	case LEX_PORT:
+		return snprintf(buf, size, "%d", rnd(65536));
+	case LEX_PORT_RANGE:
+		i = rnd(65536);
+		return snprintf(buf, size, "%d-%d", i, i + rnd(65536 - i));
+	case LEX_VLAN_ID:
+		return snprintf(buf, size, "%d", 1 + rnd(4094));
+	case LEX_MAC_ADDR:
+		sep = ":-\0"[rnd(3)];
+		for (i = 0; i < 6; i++) {
+			buf[len++] = xdigit_chars[rnd(22)];
+			buf[len++] = xdigit_chars[rnd(22)];
+			if (sep && i < 5) buf[len++] = sep;
+		}
+		buf[len] = '\0';
+		return len;
+	case LEX_WORD:
+		len = gen_word(buf, size, 1, 12);
+		if (rnd(2)) buf[len++] = '-';
+		return len + gen_word(buf + len, size - len, 1, 4);
+	case LEX_WORDS:
+		return gen_word(buf, size, 1, 20);
+	case LEX_INT:
+		return snprintf(buf, size, "%d", rnd(1000000));
+	case LEX_SINT:
+		return snprintf(buf, size, "%d", rnd(2000000) - 1000000);
+	case LEX_HEX:
+		return snprintf(buf, size, "%s%x", rnd(2) ? "0x" : "",
+				(u_int) rand());
+	case LEX_DECIMAL:
+		return snprintf(buf, size, "%d.%d", rnd(100000), rnd(1000));
+	case LEX_HOST_NAME:
+	case LEX_HOST:
+		if (rnd(2)) return gen_word(buf, size, 1, 12);
+		return gen_domain(buf, size);
+	case LEX_DOMAIN_NAME:
+		return gen_domain(buf, size);
+	case LEX_EMAIL_ADDR:
+		len = gen_word(buf, size, 1, 10);
+		buf[len++] = '@';
+		return len + gen_domain(buf + len, size - len);
+	case LEX_HTTP_URL:
+	case LEX_HTTPS_URL:
+	case LEX_TFTP_URL:
+		len = snprintf(buf, size, "%s://", (type == LEX_HTTP_URL) ? "http" :
+			       (type == LEX_HTTPS_URL) ? "https" : "tftp");
+		len += gen_domain(buf + len, size - len);
+		buf[len++] = '/';
+		return len + gen_word(buf + len, size - len, 1, 10);
+	case LEX_FTP_URL:
+	case LEX_SCP_URL:
+		len = snprintf(buf, size, "%s://",
+			       (type == LEX_FTP_URL) ? "ftp" : "scp");
+		len += gen_word(buf + len, size - len, 2, 6);
+		if (type == LEX_FTP_URL) {
+			buf[len++] = ':';
+			len += gen_word(buf + len, size - len, 2, 6);
+		}
+		buf[len++] = '@';
+		len += gen_domain(buf + len, size - len);
+		buf[len++] = '/';
+		return len + gen_word(buf + len, size - len, 1, 10);
+	case LEX_FILE_NAME:
+	case LEX_UID:
+		len = gen_word(buf, size, 1, 8);
+		buf[len++] = '.';
+		return len + gen_word(buf + len, size - len, 1, 3);
+	case LEX_FILE_PATH:
+		for (i = 1 + rnd(3); i > 0; i--) {
+			buf[len++] = '/';
+			len += gen_word(buf + len, size - len, 2, 8);
+		}
+		return len;
+	case LEX_NET_UID:
+		len = gen_word(buf, size, 2, 8);
+		buf[len++] = '@';
+		return len + gen_domain(buf + len, size - len);
+	case LEX_NET6_UID:
+		len = gen_word(buf, size, 2, 8);
+		buf[len++] = '@';
+		return len + gen_ip6(buf + len, size - len);
+	case LEX_DATE_TIME:
+		return snprintf(buf, size, "20%02d%02d%02d%02d%02d.%02d",
+				15 + rnd(85), 1 + rnd(12), 1 + rnd(28),
+				rnd(24), rnd(60), rnd(60));
+	default:
+		/* customized types, no idea of its syntax */
+		return gen_word(buf, size, 1, 16);
+	}
+}
+
+/*
+ * turn a valid token into a near-miss one by a single edit
+ */
+static void
+gen_near(int type, char *buf, int size)
+{
+	int	len, pos, op;
+
+	len = gen_valid(type, buf, size);
+	pos = rnd(len);
+	op = rnd(3);
+
+	if (op == 0 && len > 0) {
+		buf[pos] = near_chars[rnd(strlen(near_chars))];
+	} else if (op == 1 && len < size - 1) {
+		memmove(buf + pos + 1, buf + pos, len - pos + 1);
+		buf[pos] = near_chars[rnd(strlen(near_chars))];
+	} else if (len > 1) {
+		memmove(buf + pos, buf + pos + 1, len - pos);
+	}
+}
+
+static void
+gen_random(char *buf, int size)
+{
+	int	i, len = 1 + rnd(24);
+
+	if (len >= size) len = size - 1;
+	for (i = 0; i < len; i++)
+		buf[i] = 0x21 + rnd(0x7e - 0x21 + 1);
+	buf[len] = '\0';
+}
+
+static double
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e9 + ts.tv_nsec);
+}
+
+struct bench_res {
+	double	ns;		/* ns per token */
+	double	mps;		/* matches per second */
+	double	allocs;		/* allocations per token */
+	int	matches;	/* matched tokens in one round */
+};
+
+/*
+ * run lex fun over corpus for rounds
+ */
+static void
+bench_run(lex_fun_t fun, char (*toks)[BENCH_TOK_LEN], int n, int rounds,
+	  u_char *verdicts, struct bench_res *res)
+{
+	double	start, elapsed;
+	unsigned long allocs;
+	long	matches = 0;
+	int	i, r;
+
+	/* warm up, and take verdicts of this path */
+	res->matches = 0;
+	for (i = 0; i < n; i++) {
+		verdicts[i] = (fun(toks[i]) == 1);
+		res->matches += verdicts[i];
+	}
+
+	allocs = alloc_cnt;
+	start = now_ns();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < n; i++)
+			matches += (fun(toks[i]) == 1);
+	}
+	elapsed = now_ns() - start;
+	allocs = alloc_cnt - allocs;
+
+	res->ns = elapsed / ((double) n * rounds);
+	res->mps = (elapsed > 0) ? (matches * 1e9 / elapsed) : 0;
+	res->allocs = (double) allocs / ((double) n * rounds);
+}
+
+static void
+print_rate(double mps)
+{
+	if (mps >= 1e6)
+		printf(" %7.2fM", mps / 1e6);
+	else if (mps >= 1e3)
+		printf(" %7.2fK", mps / 1e3);
+	else
+		printf(" %8.0f", mps);
+}
+
+static void
+print_res(struct bench_res *res)
+{
+	printf(" %8.1f", res->ns);
+	print_rate(res->mps);
+	if (HAS_ALLOC_CNT)
+		printf(" %6.2f", res->allocs);
+	else
+		printf(" %6s", "n/a");
+}
+
+static int
+type_selected(char *name, char **names, int num)
+{
+	int	i;
+
+	if (num == 0) return 1;
+	for (i = 0; i < num; i++) {
+		if (strcasecmp(name, names[i]) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+static void
+usage(char *prog)
+{
+	fprintf(stderr, "usage: %s [-n tokens] [-r rounds] [-s seed] [TYPE ...]\n",
+		prog);
+}
+
+int
+main(int argc, char **argv)
+{
+	char	(*toks)[BENCH_TOK_LEN];
+	u_char	*v_native, *v_pcre;
+	struct bench_res native, pcre;
+	struct lex_ent *lex;
+	int	n = 1000, rounds = 50, seed = 1;
+	int	type, c, i, diff;
+
+	while ((c = getopt(argc, argv, "n:r:s:h")) != -1) {
+		switch (c) {
+		case 'n':
+			n = atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 's':
+			seed = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (n <= 0 || rounds <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	toks = malloc(sizeof(*toks) * n);
+	v_native = malloc(n);
+	v_pcre = malloc(n);
+	if (!toks || !v_native || !v_pcre) {
+		fprintf(stderr, "lexbench: no memory\n");
+		return 1;
+	}
+
+	lex_init();
+
+	printf("%d tokens x %d rounds per corpus\n\n", n, rounds);
+	printf("%-12s %-9s | %-24s | %-24s | %6s %5s\n", "",
+	       "", "native", "pcre", "", "");
+	printf("%-12s %-9s | %8s %8s %6s | %8s %8s %6s | %6s %5s\n",
+	       "TYPE", "CORPUS",
+	       "ns/tok", "match/s", "alloc",
+	       "ns/tok", "match/s", "alloc",
+	       "match%", "diff");
+
+	for (type = 0; type < MAX_LEX_TYPE; type++) {
+		lex = get_lex_ent(type);
+		if (!lex || !lex->name[0] || !lex->fun) continue;
+		if (!type_selected(lex->name, argv + optind, argc - optind))
+			continue;
+
+		for (c = 0; c < CORPUS_NUM; c++) {
+			/* same corpus for each type and corpus across runs */
+			srand(seed * 7919 + type * CORPUS_NUM + c);
+			for (i = 0; i < n; i++) {
+				if (c == CORPUS_VALID)
+					gen_valid(type, toks[i], BENCH_TOK_LEN);
+				else if (c == CORPUS_NEAR)
+					gen_near(type, toks[i], BENCH_TOK_LEN);
+				else
+					gen_random(toks[i], BENCH_TOK_LEN);
+			}
+
+			lex_set_native(1);
+			bench_run(lex->fun, toks, n, rounds, v_native, &native);
+			lex_set_native(0);
+			bench_run(lex->fun, toks, n, rounds, v_pcre, &pcre);
+			lex_set_native(1);
+
+			for (diff = 0, i = 0; i < n; i++) {
+				if (v_native[i] != v_pcre[i]) {
+					if (diff == 0)
+						fprintf(stderr, "%s(\"%s\") MISMATCH, "
+							"native = %d, pcre = %d\n",
+							lex->name, toks[i],
+							v_native[i], v_pcre[i]);
+					diff++;
+				}
+			}
+
+			printf("%-12s %-9s |", lex->name, corpus_name[c]);
+			print_res(&native);
+			printf(" |");
+			print_res(&pcre);
+			printf(" | %5.1f%% %5d\n",
+			       native.matches * 100.0 / n, diff);
+		}
+	}
+
+	lex_exit();
+	free(toks);
+	free(v_native);
+	free(v_pcre);
+	return 0;
+}
@@ -82,11 +82,25 @@ enum error_code {
 
 #define MAX_CHOICES	16	/* limit of choices for [] {} */
 
+/* kinds of range check */
+#define RANGE_NONE	0
+#define RANGE_FLOAT	1	/* double range of INT, SINT and DECIMAL */
+#define RANGE_INT	2	/* 64-bit signed range of integer types */
+#define RANGE_UINT	3	/* 64-bit unsigned range of integer types */
+
+/* bound of an integer range */
+typedef union ival {
+	int64_t		i;	/* RANGE_INT */
+	u_int64_t	u;	/* RANGE_UINT */
+} ival_t;
+
 typedef struct var {
 	int	lex_type;	/* lexical type */
-	int	chk_range;	/* if enabled numeric range check */
+	int	chk_range;	/* kind of range check, RANGE_XXX */
 	double	min_val;	/* minimal value of range */
 	double	max_val;	/* maximal value of range */
+	ival_t	min_ival;	/* minimal value of integer range */
+	ival_t	max_ival;	/* maximal value of integer range */
 } var_t;
 
 typedef struct node node_t;
@@ -98,31 +112,37 @@ typedef struct node node_t;
 typedef int (*arg_helper_t)(char *, char **, int);
 
 struct node {
+	/* hot part, read by matching args against children */
 	int	match_type;		/* keyword or variable */
+	u_int	do_view_mask;		/* the do view mask */
+	u_int	undo_view_mask;		/* the undo view mask */
 	union {
-		char	keyword[MAX_WORD_LEN];	/* the keyword string */
-		var_t	var;			/* the variable item */
+		const char *keyword;	/* the keyword string, interned */
+		var_t	var;		/* the variable item */
 	} match_ent;
 
-	u_int	do_view_mask;		/* the do view mask */
-	u_int	undo_view_mask;		/* the undo view mask */
-	char	arg_name[MAX_WORD_LEN];	/* arg name for command exec */
-	char	help[MAX_TEXT_LEN];	/* help text info */
+	int	child_order;		/* position in child_list of parent */
+	int	alt_order;		/* alt silbing order: eldest = 1 */
+	node_t	*opt_head;		/* opt end node, backtrack to opt group head */
+	node_t	*alt_head;		/* alt youngest sibling, backtrack to eldest */
+
+	/* index of child_list */
+	int	key_num;		/* number of keyword children */
+	int	other_num;		/* number of other children */
+	node_t	**keys;			/* keyword children, sorted */
+	node_t	**others;		/* other children, in list order */
+	node_t	*leaf;			/* leaf child, NULL if none */
 
+	/* cold part, for help, completion and tree building */
+	const char *arg_name;		/* arg name for command exec, interned */
+	const char *help;		/* help text info, interned */
 	arg_helper_t arg_helper;	/* helper func for auto completion */
 
 	int	depth;			/* tree node depth, 0 is root */
-	node_t	*parent;		/* parent node */
-
 	int	child_num;		/* number of child nodes */
+	node_t	*parent;		/* parent node */
 	struct list_head child_list;	/* list of child nodes */
 	struct list_head sibling_list;	/* link to sibling list */
-
-	int	opt_mark;		/* opt used mark */
-	node_t	*opt_head;		/* opt end node, backtrack to opt group head */
-
-	int	alt_order;		/* alt silbing order: eldest = 1 */
-	node_t	*alt_head;		/* alt youngest sibling, backtrack to eldest */
 };
 
 #define	MANUAL_ARG	"_CMD_"	/* tricky for manual node->arg_name */
@@ -139,9 +159,11 @@ typedef struct symbol {
 	char	*name;		/* name of symbol */
 	char	*help;		/* symbol help info */
 	int	lex_type;	/* if a lexcial type is set, -1 N/A */
-	int	chk_range;	/* if enable numeric range check */
+	int	chk_range;	/* kind of range check, RANGE_XXX */
 	double	min_val;	/* minimal value of range */
 	double	max_val;	/* maximal value of range */
+	ival_t	min_ival;	/* minimal value of integer range */
+	ival_t	max_ival;	/* maximal value of integer range */
 	char	*arg_name;	/* if set an arg name */
 	node_t	*node;		/* pointer to an assiciated node */
 	struct list_head list;	/* link to symbol table */
@@ -151,7 +173,7 @@ typedef struct symbol {
  *	n	- name string of symbol
  *	h	- help string of symbol
  *	t	- lexical type ID, e.g. LEX_INT
- *	c	- if range check enabled, 1 or 0
+ *	c	- kind of range check, RANGE_XXX
  *	x	- min vallue of range
  *	y	- max vallue of range
  *	a	- callback arg name, usually by ARG() macro
@@ -183,12 +205,47 @@ typedef struct symbol {
 
 /* Define a var symbol with type, arg and range */
 #define DEF_VAR_RANGE(n, h, t, a, x, y) \
-	DEF_SYM(n, h, t, 1, x, y, a)
+	DEF_SYM(n, h, t, RANGE_FLOAT, x, y, a)
+
+/* Define a var symbol with integer type, arg and 64-bit integer range */
+#define DEF_SYM_IVAL(n, h, t, c, f, x, y, a) {	\
+	.name		= n,		\
+	.help		= h,		\
+	.lex_type	= t,		\
+	.chk_range	= c,		\
+	.min_ival	= { .f = x },	\
+	.max_ival	= { .f = y },	\
+	.arg_name	= a,		\
+	.node		= NULL,		\
+	.list		= {NULL, NULL}	\
+}
+
+#define DEF_VAR_INT_RANGE(n, h, t, a, x, y) \
+	DEF_SYM_IVAL(n, h, t, RANGE_INT, i, x, y, a)
+
+#define DEF_VAR_UINT_RANGE(n, h, t, a, x, y) \
+	DEF_SYM_IVAL(n, h, t, RANGE_UINT, u, x, y, a)
 
 /* Define a reserved syntax symbol */
 #define DEF_RSV(n, h) \
 	DEF_SYM(n, h, -2, 0, 0, 0, NULL)
 
+/* Definition of syntax type, a row of add_cmd_syntaxes() table */
+typedef struct syntax {
+	char	*syntax;	/* syntax string */
+	int	view_mask;	/* views of syntax */
+	int	do_flag;	/* DO_FLAG and/or UNDO_FLAG */
+	int	manual;		/* 1 to add manual as add_cmd_easily() */
+} syntax_t;
+
+/* Define a syntax as add_cmd_syntax() */
+#define DEF_SYNTAX(s, v, d) \
+	{ .syntax = s, .view_mask = v, .do_flag = d, .manual = 0 }
+
+/* Define a syntax with manual as add_cmd_easily() */
+#define DEF_SYNTAX_EASILY(s, v, d) \
+	{ .syntax = s, .view_mask = v, .do_flag = d, .manual = 1 }
+
 /* Definition of arg type of name/value pair */
 typedef struct cmd_arg {
 	char	*name;		/* arg name */
@@ -219,6 +276,15 @@ typedef struct cmd_arg {
 	      i < MAX_ARG_NUM && (name = cmd_arg[i].name) && \
 		(value = cmd_arg[i].value); i++)
 
+/* Lex verdict of one arg memorized during a parse */
+#define	MAX_LEX_MEMO	32
+
+typedef struct lex_memo {
+	short	argi;		/* index of arg */
+	short	lex_type;	/* lex type checked */
+	int	res;		/* verdict of lex fun */
+} lex_memo_t;
+
 /* Command parsing result status set by check_cmd_syntax() */
 typedef struct cmd_stat {
 	int	do_flag;	/* do or undo flag */
@@ -232,8 +298,28 @@ typedef struct cmd_stat {
 	int	err_offset;	/* char offset of err_arg */
 	struct cmd_tree *cmd_tree;	/* matching cmd_tree */
 	cmd_arg_t *cmd_arg;		/* set cmd_arg */
+	char	**args;			/* parsed args */
+	int	arg_num;		/* number of args */
+	int	memo_num;		/* number of lex_memo */
+	lex_memo_t lex_memo[MAX_LEX_MEMO];
+	int	opt_num;		/* number of opt_used */
+	node_t	*opt_used[MAX_ARG_NUM];	/* options used by this parse */
+	int	rcu_slot;		/* 1 + reader slot held, 0 if none */
 } cmd_stat_t;
 
+/* arena of registration memory, see arena_alloc() */
+#define	ARENA_ALIGN	16	/* alignment of arena allocations */
+#define	ARENA_BLK_SIZE	8192	/* default size of arena block */
+
+struct arena_blk;
+struct arena_str;
+
+struct arena {
+	struct arena_blk *blk;	/* current block, linked to older ones */
+	size_t	used;		/* bytes carved from all blocks */
+	struct arena_str *strs;	/* interned strings held, see arena_intern() */
+};
+
 /* Definition of command exec function type */
 typedef int (*cmd_fun_t)(cmd_arg_t *, int);
 
@@ -245,6 +331,10 @@ struct cmd_tree {
 	struct list_head symbol_list;	/* list head of symbols */
 	struct list_head manual_list;	/* list head of manuals */
 	struct list_head cmd_tree_list;	/* link to list of command tree */
+	struct arena arena;		/* nodes and symbols until frozen */
+	int	lazy;			/* syntaxes recorded, tree not built */
+	struct list_head syntax_list;	/* recorded syntaxes if lazy */
+	u_int	retired;		/* epoch unlinked in */
 };
 	
 /* declare module static debug_flag to call this */
@@ -254,9 +344,10 @@ struct cmd_tree {
 /*
  * symbol utils functions
  */
-extern int set_symbol_node(symbol_t *symbol);
+extern int set_symbol_node(symbol_t *symbol, struct arena *arena);
 extern int prepare_symbols(struct list_head *sym_list,
-			   symbol_t *sym_table, int limit);
+			   symbol_t *sym_table, int limit,
+			   struct arena *arena);
 extern void cleanup_symbols(struct list_head *sym_list);
 extern symbol_t *get_symbol_by_name(struct list_head *sym_list, char *name);
 extern node_t *get_node_by_name(struct list_head *sym_list, char *name);
@@ -270,6 +361,17 @@ extern int get_argv(char *str, char ***argvp, int *offsets);
 extern void debug_argv(char **argv);
 extern void free_argv(char **argv);
 
+/*
+ * arena and string pool utils functions
+ */
+extern void *arena_alloc(struct arena *arena, size_t size);
+extern char *arena_strdup(struct arena *arena, const char *str);
+extern void arena_free(struct arena *arena);
+extern const char *arena_intern(struct arena *arena, const char *str,
+				int size);
+extern const char *intern_str(const char *str, int size);
+extern void free_intern_strs(void);
+
 /*
  * 'more' utils functions
  */
@@ -295,6 +397,10 @@ extern int display_file_more(char *path);
 #define SYM_TABLE(syms) &syms[0], SYM_NUM(syms)
 #define SYM_ROW(sym) &sym, 1
 
+/* Macros to simplify add_cmd_syntaxes() calls with an array of syntax_t */
+#define SYN_NUM(syns) (sizeof(syns)/sizeof(syntax_t))
+#define SYN_TABLE(syns) &syns[0], SYN_NUM(syns)
+
 /* Macros to simplify dynamic command creation and symbol registration
  * without a predefined symbol table.
  *
@@ -363,6 +469,10 @@ do {							\
  */
 extern struct cmd_tree *create_cmd_tree(char *cmd, symbol_t *sym_table, int sym_num,
 					cmd_fun_t fun);
+extern struct cmd_tree *prepare_cmd_tree(char *cmd, symbol_t *sym_table,
+					 int sym_num, cmd_fun_t fun);
+extern int replace_cmd_tree(struct cmd_tree *cmd_tree);
+extern int delete_cmd_tree(struct cmd_tree *cmd_tree);
 extern struct cmd_tree *get_cmd_tree(char *cmd);
 extern int get_cmd_trees(char *cmd, int view, int do_flag,
 			 struct cmd_tree **cmd_tree);
@@ -374,6 +484,8 @@ extern int add_cmd_syntax(struct cmd_tree *cmd_tree, char *syntax,
 			  int view_mask, int do_flag);
 extern int add_cmd_easily(struct cmd_tree *cmd_tree, char *syntax,
 			  int view_mask, int do_flag);
+extern int add_cmd_syntaxes(struct cmd_tree *cmd_tree, syntax_t *syn_table,
+			    int syn_num, char *err_buf, int limit);
 extern int sprout_cmd_syntax(struct cmd_tree *cmd_tree, char *syntax,
 			     int view_mask, int do_flag);
 extern int check_cmd_syntax(char *cmd_str, int view, cmd_stat_t *cmd_stat);
@@ -386,6 +498,17 @@ extern int get_node_help(node_t *node, char *cmd, char *buf, int limit,
 			 int view, int do_flag);
 extern int get_node_next_help(node_t *node, char *cmd, char *buf, int limit,
 			      int view, int do_flag);
+extern int get_node_matches_stat(node_t *node, char *cmd, char **matches,
+				 int limit, int view, int do_flag,
+				 cmd_stat_t *cmd_stat);
+extern int get_node_next_matches_stat(node_t *node, char *cmd,
+				      char **matches, int limit, int view,
+				      int do_flag, cmd_stat_t *cmd_stat);
+extern int get_node_help_stat(node_t *node, char *cmd, char *buf, int limit,
+			      int view, int do_flag, cmd_stat_t *cmd_stat);
+extern int get_node_next_help_stat(node_t *node, char *cmd, char *buf,
+				   int limit, int view, int do_flag,
+				   cmd_stat_t *cmd_stat);
 extern int compare_node(node_t *node1, node_t *node2);
 
 extern void debug_cmd_tree(char *cmd);
@@ -403,6 +526,12 @@ extern void cleanup_cmd_stat(struct cmd_stat *cmd_stat);
 extern char *ocli_strerror(int err_code);
 extern void ocli_set_debug(int flag);
 
+extern void ocli_set_lazy(int enabled);
+extern int ocli_freeze(void);
+extern int ocli_is_frozen(void);
+extern int ocli_save_image(char *path, u_int64_t grammar_hash);
+extern int ocli_load_image(char *path, u_int64_t grammar_hash);
+
 extern int ocli_core_init(void);
 extern void ocli_core_exit(void);
 
@@ -22,12 +22,23 @@
  * ocli_core.c, the core syntax tree module of libocli
  */
 
+#ifndef _GNU_SOURCE
+#define	_GNU_SOURCE	/* writer preferring rwlock of command index */
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <string.h>
-#include <pcre.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -42,6 +53,116 @@ static int debug_flag = 0;
 static int olic_core_init_ok = 0;
 static struct list_head cmd_tree_list;
 
+/*
+ * once frozen, syntax trees of all commands are compacted into one image,
+ * and commands, symbols and syntaxes can no more be added.
+ */
+static int	ocli_frozen = 0;
+static char	*frozen_image = NULL;
+static size_t	frozen_size = 0;
+static node_t	*frozen_nodes = NULL;	/* nodes, then index entries */
+static size_t	frozen_node_num = 0;
+static size_t	frozen_ent_num = 0;
+
+/*
+ * once a syntax image is loaded, registration calls only bind command
+ * functions and arg helpers by name, until ocli_freeze() seals the image.
+ */
+static int	ocli_loaded = 0;
+
+/*
+ * FNV-1a hash of the arguments of registration calls until ocli_freeze(),
+ * saved with the syntax image, and compared by ocli_freeze() after the
+ * image is loaded, as the same calls are made again to bind functions.
+ */
+#define	REG_HASH_INIT	0xcbf29ce484222325ULL
+#define	REG_HASH_PRIME	0x100000001b3ULL
+
+static u_int64_t reg_hash = REG_HASH_INIT;
+static u_int64_t image_reg_hash = 0;	/* of the loaded image */
+
+/*
+ * with lazy building, syntaxes of a command are only recorded, and its
+ * tree is built when the command is first resolved
+ */
+static int	ocli_lazy = 0;
+
+#define	SYN_ADD		1	/* add_cmd_syntax() */
+#define	SYN_SPROUT	2	/* sprout_cmd_syntax() */
+#define	SYN_HELPER	3	/* set_cmd_arg_helper() */
+
+struct cmd_syntax {
+	int	op;			/* SYN_XXX */
+	char	*syntax;		/* syntax, or arg name of helper */
+	int	view_mask;
+	int	do_flag;
+	arg_helper_t helper;
+	struct list_head syntax_list;	/* link to syntaxes of cmd_tree */
+};
+
+/*
+ * symbols of a command sorted by name, to resolve the words of a batch
+ * of syntaxes without scanning symbol_list for each word
+ */
+struct sym_ent {
+	symbol_t *sym;
+	int	pos;			/* order in symbol_list */
+};
+
+struct sym_index {
+	int	num;
+	struct sym_ent *ents;		/* by name, then pos */
+};
+
+/*
+ * errors of add_cmd_syntaxes() are collected, and reported all at the
+ * end of the batch
+ */
+struct syn_report {
+	char	*buf;			/* error lines */
+	size_t	len;
+	size_t	size;
+	char	*cmd;			/* command of the syntax being added */
+	int	index;			/* index of the syntax in syn_table */
+};
+
+#define	OCLI_FROZEN()	__atomic_load_n(&ocli_frozen, __ATOMIC_ACQUIRE)
+
+/* root of a command found, swapped to the frozen copy by ocli_freeze() */
+#define	CMD_ROOT(ct)	__atomic_load_n(&(ct)->tree, __ATOMIC_ACQUIRE)
+
+/*
+ * cmd_lock guards the command index, cmd_trie and cmd_tree_list, and is
+ * only held while looking up. a tree unlinked by replace_cmd_tree() or
+ * delete_cmd_tree() is retired, and freed when no parse which may have
+ * found it is in flight. a parse counts itself in rcu_readers[] of the
+ * epoch it starts in, and a tree retired in epoch e is freed once the
+ * epoch has advanced to e + 2, each step waiting for the readers of the
+ * epoch before the current one to drain.
+ */
+static pthread_rwlock_t cmd_lock;
+static pthread_mutex_t rcu_lock = PTHREAD_MUTEX_INITIALIZER;
+static u_int	rcu_epoch = 0;
+static int	rcu_readers[2];
+static int	rcu_retired_num = 0;
+static LIST_HEAD(rcu_retired);		/* retired trees, by retired epoch */
+
+/*
+ * radix trie of command names, indexing the sorted cmd_tree_list.
+ * commands starting with a prefix are all the entries of a subtree,
+ * and they are in a row of the list from the first one of the subtree.
+ */
+struct cmd_trie {
+	char	*label;			/* edge from parent */
+	int	len;			/* length of label */
+	int	num;			/* commands in this subtree */
+	struct cmd_tree *ent;		/* command ending here */
+	int	child_num;
+	struct cmd_trie **child;	/* sorted by first char of label */
+};
+
+static struct cmd_trie cmd_trie;	/* root, empty label */
+
 static char *err_info[] = {
 	"No error",
 	"No match",
@@ -52,27 +173,362 @@ static char *err_info[] = {
 	NULL
 };
 
+struct arg_lex;
+
 /*
  * local tree functions
  */
-static void sprout_tree(node_t *tree, node_t **nodes, int num,
-			int view_mask, int do_flag);
-static int plant_root(node_t **root, node_t *node);
-static int grow_leaf(node_t *base, int view_mask, int do_flag);
-static int grow_tree(node_t *tree, node_t **nodes, int num,
-			int view_mask, int do_flag);
-static node_t *grow_node(node_t *base, node_t *node,
-			int view_mask, int do_flag);
+static void sprout_tree(struct arena *arena, node_t *tree, node_t **nodes,
+			int num, int view_mask, int do_flag,
+			struct syn_report *rp);
+static int plant_root(struct arena *arena, node_t **root, node_t *node);
+static int grow_leaf(struct arena *arena, node_t *base,
+			int view_mask, int do_flag, struct syn_report *rp);
+static int grow_tree(struct arena *arena, node_t *tree, node_t **nodes,
+			int num, int view_mask, int do_flag,
+			struct syn_report *rp);
+static node_t *grow_node(struct arena *arena, node_t *base, node_t *node,
+			int view_mask, int do_flag, struct syn_report *rp);
 static int get_next_node(node_t *node, node_t **next, char *arg,
-			int view, int do_flag);
+			int view, int do_flag, cmd_stat_t *cmd_stat, int argi);
+static int node_matches(node_t *node, char *cmd, char **matches, int limit,
+			int view, int do_flag, struct arg_lex *al);
+static int node_help(node_t *node, char *cmd, char *buf, int limit,
+			int view, int do_flag, struct arg_lex *al);
 static int node_has_leaf(node_t *node, int view, int do_flag);
+static int key_lower(node_t *node, const char *key);
+static node_t *get_child_key(node_t *node, const char *key);
+static int index_child(struct arena *arena, node_t *base, node_t *np);
 static int node_has_only_leaf(node_t *node, int view, int do_flag);
 
+static int grow_syntax(struct cmd_tree *cmd_tree, struct sym_index *si,
+			char *syntax, int view_mask, int do_flag,
+			struct syn_report *rp);
+static int grow_args(struct cmd_tree *cmd_tree, struct sym_index *si,
+			char **args, int arg_num, int view_mask, int do_flag,
+			struct syn_report *rp);
+static int sprout_syntax(struct cmd_tree *cmd_tree, struct sym_index *si,
+			char *syntax, int view_mask, int do_flag);
+static int resolve_words(struct cmd_tree *cmd_tree, struct sym_index *si,
+			char **args, int arg_num, node_t **nodes, char *caller,
+			struct syn_report *rp);
+static int index_symbols(struct sym_index *si, struct cmd_tree *cmd_tree);
+static void easy_manual(char *syntax, int do_flag, char *manual);
+static void syntax_error(struct syn_report *rp, const char *fmt, ...);
+static void hash_reg(const void *data, size_t len);
+static void hash_reg_str(const char *str);
+static void hash_reg_int(int64_t val);
+static void hash_reg_symbols(symbol_t *sym, int num);
+static int add_syntax(struct cmd_tree *cmd_tree, char *syntax,
+		      int view_mask, int do_flag);
+static int add_manual(struct cmd_tree *cmd_tree, char *text, int view_mask);
+static int record_syntax(struct cmd_tree *cmd_tree, int op, char *syntax,
+			int view_mask, int do_flag, arg_helper_t helper);
+static void build_cmd_tree(struct cmd_tree *cmd_tree);
+static void set_arg_helper(node_t *tree, char *arg_name, arg_helper_t helper);
+
+static struct cmd_tree *first_cmd_tree(char *prefix, int *num);
+static struct cmd_tree *find_cmd_tree(char *cmd);
+static struct cmd_tree *next_cmd_tree(struct cmd_tree *ent);
+static int match_cmd_trees(char *cmd, int view, int do_flag,
+			   struct cmd_tree **first);
+
 static void debug_tree(node_t *tree, node_t **path, int len);
-static void free_tree(node_t *tree);
+static void count_tree(node_t *tree, size_t *nodes, size_t *ents);
+static node_t *copy_tree(node_t *tree, node_t *parent, node_t **node_pos);
+static void relink_tree(node_t *tree, node_t ***ent_pos);
+static void drop_cmd_trees(void);
+static void drop_image(void);
+static int image_tree_ok(node_t *nodes, u_int64_t num);
 static void free_cmd_tree(struct cmd_tree *cmd_tree);
+static struct cmd_tree *new_cmd_tree(char *cmd, symbol_t *sym_table,
+			int sym_num, cmd_fun_t fun, char *caller);
+
+static int rcu_enter(void);
+static void rcu_leave(int slot);
+static void rcu_retire(struct cmd_tree *cmd_tree);
+static void rcu_reclaim(void);
+
+static int set_cmd_arg(node_t *node, char *str, cmd_arg_t *cmd_arg,
+			cmd_stat_t *cmd_stat, int argi);
+
+/*
+ * position of child starting with c, or where to insert it
+ */
+static int
+trie_child_pos(struct cmd_trie *t, u_char c, int *found)
+{
+	int	lo = 0, hi = t->child_num, mid;
+	u_char	m;
+
+	*found = 0;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		m = (u_char) t->child[mid]->label[0];
+		if (m == c) {
+			*found = 1;
+			return mid;
+		} else if (m < c) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+static struct cmd_trie *
+trie_new_node(char *label, int len)
+{
+	struct cmd_trie *t;
+
+	if ((t = calloc(1, sizeof(struct cmd_trie))) == NULL)
+		return NULL;
+	if ((t->label = strndup(label, len)) == NULL) {
+		free(t);
+		return NULL;
+	}
+	t->len = len;
+	return t;
+}
+
+static int
+trie_add_child(struct cmd_trie *t, int pos, struct cmd_trie *child)
+{
+	struct cmd_trie **ch;
+
+	ch = realloc(t->child, sizeof(struct cmd_trie *) * (t->child_num + 1));
+	if (ch == NULL) return -1;
+
+	memmove(&ch[pos + 1], &ch[pos],
+		sizeof(struct cmd_trie *) * (t->child_num - pos));
+	ch[pos] = child;
+	t->child = ch;
+	t->child_num++;
+	return 0;
+}
+
+/*
+ * first command of a subtree, a name ending at a node is less than all
+ * the names below it
+ */
+static struct cmd_tree *
+trie_first(struct cmd_trie *t)
+{
+	if (t->num == 0) return NULL;
+	while (t->ent == NULL)
+		t = t->child[0];
+	return t->ent;
+}
+
+/*
+ * find the subtree of all commands starting with prefix, set back
+ * exact to 1 if prefix ends right at the node returned
+ */
+static struct cmd_trie *
+trie_find(char *prefix, int *exact)
+{
+	struct cmd_trie *t = &cmd_trie, *ch;
+	char	*p = prefix;
+	int	i, n, found;
+
+	*exact = 1;
+	while (*p) {
+		i = trie_child_pos(t, (u_char) *p, &found);
+		if (!found) return NULL;
+		ch = t->child[i];
+
+		for (n = 1; n < ch->len && p[n] && p[n] == ch->label[n]; n++);
+		if (p[n] == '\0') {
+			*exact = (n == ch->len);
+			return ch;
+		}
+		if (n < ch->len) return NULL;
+
+		p += n;
+		t = ch;
+	}
+	return t;
+}
+
+/*
+ * index a new command tree, and link it into cmd_tree_list before its
+ * successor, which is the first command of the nearest subtree on the
+ * right of the path. the name must not be indexed yet.
+ */
+static int
+trie_insert(struct cmd_tree *cmd_tree)
+{
+	struct cmd_trie *t = &cmd_trie, *ch, *mid, *leaf;
+	struct cmd_tree *succ = NULL;
+	char	*p = cmd_tree->cmd;
+	int	i, n, found;
+
+	while (*p) {
+		i = trie_child_pos(t, (u_char) *p, &found);
+		if (!found) {
+			/* new leaf between siblings */
+			if ((leaf = trie_new_node(p, strlen(p))) == NULL)
+				return -1;
+			if (trie_add_child(t, i, leaf) < 0) {
+				free(leaf->label);
+				free(leaf);
+				return -1;
+			}
+			if (i + 1 < t->child_num)
+				succ = trie_first(t->child[i + 1]);
+			t = leaf;
+			break;
+		}
+
+		ch = t->child[i];
+		if (i + 1 < t->child_num)
+			succ = trie_first(t->child[i + 1]);
+
+		for (n = 1; n < ch->len && p[n] == ch->label[n]; n++);
+		if (n == ch->len) {
+			p += n;
+			t = ch;
+			continue;
+		}
+
+		/* split the label of ch at n */
+		if ((mid = trie_new_node(ch->label, n)) == NULL ||
+		    trie_add_child(mid, 0, ch) < 0) {
+			if (mid) {
+				free(mid->label);
+				free(mid);
+			}
+			return -1;
+		}
+		memmove(ch->label, ch->label + n, ch->len - n + 1);
+		ch->len -= n;
+		mid->num = ch->num;
+		t->child[i] = mid;
+
+		if (p[n] == '\0') {
+			succ = trie_first(ch);
+		} else {
+			if ((leaf = trie_new_node(p + n, strlen(p + n))) == NULL)
+				return -1;
+			found = ((u_char) p[n] > (u_char) ch->label[0]);
+			if (trie_add_child(mid, found, leaf) < 0) {
+				free(leaf->label);
+				free(leaf);
+				return -1;
+			}
+			if (!found) succ = trie_first(ch);
+		}
+		t = (p[n] == '\0') ? mid : leaf;
+		break;
+	}
+
+	if (*p == '\0' && t->child_num > 0)
+		succ = trie_first(t->child[0]);
+
+	t->ent = cmd_tree;
+
+	/* count it on the path */
+	t = &cmd_trie;
+	t->num++;
+	for (p = cmd_tree->cmd; *p; p += t->len) {
+		t = t->child[trie_child_pos(t, (u_char) *p, &found)];
+		t->num++;
+	}
+
+	if (succ)
+		list_add_tail(&cmd_tree->cmd_tree_list, &succ->cmd_tree_list);
+	else
+		list_add_tail(&cmd_tree->cmd_tree_list, &cmd_tree_list);
+	return 0;
+}
+
+static void
+trie_free(struct cmd_trie *t)
+{
+	int	i;
+
+	for (i = 0; i < t->child_num; i++) {
+		trie_free(t->child[i]);
+		free(t->child[i]->label);
+		free(t->child[i]);
+	}
+	free(t->child);
+	t->child = NULL;
+	t->child_num = 0;
+}
+
+/*
+ * unindex a command tree, dropping the branches left with no command,
+ * and unlink it from cmd_tree_list. the name must be indexed.
+ */
+static void
+trie_remove(struct cmd_tree *cmd_tree)
+{
+	struct cmd_trie *t = &cmd_trie, *ch;
+	char	*p = cmd_tree->cmd;
+	int	i, found;
+
+	t->num--;
+	while (*p) {
+		i = trie_child_pos(t, (u_char) *p, &found);
+		ch = t->child[i];
+		if (--ch->num == 0) {
+			t->child_num--;
+			memmove(&t->child[i], &t->child[i + 1],
+				(t->child_num - i) * sizeof(struct cmd_trie *));
+			trie_free(ch);
+			free(ch->label);
+			free(ch);
+			break;
+		}
+		p += ch->len;
+		t = ch;
+	}
+	if (*p == '\0')
+		t->ent = NULL;
+
+	list_del(&cmd_tree->cmd_tree_list);
+}
+
+/*
+ * first command tree whose name starts with prefix, and number of them
+ * in a row from there. NULL if none.
+ */
+static struct cmd_tree *
+first_cmd_tree(char *prefix, int *num)
+{
+	struct cmd_trie *t;
+	int	exact;
+
+	*num = 0;
+	if ((t = trie_find(prefix ? prefix : "", &exact)) == NULL)
+		return NULL;
+
+	*num = t->num;
+	return trie_first(t);
+}
+
+static struct cmd_tree *
+next_cmd_tree(struct cmd_tree *ent)
+{
+	return list_entry(ent->cmd_tree_list.next, struct cmd_tree,
+			  cmd_tree_list);
+}
 
-static int set_cmd_arg(node_t *node, char *str, cmd_arg_t *cmd_arg);
+/*
+ * command tree by exactly matched name, with cmd_lock held
+ */
+static struct cmd_tree *
+find_cmd_tree(char *cmd)
+{
+	struct cmd_trie *t;
+	int	exact;
+
+	if ((t = trie_find(cmd, &exact)) == NULL || !exact)
+		return NULL;
+	return t->ent;
+}
 
 /*
  * create a cmd_tree
@@ -80,23 +536,89 @@ static int set_cmd_arg(node_t *node, char *str, cmd_arg_t *cmd_arg);
 struct cmd_tree *
 create_cmd_tree(char *cmd, symbol_t *sym_table, int sym_num, cmd_fun_t fun)
 {
-	int	res;
-	node_t	*node;
 	struct cmd_tree *cmd_tree, *ent;
-	struct list_head *prev = NULL;
+
+	if (OCLI_FROZEN()) {
+		fprintf(stderr, "create_cmd_tree: syntax trees are frozen\n");
+		return NULL;
+	}
+	hash_reg_str("create_cmd_tree");
+	hash_reg_str(cmd);
+	hash_reg_symbols(sym_table, sym_num);
+
+	/* loaded from image, just bind the exec function */
+	if (ocli_loaded) {
+		if ((ent = get_cmd_tree(cmd)) == NULL) {
+			fprintf(stderr, "create_cmd_tree: "
+				"'%s' not in syntax image\n", cmd);
+			return NULL;
+		}
+		ent->fun = fun;
+		return ent;
+	}
+
+	cmd_tree = new_cmd_tree(cmd, sym_table, sym_num, fun,
+				"create_cmd_tree");
+	if (cmd_tree == NULL)
+		return NULL;
+
+	pthread_rwlock_wrlock(&cmd_lock);
+	if ((ent = find_cmd_tree(cmd_tree->cmd)) != NULL) {
+		pthread_rwlock_unlock(&cmd_lock);
+		fprintf(stderr, "create_cmd_tree: '%s' exists\n", cmd);
+		free_cmd_tree(cmd_tree);
+		return ent;
+	}
+
+	if (trie_insert(cmd_tree) < 0) {
+		pthread_rwlock_unlock(&cmd_lock);
+		fprintf(stderr, "create_cmd_tree: no memory\n");
+		free_cmd_tree(cmd_tree);
+		return NULL;
+	}
+	dprintf(DBG_LIST, "insert %s, %d commands\n", cmd, cmd_trie.num);
+	pthread_rwlock_unlock(&cmd_lock);
+
+	return (cmd_tree);
+}
+
+/*
+ * create a cmd_tree not indexed yet, to be published by replace_cmd_tree()
+ * after its syntaxes are added
+ */
+struct cmd_tree *
+prepare_cmd_tree(char *cmd, symbol_t *sym_table, int sym_num, cmd_fun_t fun)
+{
+	if (OCLI_FROZEN() || ocli_loaded) {
+		fprintf(stderr, "prepare_cmd_tree: syntax trees are %s\n",
+			ocli_loaded ? "loaded" : "frozen");
+		return NULL;
+	}
+	return new_cmd_tree(cmd, sym_table, sym_num, fun, "prepare_cmd_tree");
+}
+
+/*
+ * allocate a cmd_tree and plant its root
+ */
+static struct cmd_tree *
+new_cmd_tree(char *cmd, symbol_t *sym_table, int sym_num, cmd_fun_t fun,
+	     char *caller)
+{
+	node_t	*node;
+	struct cmd_tree *cmd_tree;
 
 	if (!cmd || !cmd[0] || strlen(cmd) >= MAX_WORD_LEN) {
-		fprintf(stderr, "create_cmd_tree: command empty or too long\n");
+		fprintf(stderr, "%s: command empty or too long\n", caller);
 		return NULL;
 	}
 
 	if (!sym_table || sym_num <= 0) {
-		fprintf(stderr, "create_cmd_tree: bad sym_table parm\n");
+		fprintf(stderr, "%s: bad sym_table parm\n", caller);
 		return NULL;
 	}
 
 	if ((cmd_tree = malloc(sizeof(struct cmd_tree))) == NULL) {
-		fprintf(stderr, "create_cmd_tree: no memory\n");
+		fprintf(stderr, "%s: no memory\n", caller);
 		return NULL;
 	}
 
@@ -105,21 +627,26 @@ create_cmd_tree(char *cmd, symbol_t *sym_table, int sym_num, cmd_fun_t fun)
 
 	INIT_LIST_HEAD(&cmd_tree->manual_list);
 	INIT_LIST_HEAD(&cmd_tree->symbol_list);
+	INIT_LIST_HEAD(&cmd_tree->syntax_list);
+	INIT_LIST_HEAD(&cmd_tree->cmd_tree_list);
+	cmd_tree->lazy = ocli_lazy;
 
-	if (prepare_symbols(&cmd_tree->symbol_list, sym_table, sym_num) < 0) {
-		fprintf(stderr, "create_cmd_tree: failed to process symbols\n");
+	if (prepare_symbols(&cmd_tree->symbol_list, sym_table, sym_num,
+			    &cmd_tree->arena) < 0) {
+		fprintf(stderr, "%s: failed to process symbols\n", caller);
 		free_cmd_tree(cmd_tree);
 		return NULL;
 	}
 
 	if ((node = get_node_by_name(&cmd_tree->symbol_list, cmd)) == NULL) {
-		fprintf(stderr, "create_cmd_tree: no symbol found for \'%s\'\n", cmd);
+		fprintf(stderr, "%s: no symbol found for \'%s\'\n",
+			caller, cmd);
 		free_cmd_tree(cmd_tree);
 		return NULL;
 	}
 
-	if (plant_root(&cmd_tree->tree, node) != 0) {
-		fprintf(stderr, "create_cmd_tree: set root error\n");
+	if (plant_root(&cmd_tree->arena, &cmd_tree->tree, node) != 0) {
+		fprintf(stderr, "%s: set root error\n", caller);
 		free_cmd_tree(cmd_tree);
 		return NULL;
 	}
@@ -134,64 +661,142 @@ create_cmd_tree(char *cmd, symbol_t *sym_table, int sym_num, cmd_fun_t fun)
 		cmd_tree->tree->undo_view_mask = UNDO_VIEW_MASK;
 	}
 
-	if (list_empty(&cmd_tree_list)) {
-		list_add(&cmd_tree->cmd_tree_list, &cmd_tree_list);
-	} else {
-		list_for_each_entry(ent, &cmd_tree_list, cmd_tree_list) {
-			res = strcmp(cmd, ent->cmd);
-			if (res < 0) {
-				dprintf(DBG_LIST, "insert %s before %s\n",
-					cmd, ent->cmd);
-				prev = ent->cmd_tree_list.prev;
-				list_add(&cmd_tree->cmd_tree_list, prev);
-				break;
-			} else if (res == 0) {
-				fprintf(stderr, "create_cmd_tree: '%s' exists\n",
-					cmd);
-				free_cmd_tree(cmd_tree);
-				return ent;
-			}
-		}
-		if (prev == NULL) {
-			dprintf(DBG_LIST, "insert %s after tail\n", cmd);
-			list_add_tail(&cmd_tree->cmd_tree_list, &cmd_tree_list);
-		}
+	return (cmd_tree);
+}
+
+/*
+ * publish a prepared cmd_tree in place of the one of the same name if
+ * any. parses already holding the old tree go on with it, and it is
+ * freed after they are all cleaned up.
+ */
+int
+replace_cmd_tree(struct cmd_tree *cmd_tree)
+{
+	struct cmd_trie *t;
+	struct cmd_tree *old = NULL;
+	int	exact;
+
+	if (!cmd_tree) return -1;
+
+	if (OCLI_FROZEN()) {
+		fprintf(stderr, "replace_cmd_tree: syntax trees are frozen\n");
+		return -1;
 	}
 
-	return (cmd_tree);
+	/* readers must not build a published tree */
+	build_cmd_tree(cmd_tree);
+
+	pthread_rwlock_wrlock(&cmd_lock);
+	if (!list_empty(&cmd_tree->cmd_tree_list)) {
+		pthread_rwlock_unlock(&cmd_lock);
+		fprintf(stderr, "replace_cmd_tree: '%s' is published\n",
+			cmd_tree->cmd);
+		return -1;
+	}
+
+	if ((t = trie_find(cmd_tree->cmd, &exact)) != NULL && exact &&
+	    t->ent != NULL) {
+		old = t->ent;
+		t->ent = cmd_tree;
+		list_add(&cmd_tree->cmd_tree_list, &old->cmd_tree_list);
+		list_del(&old->cmd_tree_list);
+	} else if (trie_insert(cmd_tree) < 0) {
+		pthread_rwlock_unlock(&cmd_lock);
+		fprintf(stderr, "replace_cmd_tree: no memory\n");
+		return -1;
+	}
+	dprintf(DBG_LIST, "%s %s, %d commands\n", old ? "replace" : "insert",
+		cmd_tree->cmd, cmd_trie.num);
+	pthread_rwlock_unlock(&cmd_lock);
+
+	if (old) rcu_retire(old);
+	return 0;
+}
+
+/*
+ * unpublish a cmd_tree, it is freed after all the parses that may hold
+ * it are cleaned up. a prepared tree never published is freed at once.
+ */
+int
+delete_cmd_tree(struct cmd_tree *cmd_tree)
+{
+	if (!cmd_tree) return -1;
+
+	pthread_rwlock_wrlock(&cmd_lock);
+	if (find_cmd_tree(cmd_tree->cmd) == cmd_tree) {
+		trie_remove(cmd_tree);
+		dprintf(DBG_LIST, "delete %s, %d commands\n",
+			cmd_tree->cmd, cmd_trie.num);
+		pthread_rwlock_unlock(&cmd_lock);
+		rcu_retire(cmd_tree);
+		return 0;
+	}
+	pthread_rwlock_unlock(&cmd_lock);
+
+	if (!list_empty(&cmd_tree->cmd_tree_list)) {
+		fprintf(stderr, "delete_cmd_tree: '%s' is retired\n",
+			cmd_tree->cmd);
+		return -1;
+	}
+	free_cmd_tree(cmd_tree);
+	return 0;
 }
 
 /*
- * get matching command trees.
+ * get matching command trees. a lazy tree matched alone is built with
+ * the write lock held, and published by clearing its lazy flag.
  * return number of match entries, and set the first match_tree.
  */
 int
 get_cmd_trees(char *cmd, int view, int do_flag, struct cmd_tree **cmd_tree)
 {
-	struct cmd_tree *ent, *first = NULL;
-	int	n_match = 0;
+	struct cmd_tree *first = NULL;
+	int	n_match;
 
 	if (!cmd || !cmd[0]) return 0;
 
-	list_for_each_entry(ent, &cmd_tree_list, cmd_tree_list) {
+	pthread_rwlock_rdlock(&cmd_lock);
+	n_match = match_cmd_trees(cmd, view, do_flag, &first);
+	if (n_match == 1 && __atomic_load_n(&first->lazy, __ATOMIC_ACQUIRE)) {
+		pthread_rwlock_unlock(&cmd_lock);
+		pthread_rwlock_wrlock(&cmd_lock);
+		/* the index may change while no lock is held */
+		first = NULL;
+		n_match = match_cmd_trees(cmd, view, do_flag, &first);
+		if (n_match == 1) build_cmd_tree(first);
+	}
+	if (first != NULL) *cmd_tree = first;
+	pthread_rwlock_unlock(&cmd_lock);
+	return n_match;
+}
+
+/*
+ * count commands matching cmd, and set the first one, with cmd_lock held
+ */
+static int
+match_cmd_trees(char *cmd, int view, int do_flag, struct cmd_tree **first)
+{
+	struct cmd_tree *ent;
+	int	n_match = 0, num;
+
+	for (ent = first_cmd_tree(cmd, &num); num > 0;
+	     ent = next_cmd_tree(ent), num--) {
 		/* skip UNDO_CMD if UNDO_FLAG is set */
 		if (do_flag == UNDO_FLAG && strcmp(ent->cmd, UNDO_CMD) == 0)
 			continue;
-		if (strncmp(cmd, ent->cmd, strlen(cmd)) == 0 &&
-		    ent->tree != NULL &&
+		if (ent->tree != NULL &&
 		    NODE_IS_ALLOWED(ent->tree, view, do_flag)) {
 			/* match exactly, quit loop */
 			if (strcmp(cmd, ent->cmd) == 0) {
-				first = ent;
+				*first = ent;
 				n_match = 1;
 				break;
 			}
-			if (first == NULL)
-				first = ent;
+			if (*first == NULL)
+				*first = ent;
 			n_match++;
 		}
 	}
-	if (first != NULL) *cmd_tree = first;
 	return n_match;
 }
 
@@ -205,12 +810,10 @@ get_cmd_tree(char *cmd)
 
 	if (!cmd || !cmd[0]) return NULL;
 
-	list_for_each_entry(ent, &cmd_tree_list, cmd_tree_list) {
-		if (strcmp(cmd, ent->cmd) == 0) {
-			return ent;
-		}
-	}
-	return NULL;
+	pthread_rwlock_rdlock(&cmd_lock);
+	ent = find_cmd_tree(cmd);
+	pthread_rwlock_unlock(&cmd_lock);
+	return ent;
 }
 
 /*
@@ -219,9 +822,25 @@ get_cmd_tree(char *cmd)
 int
 add_cmd_manual(struct cmd_tree *cmd_tree, char *text, int view_mask)
 {
-	struct manual *manual;
-
 	if (cmd_tree == NULL) return -1;
+	if (!OCLI_FROZEN()) {
+		hash_reg_str("add_cmd_manual");
+		hash_reg_str(cmd_tree->cmd);
+		hash_reg_str(text);
+		hash_reg_int(view_mask);
+	}
+	/* manuals come with the syntax image */
+	if (ocli_loaded) return 0;
+	return add_manual(cmd_tree, text, view_mask);
+}
+
+/*
+ * append a manual to command tree
+ */
+static int
+add_manual(struct cmd_tree *cmd_tree, char *text, int view_mask)
+{
+	struct manual *manual;
 
 	if ((manual = malloc(sizeof(struct manual))) == NULL) {
 		fprintf(stderr, "add_cmd_manual: no memory\n");
@@ -244,17 +863,16 @@ get_cmd_manual(struct cmd_tree *cmd_tree, int view, char *buf, int limit)
 {
 	struct manual *man = NULL;
 	char	*ptr = buf;
+	node_t	*root;
 	int	len = 0;
 
-	if (cmd_tree == NULL ||
-	    (!(cmd_tree->tree->do_view_mask & view) &&
-	     !(cmd_tree->tree->undo_view_mask & view)))
+	if (cmd_tree == NULL || (root = CMD_ROOT(cmd_tree)) == NULL ||
+	    (!(root->do_view_mask & view) && !(root->undo_view_mask & view)))
 		return 0;
 
 	if (limit > 80) {
 		len = snprintf(ptr, limit, "NAME\n\t%s - %s\nSYNOPSIS\n",
-			       cmd_tree->cmd,
-			       cmd_tree->tree->help);
+			       cmd_tree->cmd, root->help);
 		ptr += len;
 		limit -= len;
 	}
@@ -290,11 +908,21 @@ add_cmd_symbol(struct cmd_tree *cmd_tree, symbol_t *sym)
 {
 	if (!cmd_tree || !sym) return -1;
 
+	if (OCLI_FROZEN()) {
+		fprintf(stderr, "add_cmd_symbol: syntax trees are frozen\n");
+		return -1;
+	}
+	hash_reg_str("add_cmd_symbol");
+	hash_reg_str(cmd_tree->cmd);
+	hash_reg_symbols(sym, 1);
+	if (ocli_loaded) return 0;
+
 	if ((strlen(sym->name) == 1 && strchr("[]{}", sym->name[0])) ||
 	    get_node_by_name(&cmd_tree->symbol_list, sym->name))
 		return -1;
 
-	return prepare_symbols(&cmd_tree->symbol_list, sym, 1);
+	return prepare_symbols(&cmd_tree->symbol_list, sym, 1,
+			       &cmd_tree->arena);
 }
 
 /*
@@ -323,51 +951,283 @@ int
 add_cmd_syntax(struct cmd_tree *cmd_tree, char *syntax,
 	       int view_mask, int do_flag)
 {
-	int	i, arg_num;
-	char	**args = NULL;
-	node_t	*nodes[MAX_ARG_NUM + 1];
-	int	is_spec = 0, in_alt = 0;
-
 	if (!cmd_tree || !syntax || !syntax[0] || !do_flag) {
 		fprintf(stderr, "add_cmd_syntax: bad parm\n");
 		return -1;
 	}
-	if ((arg_num = get_argv(syntax, &args, NULL)) <= 0) {
-		fprintf(stderr, "add_cmd_syntax: zero args\n");
-		return -1;
-	}
-
-	if (strcmp(cmd_tree->cmd, args[0]) != 0) {
-		fprintf(stderr, "add_cmd_syntax: "
-			"expect word[1] \'%s\' but get \'%s\'\n",
-			cmd_tree->cmd, args[0]);
-		free_argv(args);
+	if (OCLI_FROZEN()) {
+		fprintf(stderr, "add_cmd_syntax: syntax trees are frozen\n");
 		return -1;
 	}
+	hash_reg_str("add_cmd_syntax");
+	hash_reg_str(cmd_tree->cmd);
+	hash_reg_str(syntax);
+	hash_reg_int(view_mask);
+	hash_reg_int(do_flag);
+	/* syntaxes come with the syntax image */
+	if (ocli_loaded) return 0;
+	return add_syntax(cmd_tree, syntax, view_mask, do_flag);
+}
 
-	bzero(&nodes[0], sizeof(nodes));
+/*
+ * grow a syntax into command tree, or record it if the tree is lazy
+ */
+static int
+add_syntax(struct cmd_tree *cmd_tree, char *syntax, int view_mask,
+	   int do_flag)
+{
+	char	*p;
+	int	len;
+
+	if (!cmd_tree->lazy)
+		return grow_syntax(cmd_tree, NULL, syntax, view_mask, do_flag,
+				   NULL);
+
+	/* only check the command word until built */
+	for (p = syntax; isspace(*p); p++);
+	len = strlen(cmd_tree->cmd);
+	if (strncmp(p, cmd_tree->cmd, len) != 0 ||
+	    (p[len] && !isspace(p[len]))) {
+		fprintf(stderr, "add_cmd_syntax: "
+			"expect word[1] \'%s\' in \'%s\'\n",
+			cmd_tree->cmd, syntax);
+		return -1;
+	}
+
+	/* the root is ORed as by grow_tree(), for matching commands */
+	if ((do_flag & DO_FLAG))
+		cmd_tree->tree->do_view_mask |= view_mask;
+	if ((do_flag & UNDO_FLAG))
+		cmd_tree->tree->undo_view_mask |= view_mask;
+
+	return record_syntax(cmd_tree, SYN_ADD, syntax, view_mask, do_flag,
+			     NULL);
+}
+
+/*
+ * report an error of adding syntax, into rp of add_cmd_syntaxes(), or
+ * to stderr if rp is NULL
+ */
+static void
+syntax_error(struct syn_report *rp, const char *fmt, ...)
+{
+	char	msg[MAX_LINE_LEN], *p;
+	size_t	need;
+	va_list	ap;
+
+	va_start(ap, fmt);
+	if (rp == NULL) {
+		vfprintf(stderr, fmt, ap);
+		va_end(ap);
+		return;
+	}
+	vsnprintf(msg, sizeof(msg), fmt, ap);
+	va_end(ap);
+
+	need = rp->len + strlen(rp->cmd) + strlen(msg) + 32;
+	if (need > rp->size) {
+		if ((p = realloc(rp->buf, need * 2)) == NULL)
+			return;
+		rp->buf = p;
+		rp->size = need * 2;
+	}
+	rp->len += sprintf(rp->buf + rp->len, "%s syntax[%d]: %s",
+			   rp->cmd, rp->index, msg);
+}
+
+/*
+ * hash bytes of a registration call into reg_hash
+ */
+static void
+hash_reg(const void *data, size_t len)
+{
+	const u_char *p = data;
+
+	while (len-- > 0) {
+		reg_hash ^= *p++;
+		reg_hash *= REG_HASH_PRIME;
+	}
+}
+
+/*
+ * hash a string with its NUL, NULL differs from an empty string
+ */
+static void
+hash_reg_str(const char *str)
+{
+	u_char	null = 0xff;
+
+	if (str)
+		hash_reg(str, strlen(str) + 1);
+	else
+		hash_reg(&null, 1);
+}
+
+static void
+hash_reg_int(int64_t val)
+{
+	hash_reg(&val, sizeof(val));
+}
+
+/*
+ * hash the fields of symbols given by application
+ */
+static void
+hash_reg_symbols(symbol_t *sym, int num)
+{
+	int	i;
+
+	if (!sym) num = 0;
+	hash_reg_int(num);
+	for (i = 0; i < num; i++, sym++) {
+		hash_reg_str(sym->name);
+		hash_reg_str(sym->help);
+		hash_reg_int(sym->lex_type);
+		hash_reg_int(sym->chk_range);
+		hash_reg(&sym->min_val, sizeof(sym->min_val));
+		hash_reg(&sym->max_val, sizeof(sym->max_val));
+		hash_reg(&sym->min_ival, sizeof(sym->min_ival));
+		hash_reg(&sym->max_ival, sizeof(sym->max_ival));
+		hash_reg_str(sym->arg_name);
+	}
+}
+
+/*
+ * symbol index entries in name order, equal names in list order
+ */
+static int
+sym_ent_cmp(const void *a, const void *b)
+{
+	const struct sym_ent *x = a, *y = b;
+	int	res = strcmp(x->sym->name, y->sym->name);
+
+	return (res ? res : x->pos - y->pos);
+}
+
+/*
+ * sort the symbols of a command by name into si, free si->ents after use
+ */
+static int
+index_symbols(struct sym_index *si, struct cmd_tree *cmd_tree)
+{
+	symbol_t *sym;
+	int	num = 0;
+
+	si->num = 0;
+	list_for_each_entry(sym, &cmd_tree->symbol_list, list)
+		num++;
+	if ((si->ents = malloc(sizeof(struct sym_ent) * (num + 1))) == NULL)
+		return -1;
+
+	list_for_each_entry(sym, &cmd_tree->symbol_list, list) {
+		si->ents[si->num].sym = sym;
+		si->ents[si->num].pos = si->num;
+		si->num++;
+	}
+	qsort(si->ents, si->num, sizeof(struct sym_ent), sym_ent_cmp);
+	return 0;
+}
+
+/*
+ * node of the first symbol named name, as get_node_by_name()
+ */
+static node_t *
+index_lookup(struct sym_index *si, char *name)
+{
+	int	lo = 0, hi = si->num, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (strcmp(si->ents[mid].sym->name, name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < si->num && strcmp(si->ents[lo].sym->name, name) == 0)
+		return si->ents[lo].sym->node;
+	return NULL;
+}
+
+/*
+ * resolve words of a syntax to symbol nodes, by the symbol index if si
+ * is given. every bad word is reported.
+ */
+static int
+resolve_words(struct cmd_tree *cmd_tree, struct sym_index *si, char **args,
+	      int arg_num, node_t **nodes, char *caller, struct syn_report *rp)
+{
+	int	i, res = 0;
+	int	is_spec = 0, in_alt = 0;
 
 	for (i = 0; i < arg_num; i++) {
 		track_syntax_char(args[i], &is_spec, &in_alt);
-		nodes[i] = get_node_by_name((!is_spec) ? &cmd_tree->symbol_list : NULL, args[i]);
+		if (is_spec)
+			nodes[i] = get_node_by_name(NULL, args[i]);
+		else if (si)
+			nodes[i] = index_lookup(si, args[i]);
+		else
+			nodes[i] = get_node_by_name(&cmd_tree->symbol_list,
+						    args[i]);
 		if (nodes[i] == NULL) {
-			fprintf(stderr, "add_cmd_syntax: "
-				"bad symbol of command \'%s\', "
-				"word[%d] '\%s\'\n",
-				cmd_tree->cmd, i+1, args[i]);
-			free_argv(args);
-			return -1;
+			syntax_error(rp, "%s: bad symbol of command \'%s\', "
+				     "word[%d] '\%s\'\n",
+				     caller, cmd_tree->cmd, i+1, args[i]);
+			res = -1;
 		}
 	}
+	return res;
+}
+
+/*
+ * tokenize a syntax, and grow it into command tree
+ */
+static int
+grow_syntax(struct cmd_tree *cmd_tree, struct sym_index *si, char *syntax,
+	    int view_mask, int do_flag, struct syn_report *rp)
+{
+	int	arg_num, res;
+	char	**args = NULL;
+
+	if ((arg_num = get_argv(syntax, &args, NULL)) <= 0) {
+		syntax_error(rp, "add_cmd_syntax: zero args\n");
+		return -1;
+	}
+
+	if (strcmp(cmd_tree->cmd, args[0]) != 0) {
+		syntax_error(rp, "add_cmd_syntax: "
+			     "expect word[1] \'%s\' but get \'%s\'\n",
+			     cmd_tree->cmd, args[0]);
+		free_argv(args);
+		return -1;
+	}
+
+	res = grow_args(cmd_tree, si, args, arg_num, view_mask, do_flag, rp);
 	free_argv(args);
+	return res;
+}
+
+/*
+ * grow the words of a syntax into command tree, word[1] is the command
+ */
+static int
+grow_args(struct cmd_tree *cmd_tree, struct sym_index *si, char **args,
+	  int arg_num, int view_mask, int do_flag, struct syn_report *rp)
+{
+	node_t	*nodes[MAX_ARG_NUM + 1];
+
+	bzero(&nodes[0], sizeof(nodes));
+
+	if (resolve_words(cmd_tree, si, args, arg_num, &nodes[0],
+			  "add_cmd_syntax", rp) < 0)
+		return -1;
 
 	if (compare_node(cmd_tree->tree, nodes[0]) != 0) {
-		fprintf(stderr, "add_cmd_syntax: weird unmatch root\n");
+		syntax_error(rp, "add_cmd_syntax: weird unmatch root\n");
 		return -1;
 	}
 	/* XXX grow from the next ! */
-	return grow_tree(cmd_tree->tree, &nodes[1], arg_num-1,
-			 view_mask, do_flag);
+	return grow_tree(&cmd_tree->arena, cmd_tree->tree, &nodes[1], arg_num-1,
+			 view_mask, do_flag, rp);
 }
 
 /*
@@ -377,19 +1237,30 @@ int
 add_cmd_easily(struct cmd_tree *cmd_tree, char *syntax,
 	       int view_mask, int do_flag)
 {
-	char	text[MAX_MANUAL_LEN];
 	char	manual[MAX_MANUAL_LEN];
+
+	if (add_cmd_syntax(cmd_tree, syntax, view_mask, do_flag) < 0)
+		return -1;
+
+	easy_manual(syntax, do_flag, manual);
+	return add_cmd_manual(cmd_tree, manual, view_mask);
+}
+
+/*
+ * manual text of a syntax added easily, with spaces zipped
+ */
+static void
+easy_manual(char *syntax, int do_flag, char *manual)
+{
+	char	text[MAX_MANUAL_LEN];
 	char	*ptr;
 	int	len = 0;
 	int	in_alt = 0;	/* inside { } */
 	int	zip = 0;	/* zip multi spaces as one */
 	int	filter = 0;	/* filter following spaces */
 
-	if (add_cmd_syntax(cmd_tree, syntax, view_mask, do_flag) < 0)
-		return -1;
-
 	bzero(text, sizeof(text));
-	bzero(manual, sizeof(manual));
+	bzero(manual, MAX_MANUAL_LEN);
 
 	/* zip spaces round syntax anchors */
 	for (ptr = syntax; *ptr && len < MAX_MANUAL_LEN - 1; ptr++) {
@@ -415,13 +1286,168 @@ add_cmd_easily(struct cmd_tree *cmd_tree, char *syntax,
 	}
 
 	if ((do_flag & DO_FLAG) && (do_flag & UNDO_FLAG))
-		snprintf(manual, sizeof(manual), "[%s] %s", UNDO_CMD, text);
+		snprintf(manual, MAX_MANUAL_LEN, "[%s] %s", UNDO_CMD, text);
 	else if ((do_flag & UNDO_FLAG))
-		snprintf(manual, sizeof(manual), "%s %s", UNDO_CMD, text);
+		snprintf(manual, MAX_MANUAL_LEN, "%s %s", UNDO_CMD, text);
 	else
-		snprintf(manual, sizeof(manual), "%s", text);
+		snprintf(manual, MAX_MANUAL_LEN, "%s", text);
+}
 
-	return add_cmd_manual(cmd_tree, manual, view_mask);
+/*
+ * a syntax of add_cmd_syntaxes(), tokenized
+ */
+struct syn_line {
+	struct cmd_tree *cmd_tree;
+	int	index;			/* index in syn_table */
+	int	arg_num;
+	char	**args;
+};
+
+/*
+ * syntax lines grouped by command, in table order within a command
+ */
+static int
+syn_line_cmp(const void *a, const void *b)
+{
+	const struct syn_line *x = a, *y = b;
+	int	res = strcmp(x->cmd_tree->cmd, y->cmd_tree->cmd);
+
+	return (res ? res : x->index - y->index);
+}
+
+/*
+ * add a table of syntaxes in one batch, to cmd_tree, or to the commands
+ * named by the first word of each syntax if cmd_tree is NULL. syntaxes
+ * are grouped by command keeping their order, so the tree grows as by
+ * adding them one by one, and words are resolved by a sorted index of
+ * symbols built once per command. errors of all the syntaxes are put
+ * into err_buf, or printed to stderr if err_buf is NULL, at the end.
+ * return the number of syntaxes failed, or -1 on bad parm, including
+ * an err_buf without room.
+ */
+int
+add_cmd_syntaxes(struct cmd_tree *cmd_tree, syntax_t *syn_table, int syn_num,
+		 char *err_buf, int limit)
+{
+	struct syn_report report;
+	struct syn_line	*lines, *sl;
+	struct sym_index si, *sip;
+	struct cmd_tree	*ct;
+	syntax_t *syn;
+	char	manual[MAX_MANUAL_LEN];
+	int	i, j, num = 0, failed = 0, res;
+
+	if (!syn_table || syn_num <= 0 || (err_buf && limit <= 0)) {
+		fprintf(stderr, "add_cmd_syntaxes: bad parm\n");
+		return -1;
+	}
+	if (OCLI_FROZEN()) {
+		fprintf(stderr, "add_cmd_syntaxes: syntax trees are frozen\n");
+		return -1;
+	}
+	hash_reg_str("add_cmd_syntaxes");
+	hash_reg_str(cmd_tree ? cmd_tree->cmd : NULL);
+	for (i = 0; i < syn_num; i++) {
+		hash_reg_str(syn_table[i].syntax);
+		hash_reg_str(syn_table[i].manual ? "manual" : NULL);
+		hash_reg_int(syn_table[i].view_mask);
+		hash_reg_int(syn_table[i].do_flag);
+	}
+	if (err_buf) err_buf[0] = '\0';
+	/* syntaxes and manuals come with the syntax image */
+	if (ocli_loaded) return 0;
+
+	if ((lines = malloc(sizeof(struct syn_line) * syn_num)) == NULL) {
+		fprintf(stderr, "add_cmd_syntaxes: no memory\n");
+		return -1;
+	}
+
+	bzero(&report, sizeof(report));
+
+	/* tokenize, and find the command of each syntax */
+	for (i = 0; i < syn_num; i++) {
+		syn = &syn_table[i];
+		sl = &lines[num];
+		report.cmd = cmd_tree ? cmd_tree->cmd : "-";
+		report.index = i;
+
+		sl->args = NULL;
+		if (!syn->syntax || !syn->do_flag ||
+		    (sl->arg_num = get_argv(syn->syntax, &sl->args, NULL)) <= 0) {
+			syntax_error(&report, "add_cmd_syntaxes: empty syntax or no "
+				     "do_flag\n");
+			if (sl->args) free_argv(sl->args);
+			failed++;
+			continue;
+		}
+
+		if (cmd_tree == NULL)
+			report.cmd = sl->args[0];
+		ct = cmd_tree ? cmd_tree : get_cmd_tree(sl->args[0]);
+		if (ct == NULL) {
+			syntax_error(&report, "add_cmd_syntaxes: no command \'%s\'\n",
+				     sl->args[0]);
+			free_argv(sl->args);
+			failed++;
+			continue;
+		}
+		if (strcmp(ct->cmd, sl->args[0]) != 0) {
+			syntax_error(&report, "add_cmd_syntax: "
+				     "expect word[1] \'%s\' but get \'%s\'\n",
+				     ct->cmd, sl->args[0]);
+			free_argv(sl->args);
+			failed++;
+			continue;
+		}
+		sl->cmd_tree = ct;
+		sl->index = i;
+		num++;
+	}
+
+	qsort(lines, num, sizeof(struct syn_line), syn_line_cmp);
+
+	for (i = 0; i < num; i = j) {
+		ct = lines[i].cmd_tree;
+		report.cmd = ct->cmd;
+
+		/* without an index, words are looked up in symbol_list */
+		sip = NULL;
+		if (!ct->lazy && index_symbols(&si, ct) == 0)
+			sip = &si;
+
+		for (j = i; j < num && lines[j].cmd_tree == ct; j++) {
+			syn = &syn_table[lines[j].index];
+			report.index = lines[j].index;
+
+			/* a lazy command only records them */
+			if (ct->lazy)
+				res = add_syntax(ct, syn->syntax,
+						 syn->view_mask, syn->do_flag);
+			else
+				res = grow_args(ct, sip, lines[j].args,
+						lines[j].arg_num,
+						syn->view_mask, syn->do_flag,
+						&report);
+
+			if (res == 0 && syn->manual) {
+				easy_manual(syn->syntax, syn->do_flag, manual);
+				res = add_manual(ct, manual, syn->view_mask);
+			}
+			if (res < 0) failed++;
+			free_argv(lines[j].args);
+		}
+		if (sip) free(si.ents);
+	}
+	free(lines);
+
+	if (report.buf) {
+		if (err_buf)
+			snprintf(err_buf, limit, "%s", report.buf);
+		else
+			fputs(report.buf, stderr);
+		free(report.buf);
+	}
+	return failed;
 }
 
 /*
@@ -431,15 +1457,37 @@ int
 sprout_cmd_syntax(struct cmd_tree *cmd_tree, char *syntax,
 		  int view_mask, int do_flag)
 {
-	int	i, arg_num;
-	char	**args = NULL;
-	node_t	*nodes[MAX_ARG_NUM + 1];
-	int	is_spec = 0, in_alt = 0;
-
 	if (!cmd_tree || !syntax || !syntax[0]) {
 		fprintf(stderr, "sprout_cmd_syntax: bad parm\n");
 		return -1;
 	}
+	if (OCLI_FROZEN()) {
+		fprintf(stderr, "sprout_cmd_syntax: syntax trees are frozen\n");
+		return -1;
+	}
+	hash_reg_str("sprout_cmd_syntax");
+	hash_reg_str(cmd_tree->cmd);
+	hash_reg_str(syntax);
+	hash_reg_int(view_mask);
+	hash_reg_int(do_flag);
+	if (ocli_loaded) return 0;
+	if (cmd_tree->lazy)
+		return record_syntax(cmd_tree, SYN_SPROUT, syntax, view_mask,
+				     do_flag, NULL);
+	return sprout_syntax(cmd_tree, NULL, syntax, view_mask, do_flag);
+}
+
+/*
+ * tokenize a syntax, and sprout it besides each leaf of command tree
+ */
+static int
+sprout_syntax(struct cmd_tree *cmd_tree, struct sym_index *si, char *syntax,
+	      int view_mask, int do_flag)
+{
+	int	arg_num;
+	char	**args = NULL;
+	node_t	*nodes[MAX_ARG_NUM + 1];
+
 	if ((arg_num = get_argv(syntax, &args, NULL)) <= 0) {
 		fprintf(stderr, "sprout_cmd_syntax: zero args\n");
 		return -1;
@@ -447,114 +1495,264 @@ sprout_cmd_syntax(struct cmd_tree *cmd_tree, char *syntax,
 
 	bzero(&nodes[0], sizeof(nodes));
 
-	for (i = 0; i < arg_num; i++) {
-		track_syntax_char(args[i], &is_spec, &in_alt);
-		nodes[i] = get_node_by_name((!is_spec) ? &cmd_tree->symbol_list : NULL, args[i]);
-		if (nodes[i] == NULL) {
-			fprintf(stderr, "sprout_cmd_syntax: "
-				"bad symbol of command \'%s\', "
-				"word[%d] '\%s\'\n",
-				cmd_tree->cmd, i+1, args[i]);
-			free_argv(args);
-			return -1;
-		}
+	if (resolve_words(cmd_tree, si, args, arg_num, &nodes[0],
+			  "sprout_cmd_syntax", NULL) < 0) {
+		free_argv(args);
+		return -1;
 	}
 	free_argv(args);
 
 	/* XXX sprout new nodes besides each LEAF ! */
-	sprout_tree(cmd_tree->tree, &nodes[0], arg_num,
-		    view_mask, do_flag);
+	sprout_tree(&cmd_tree->arena, cmd_tree->tree, &nodes[0], arg_num,
+		    view_mask, do_flag, NULL);
 	return 0;
 }
 
 /*
- * test if given arg matches with node.
- * return MATCH_EXACTLY (100) if key exactly match.
+ * record a syntax, or an arg helper, of a lazy command tree
  */
 static int
-match_node(node_t *node, char *arg, int view, int do_flag)
+record_syntax(struct cmd_tree *cmd_tree, int op, char *syntax,
+	      int view_mask, int do_flag, arg_helper_t helper)
 {
-	int	len;
-	struct lex_ent	*lex;
-	double	val;
-
-	if (!NODE_IS_ALLOWED(node, view, do_flag))
-		return 0;
+	struct cmd_syntax *syn;
 
-	if (node->match_type == MATCH_KEYWORD) {
-		len = strlen(arg);
-		if (strncmp(node->match_ent.keyword, arg, len) == 0) {
-			if (node->match_ent.keyword[len] == '\0')
-				return MATCH_EXACTLY;
-			else
-				return 1;
-		} else {
-			return 0;
-		}
-	} else if (node->match_type == MATCH_VAR) {
-		lex = get_lex_ent(node->match_ent.var.lex_type);
-		if (lex->fun(arg) != 1) {
-			return 0;
-		}
-		if (IS_NUMERIC_LEX_TYPE(node->match_ent.var.lex_type) &&
-		    node->match_ent.var.chk_range) {
-			val = atof(arg);
-			if (val >= node->match_ent.var.min_val &&
-			    val <= node->match_ent.var.max_val)
-				return 1;
-			else
-				return 0;
-		} else {
-			return 1;
-		}
+	if ((syn = arena_alloc(&cmd_tree->arena, sizeof(*syn))) == NULL ||
+	    (syn->syntax = arena_strdup(&cmd_tree->arena, syntax)) == NULL) {
+		fprintf(stderr, "record_syntax: no memory\n");
+		return -1;
 	}
-
+	syn->op = op;
+	syn->view_mask = view_mask;
+	syn->do_flag = do_flag;
+	syn->helper = helper;
+	list_add_tail(&syn->syntax_list, &cmd_tree->syntax_list);
 	return 0;
 }
 
 /*
- * recursively cleanup opt usage mark
+ * build the tree of a lazy command from its recorded syntaxes, in the
+ * order they were added. errors are reported as by eager adding. a
+ * published tree is built with the write lock of cmd_lock held.
  */
 static void
-cleanup_opt_mark(node_t *tree)
+build_cmd_tree(struct cmd_tree *cmd_tree)
 {
-	node_t	*np;
-
-	if (!tree) return;
-	if (tree->parent && tree->parent->match_type == MATCH_OPT_HEAD)
-		tree->opt_mark = 0;
-
-	list_for_each_entry(np, &tree->child_list, sibling_list) {
-		cleanup_opt_mark(np);
+	struct cmd_syntax *syn;
+	struct sym_index si, *sip = &si;
+
+	if (!cmd_tree || !cmd_tree->lazy) return;
+
+	/* without an index, words are looked up in symbol_list */
+	if (index_symbols(&si, cmd_tree) < 0)
+		sip = NULL;
+
+	list_for_each_entry(syn, &cmd_tree->syntax_list, syntax_list) {
+		if (syn->op == SYN_ADD)
+			grow_syntax(cmd_tree, sip, syn->syntax,
+				    syn->view_mask, syn->do_flag, NULL);
+		else if (syn->op == SYN_SPROUT)
+			sprout_syntax(cmd_tree, sip, syn->syntax,
+				      syn->view_mask, syn->do_flag);
+		else
+			set_arg_helper(cmd_tree->tree, syn->syntax,
+				       syn->helper);
 	}
+	INIT_LIST_HEAD(&cmd_tree->syntax_list);
+	if (sip) free(si.ents);
+	__atomic_store_n(&cmd_tree->lazy, 0, __ATOMIC_RELEASE);
+	dprintf(DBG_TREE, "built lazy tree [%s]\n", cmd_tree->cmd);
 }
 
 /*
- * align opt_mark if node is an ALT member
+ * set lazy building of the commands created afterwards, until it is
+ * disabled again
  */
-static void
-align_opt_mark(node_t *node)
+void
+ocli_set_lazy(int enabled)
 {
-	node_t	*alt_head = NULL;
-	node_t	*np;
+	ocli_lazy = enabled;
+}
 
-	if (!node || !node->parent ||
-	    node->parent->match_type != MATCH_OPT_HEAD)
-		return;
+/*
+ * lex matching context of one arg. verdicts are memorized in cmd_stat by
+ * arg index, and built-in types of VAR siblings share one lex_classify().
+ */
+struct arg_lex {
+	cmd_stat_t *cmd_stat;	/* memo holder, NULL if not memorized */
+	int	argi;		/* index of arg in cmd_stat->args */
+	int	n_var;		/* number of built-in VAR nodes tested */
+	int	classified;
+	lexmask_t mask;		/* built-in lex types matched by arg */
+};
 
-	if (node->alt_head)
-		alt_head = node->alt_head;
-	else if (node->alt_order == 1)
-		alt_head = node;
-	else
-		return;
+/*
+ * init lex matching context, memo is used only if arg is exactly the
+ * arg parsed at argi by check_cmd_syntax()
+ */
+static void
+init_arg_lex(struct arg_lex *al, char *arg, cmd_stat_t *cmd_stat, int argi)
+{
+	bzero(al, sizeof(struct arg_lex));
+	if (arg && cmd_stat && cmd_stat->args &&
+	    argi >= 0 && argi < cmd_stat->arg_num &&
+	    strcmp(cmd_stat->args[argi], arg) == 0) {
+		al->cmd_stat = cmd_stat;
+		al->argi = argi;
+	}
+}
+
+/*
+ * get memorized lex verdict, return -1 if not found
+ */
+static int
+get_lex_memo(struct arg_lex *al, int type)
+{
+	cmd_stat_t *cmd_stat = al->cmd_stat;
+	int	i;
+
+	if (!cmd_stat) return -1;
+	for (i = 0; i < cmd_stat->memo_num; i++) {
+		if (cmd_stat->lex_memo[i].argi == al->argi &&
+		    cmd_stat->lex_memo[i].lex_type == type)
+			return cmd_stat->lex_memo[i].res;
+	}
+	return -1;
+}
+
+/*
+ * memorize lex verdict, silently give up if memo is full
+ */
+static void
+set_lex_memo(struct arg_lex *al, int type, int res)
+{
+	cmd_stat_t *cmd_stat = al->cmd_stat;
+	lex_memo_t *memo;
+
+	if (!cmd_stat || cmd_stat->memo_num >= MAX_LEX_MEMO) return;
+	memo = &cmd_stat->lex_memo[cmd_stat->memo_num++];
+	memo->argi = al->argi;
+	memo->lex_type = type;
+	memo->res = res;
+}
+
+/*
+ * test if arg is of given lex type. the first built-in VAR node calls its
+ * validator directly, later siblings share one lex_classify() of the arg.
+ */
+static int
+match_lex(char *arg, int type, struct arg_lex *al)
+{
+	int	res;
+
+	if ((res = get_lex_memo(al, type)) >= 0)
+		return res;
+
+	if (IS_BUILTIN_LEX_TYPE(type) && al->n_var++ > 0) {
+		if (!al->classified) {
+			lex_classify(arg, &al->mask);
+			al->classified = 1;
+		}
+		res = ((al->mask & LEX_MASK(type)) != 0);
+	} else {
+		res = lex_match(type, arg);
+	}
+
+	set_lex_memo(al, type, res);
+	return res;
+}
+
+/*
+ * test if given arg matches with node.
+ * return MATCH_EXACTLY (100) if key exactly match.
+ */
+static int
+match_node(node_t *node, char *arg, int view, int do_flag,
+	   struct arg_lex *al)
+{
+	int	len;
+	double	val;
+	int64_t	ival;
+	u_int64_t uval;
+	var_t	*var;
+
+	if (!NODE_IS_ALLOWED(node, view, do_flag))
+		return 0;
 
-	list_for_each_entry(np, &node->parent->child_list, sibling_list) {
-		if (np == alt_head ||
-		    np->alt_head == alt_head) {
-			np->opt_mark = 1;
+	if (node->match_type == MATCH_KEYWORD) {
+		len = strlen(arg);
+		if (strncmp(node->match_ent.keyword, arg, len) == 0) {
+			if (node->match_ent.keyword[len] == '\0')
+				return MATCH_EXACTLY;
+			else
+				return 1;
+		} else {
+			return 0;
+		}
+	} else if (node->match_type == MATCH_VAR) {
+		var = &node->match_ent.var;
+
+		/* integer ranges are checked while validating the digits */
+		if (var->chk_range == RANGE_INT)
+			return (get_lex_int(var->lex_type, arg, &ival) &&
+				ival >= var->min_ival.i &&
+				ival <= var->max_ival.i);
+		if (var->chk_range == RANGE_UINT)
+			return (get_lex_uint(var->lex_type, arg, &uval) &&
+				uval >= var->min_ival.u &&
+				uval <= var->max_ival.u);
+
+		if (!match_lex(arg, node->match_ent.var.lex_type, al)) {
+			return 0;
+		}
+		if (IS_NUMERIC_LEX_TYPE(node->match_ent.var.lex_type) &&
+		    node->match_ent.var.chk_range == RANGE_FLOAT) {
+			val = atof(arg);
+			if (val >= node->match_ent.var.min_val &&
+			    val <= node->match_ent.var.max_val)
+				return 1;
+			else
+				return 0;
+		} else {
+			return 1;
 		}
 	}
+
+	return 0;
+}
+
+/*
+ * is option node used by the parse of cmd_stat ? members of an ALT are
+ * used together, kept by the eldest one.
+ */
+static int
+opt_is_used(cmd_stat_t *cmd_stat, node_t *node)
+{
+	int	i;
+
+	if (!cmd_stat) return 0;
+	if (node->alt_head)
+		node = node->alt_head;
+
+	for (i = 0; i < cmd_stat->opt_num; i++) {
+		if (cmd_stat->opt_used[i] == node)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * mark option node used by the parse of cmd_stat
+ */
+static void
+set_opt_used(cmd_stat_t *cmd_stat, node_t *node)
+{
+	if (!cmd_stat || cmd_stat->opt_num >= MAX_ARG_NUM) return;
+	if (node->alt_head)
+		node = node->alt_head;
+
+	if (!opt_is_used(cmd_stat, node))
+		cmd_stat->opt_used[cmd_stat->opt_num++] = node;
 }
 
 /*
@@ -589,6 +1787,16 @@ check_cmd_syntax(char *cmd, int view, cmd_stat_t *cmd_stat)
 		return -1;
 	}
 
+	/* args are kept in cmd_stat for lex memo, and freed by cleanup */
+	cmd_stat->args = args;
+	cmd_stat->arg_num = arg_num;
+	cmd_stat->memo_num = 0;
+	cmd_stat->opt_num = 0;
+
+	/* trees found from now on are kept until cleanup_cmd_stat() */
+	if (!cmd_stat->rcu_slot)
+		cmd_stat->rcu_slot = rcu_enter() + 1;
+
 	i = 0;
 	len = strlen(args[0]);
 
@@ -598,7 +1806,7 @@ check_cmd_syntax(char *cmd, int view, cmd_stat_t *cmd_stat)
 		do_flag = UNDO_FLAG; 
 		if (args[1] == NULL) {
 			err_code = MATCH_INCOMPLETE;
-			node = cmd_tree->tree;
+			node = CMD_ROOT(cmd_tree);
 			last_node = node;
 			last_argi = i;
 			err_argi = -1;
@@ -631,19 +1839,17 @@ check_cmd_syntax(char *cmd, int view, cmd_stat_t *cmd_stat)
 
 	if ((cmd_arg = malloc(sizeof(cmd_arg_t) * MAX_ARG_NUM)) == NULL) {
 		fprintf(stderr, "check_cmd_syntax: no memory for cmd_arg\n");
-		free_argv(args);
 		return -1;
 	}
 	bzero(cmd_arg, sizeof(cmd_arg_t) * MAX_ARG_NUM);
 	cmd_argi = 0;
 
-	cleanup_opt_mark(cmd_tree->tree);
-
-	node = cmd_tree->tree;
+	node = CMD_ROOT(cmd_tree);
 
 	/* The first command keyword can also have its cmd_arg */
 	if (node->arg_name[0] && cmd_argi < MAX_ARG_NUM) {
-		if (set_cmd_arg(node, args[i], &cmd_arg[cmd_argi]))
+		if (set_cmd_arg(node, args[i], &cmd_arg[cmd_argi],
+				cmd_stat, i))
 			cmd_argi++;
 	}
 
@@ -652,7 +1858,8 @@ check_cmd_syntax(char *cmd, int view, cmd_stat_t *cmd_stat)
 
 	while (args[i] != NULL && node != NULL) {
 		next = NULL;
-		n_match = get_next_node(node, &next, args[i], view, do_flag);
+		n_match = get_next_node(node, &next, args[i], view, do_flag,
+					cmd_stat, i);
 		if (n_match == 1) {
 			last_node = node;
 			last_argi = i;
@@ -665,7 +1872,8 @@ check_cmd_syntax(char *cmd, int view, cmd_stat_t *cmd_stat)
 			/* set the cmd_arg by uniq matching node */
 			if (node->arg_name[0] && cmd_argi < MAX_ARG_NUM) {
 				if (set_cmd_arg(node, args[i],
-						&cmd_arg[cmd_argi])) {
+						&cmd_arg[cmd_argi],
+						cmd_stat, i)) {
 					cmd_argi++;
 				}
 			}
@@ -723,7 +1931,6 @@ check_out:
 
 	if (cmd_tree) cmd_stat->cmd_tree = cmd_tree;
 	if (last_node) cmd_stat->last_node = node;
-	free_argv(args);
 	return res;
 }
 
@@ -731,12 +1938,13 @@ check_out:
  * collect all the opt_end nodes into list
  */
 static int
-get_opt_end(node_t *base, node_t **node_list, int *limit, int *index)
+get_opt_end(node_t *base, node_t **node_list, int *limit, int *index,
+	    struct syn_report *rp)
 {
 	node_t	*np;
 
 	if (!base || *limit <= 0 || *index >= *limit) {
-		fprintf(stderr, "get_opt_end: bad parm\n");
+		syntax_error(rp, "get_opt_end: bad parm\n");
 		return -1;
 	}
 
@@ -748,7 +1956,7 @@ get_opt_end(node_t *base, node_t **node_list, int *limit, int *index)
 	}
 		
 	list_for_each_entry(np, &base->child_list, sibling_list) {
-		if (get_opt_end(np, node_list, limit, index) < 0)
+		if (get_opt_end(np, node_list, limit, index, rp) < 0)
 			return -1;
 	}
 	
@@ -759,7 +1967,8 @@ get_opt_end(node_t *base, node_t **node_list, int *limit, int *index)
  * grow a tree with node list
  */
 static int
-grow_tree(node_t *tree, node_t **nodes, int num, int view_mask, int do_flag)
+grow_tree(struct arena *arena, node_t *tree, node_t **nodes, int num,
+	  int view_mask, int do_flag, struct syn_report *rp)
 {
 	int	i;
 	node_t	*base = NULL, *ptr = NULL;
@@ -781,7 +1990,7 @@ grow_tree(node_t *tree, node_t **nodes, int num, int view_mask, int do_flag)
 	int	alt_num = 0;
 
 	if (!tree || !nodes) {
-		fprintf(stderr, "grow_tree: bad parm\n");
+		syntax_error(rp, "grow_tree: bad parm\n");
 		return -1;
 	}
 
@@ -808,7 +2017,7 @@ grow_tree(node_t *tree, node_t **nodes, int num, int view_mask, int do_flag)
 			}
 
 			if (alt_stat == 1) {
-				fprintf(stderr, "grow_tree: nested alt head\n");
+				syntax_error(rp, "grow_tree: nested alt head\n");
 				return -1;
 			}
 			alt_stat = 1;
@@ -817,7 +2026,7 @@ grow_tree(node_t *tree, node_t **nodes, int num, int view_mask, int do_flag)
 
 		} else if (nodes[i]->match_type == MATCH_ALT_OR) {
 			if (alt_stat != 1 || alt_words != 1) {
-				fprintf(stderr, "grow_tree: bad alt | position\n");
+				syntax_error(rp, "grow_tree: bad alt | position\n");
 				return -1;
 			}
 			alt_words = 0;
@@ -825,11 +2034,11 @@ grow_tree(node_t *tree, node_t **nodes, int num, int view_mask, int do_flag)
 
 		} else if (nodes[i]->match_type == MATCH_ALT_END) {
 			if (alt_stat != 1 || alt_words != 1) {
-				fprintf(stderr, "grow_tree: bad alt end\n");
+				syntax_error(rp, "grow_tree: bad alt end\n");
 				return -1;
 			}
 			if (alt_num == 0) {
-				fprintf(stderr, "grow_tree: empty alt\n");
+				syntax_error(rp, "grow_tree: empty alt\n");
 				return -1;
 			} else if (alt_num >= 2) {
 				alt_base[0]->alt_order = 1;
@@ -850,20 +2059,21 @@ grow_tree(node_t *tree, node_t **nodes, int num, int view_mask, int do_flag)
 
 		} else if (alt_stat) {
 			if (nodes[i]->match_type == MATCH_OPT_END) {
-				fprintf(stderr, "grow_tree: unexpected ] in alt\n");
+				syntax_error(rp, "grow_tree: unexpected ] in alt\n");
 				return -1;
 			}
 			if (++alt_words != 1) {
-				fprintf(stderr, "grow_tree: missing | in alt\n");
+				syntax_error(rp, "grow_tree: missing | in alt\n");
 				return -1;
 			}
-			if ((ptr = grow_node(base, nodes[i], view_mask, do_flag)) == NULL)
+			if ((ptr = grow_node(arena, base, nodes[i], view_mask, do_flag,
+					      rp)) == NULL)
 				return -1;
 
 			if (alt_num < MAX_CHOICES - 1) {
 				alt_base[alt_num++] = ptr;
 			} else {
-				fprintf(stderr, "grow_tree: alt slot full\n");
+				syntax_error(rp, "grow_tree: alt slot full\n");
 				return -1;
 			}
 			continue;
@@ -880,14 +2090,14 @@ grow_tree(node_t *tree, node_t **nodes, int num, int view_mask, int do_flag)
 					opt_stat = 1;
 					continue;
 				} else if (opt_stat == 1) {
-					fprintf(stderr, "grow_tree: nested opt head\n");
+					syntax_error(rp, "grow_tree: nested opt head\n");
 					return -1;
 				}
 			}
 
 		} else if (nodes[i]->match_type == MATCH_OPT_ANY) {
 			if (base->match_type != MATCH_OPT_HEAD) {
-				fprintf(stderr, "grow_tree: bad opt * position\n");
+				syntax_error(rp, "grow_tree: bad opt * position\n");
 				return -1;
 			}
 			opt_any = 1;
@@ -895,11 +2105,11 @@ grow_tree(node_t *tree, node_t **nodes, int num, int view_mask, int do_flag)
 
 		} else if (nodes[i]->match_type == MATCH_OPT_END) {
 			if (base->match_type == MATCH_OPT_HEAD && !opt_any) {
-				fprintf(stderr, "grow_tree: empty opt\n");
+				syntax_error(rp, "grow_tree: empty opt\n");
 				return -1;
 			}
 			if (!opt_head || opt_stat != 1) {
-				fprintf(stderr, "grow_tree: bad or nested opt end\n");
+				syntax_error(rp, "grow_tree: bad or nested opt end\n");
 				return -1;
 			}
 
@@ -910,8 +2120,8 @@ grow_tree(node_t *tree, node_t **nodes, int num, int view_mask, int do_flag)
 				if (get_opt_end(opt_head,
 						&opt_base[opt_num],
 						&limit,
-						&index) < 0) {
-					fprintf(stderr, "grow_tree: failed to get all opt end\n");
+						&index, rp) < 0) {
+					syntax_error(rp, "grow_tree: failed to get all opt end\n");
 					return -1;
 				}
 				opt_stat = 2;
@@ -925,7 +2135,7 @@ grow_tree(node_t *tree, node_t **nodes, int num, int view_mask, int do_flag)
 			if (opt_num < MAX_CHOICES - 1) {
 				opt_base[opt_num++] = base;
 			} else {
-				fprintf(stderr, "grow_tree: opt group full\n");
+				syntax_error(rp, "grow_tree: opt group full\n");
 				return -1;
 			}
 			continue;
@@ -935,12 +2145,13 @@ grow_tree(node_t *tree, node_t **nodes, int num, int view_mask, int do_flag)
 			if (opt_stat == 2) {
 				break;
 			} else if (opt_any) {
-				fprintf(stderr, "grow_tree: bad opt after '*'\n");
+				syntax_error(rp, "grow_tree: bad opt after '*'\n");
 				return -1;
 			}
 		}
 
-		if ((ptr = grow_node(base, nodes[i], view_mask, do_flag)) == NULL)
+		if ((ptr = grow_node(arena, base, nodes[i], view_mask, do_flag,
+					     rp)) == NULL)
 			return -1;
 
 		/* node grown as option head, mark it */
@@ -955,23 +2166,24 @@ grow_tree(node_t *tree, node_t **nodes, int num, int view_mask, int do_flag)
 	}
 
 	if (opt_stat == 0 && alt_stat == 0) {
-		return (grow_leaf(base, view_mask, do_flag));
+		return (grow_leaf(arena, base, view_mask, do_flag, rp));
 
 	} else if (opt_stat == 2 && opt_num >= 2) {
 		/* recursively grow tree on each base for remaining nodes */
 		for (j = 0; j < opt_num && opt_base[j]; j++) {
-			if (grow_tree(opt_base[j], &nodes[i], num - i, view_mask, do_flag) < 0) {
+			if (grow_tree(arena, opt_base[j], &nodes[i], num - i,
+				      view_mask, do_flag, rp) < 0) {
 				return -1;
 			}
 		}
 		return 0;
 
 	} else if (opt_stat == 1) {
-		fprintf(stderr, "grow_tree: unclosed opt clause\n");
+		syntax_error(rp, "grow_tree: unclosed opt clause\n");
 		return -1;
 
 	} else {
-		fprintf(stderr, "grow_tree: weird, alt stat:%d num:%d, opt stat:%d num:%d\n",
+		syntax_error(rp, "grow_tree: weird, alt stat:%d num:%d, opt stat:%d num:%d\n",
 			alt_stat, alt_num, opt_stat, opt_num);
 		return -1;
 	}
@@ -981,7 +2193,7 @@ grow_tree(node_t *tree, node_t **nodes, int num, int view_mask, int do_flag)
  * plant the root node
  */
 static int
-plant_root(node_t **root, node_t *node)
+plant_root(struct arena *arena, node_t **root, node_t *node)
 {
 	node_t	*newp;
 
@@ -996,7 +2208,7 @@ plant_root(node_t **root, node_t *node)
 	}
 
 	/* create a root node */
-	if ((newp = malloc(sizeof(node_t))) == NULL) {
+	if ((newp = arena_alloc(arena, sizeof(node_t))) == NULL) {
 		fprintf(stderr, "plant_root: malloc root node error\n");
 		return -1;
 	}
@@ -1007,6 +2219,9 @@ plant_root(node_t **root, node_t *node)
 
 	newp->parent = NULL;
 	newp->child_num = 0;
+	newp->leaf = NULL;
+	newp->key_num = newp->other_num = 0;
+	newp->keys = newp->others = NULL;
 	INIT_LIST_HEAD(&newp->child_list);
 	INIT_LIST_HEAD(&newp->sibling_list);
 
@@ -1017,54 +2232,141 @@ plant_root(node_t **root, node_t *node)
 	return 0;
 }
 
+/*
+ * index of the first keyword child not less than key, keywords with
+ * the prefix key are all in a row from there
+ */
+static int
+key_lower(node_t *node, const char *key)
+{
+	int	lo = 0, hi = node->key_num, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (strcmp(node->keys[mid]->match_ent.keyword, key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+ * get keyword child exactly matching key
+ */
+static node_t *
+get_child_key(node_t *node, const char *key)
+{
+	int	i = key_lower(node, key);
+
+	if (i < node->key_num &&
+	    strcmp(node->keys[i]->match_ent.keyword, key) == 0)
+		return node->keys[i];
+	return NULL;
+}
+
+/*
+ * room for one more entry in an index array of num entries. arrays grow
+ * by doubling from 4, the outgrown one is left to the arena.
+ */
+static node_t **
+grow_index(struct arena *arena, node_t **arr, int num)
+{
+	node_t	**newp;
+
+	/* full only at 0, 4, 8, 16 ... */
+	if (num > 0 && (num < 4 || (num & (num - 1)) != 0))
+		return arr;
+
+	newp = arena_alloc(arena, sizeof(node_t *) * (num < 4 ? 4 : num * 2));
+	if (newp && num > 0)
+		memcpy(newp, arr, sizeof(node_t *) * num);
+	return newp;
+}
+
+/*
+ * add a new child to the index of base, before linking it to child_list
+ */
+static int
+index_child(struct arena *arena, node_t *base, node_t *np)
+{
+	node_t	**arr;
+	int	i;
+
+	np->child_order = base->child_num;
+
+	if (np->match_type == MATCH_KEYWORD) {
+		arr = grow_index(arena, base->keys, base->key_num);
+		if (arr == NULL) return -1;
+		base->keys = arr;
+
+		i = key_lower(base, np->match_ent.keyword);
+		memmove(&arr[i + 1], &arr[i],
+			sizeof(node_t *) * (base->key_num - i));
+		arr[i] = np;
+		base->key_num++;
+	} else {
+		arr = grow_index(arena, base->others, base->other_num);
+		if (arr == NULL) return -1;
+		base->others = arr;
+		arr[base->other_num++] = np;
+
+		if (np->match_type == MATCH_LEAF)
+			base->leaf = np;
+	}
+	return 0;
+}
+
 /*
  * grow a leaf node
  */
 static int
-grow_leaf(node_t *base, int view_mask, int do_flag)
+grow_leaf(struct arena *arena, node_t *base, int view_mask, int do_flag,
+	  struct syn_report *rp)
 {
 	node_t	*newp, *np;
-	int	i = 0;
 
 	if (!base) {
-		fprintf(stderr, "grow_leaf: empty base or node\n");
+		syntax_error(rp, "grow_leaf: empty base or node\n");
 		return -1;
 	}
 
-	/* search if given node already had a leaf */
-	list_for_each_entry(np, &base->child_list, sibling_list) {
-		if (IS_LEAF(np)) {
-			/* XXX OR the node view & do bits */
-			if ((do_flag & DO_FLAG))
-				np->do_view_mask |= view_mask;
-			if ((do_flag & UNDO_FLAG))
-				np->undo_view_mask |= view_mask;
-			dprintf(DBG_TREE, "leaf[%d] ", i);
-			if ((debug_flag & DBG_TREE))
-				debug_node(".", np, 1);
-			return 0;
-		}
-		i++;
+	/* if given node already had a leaf */
+	if ((np = base->leaf) != NULL) {
+		/* XXX OR the node view & do bits */
+		if ((do_flag & DO_FLAG))
+			np->do_view_mask |= view_mask;
+		if ((do_flag & UNDO_FLAG))
+			np->undo_view_mask |= view_mask;
+		dprintf(DBG_TREE, "leaf[%d] ", np->child_order);
+		if ((debug_flag & DBG_TREE))
+			debug_node(".", np, 1);
+		return 0;
 	}
 
 	if (base->child_num == MAX_CHILD_NUM) {
-		fprintf(stderr, "grow_leaf: no free leaf slot\n");
+		syntax_error(rp, "grow_leaf: no free leaf slot\n");
 		return -1;
 	}
 
 	/* create a leaf node */
-	if ((newp = malloc(sizeof(node_t))) == NULL) {
-		fprintf(stderr, "grow_leaf: malloc root node error\n");
+	if ((newp = arena_alloc(arena, sizeof(node_t))) == NULL) {
+		syntax_error(rp, "grow_leaf: malloc root node error\n");
 		return -1;
 	}
-	bzero(newp, sizeof(node_t));
 	newp->match_type = MATCH_LEAF;
+	newp->arg_name = newp->help = intern_str(NULL, 0);
 	if ((do_flag & DO_FLAG)) newp->do_view_mask = view_mask;
 	if ((do_flag & UNDO_FLAG)) newp->undo_view_mask = view_mask;
 	newp->depth = base->depth + 1;
 	newp->parent = base;
 	INIT_LIST_HEAD(&newp->child_list);
 
+	if (index_child(arena, base, newp) < 0) {
+		syntax_error(rp, "grow_leaf: no memory\n");
+		return -1;
+	}
+
 	dprintf(DBG_TREE, "leaf[%d] ", base->child_num);
 	if ((debug_flag & DBG_TREE))
 		debug_node("+", newp, 1);
@@ -1080,41 +2382,49 @@ grow_leaf(node_t *base, int view_mask, int do_flag)
  * grow one new node from base
  */
 static node_t *
-grow_node(node_t *base, node_t *node, int view_mask, int do_flag)
+grow_node(struct arena *arena, node_t *base, node_t *node,
+	  int view_mask, int do_flag, struct syn_report *rp)
 {
-	node_t	*newp, *np;
-	int	i = 0;
+	node_t	*newp, *np = NULL;
+	int	i;
 
 	if (!base || !node) {
-		fprintf(stderr, "grow_node: empty base or node\n");
+		syntax_error(rp, "grow_node: empty base or node\n");
 		return NULL;
 	}
 
 	/* search if given node match with a child */
-	list_for_each_entry(np, &base->child_list, sibling_list) {
-		if (compare_node(node, np) == 0) {
-			/* XXX OR the node view & do bits */
-			if ((do_flag & DO_FLAG))
-				np->do_view_mask |= view_mask;
-			if ((do_flag & UNDO_FLAG))
-				np->undo_view_mask |= view_mask;
-			dprintf(DBG_TREE, "child[%d] ", i);
-			if ((debug_flag & DBG_TREE))
-				debug_node(".", np, 1);
-
-			return (np);
+	if (node->match_type == MATCH_KEYWORD) {
+		np = get_child_key(base, node->match_ent.keyword);
+	} else {
+		for (i = 0; i < base->other_num; i++) {
+			if (compare_node(node, base->others[i]) == 0) {
+				np = base->others[i];
+				break;
+			}
 		}
-		i++;
+	}
+	if (np != NULL) {
+		/* XXX OR the node view & do bits */
+		if ((do_flag & DO_FLAG))
+			np->do_view_mask |= view_mask;
+		if ((do_flag & UNDO_FLAG))
+			np->undo_view_mask |= view_mask;
+		dprintf(DBG_TREE, "child[%d] ", np->child_order);
+		if ((debug_flag & DBG_TREE))
+			debug_node(".", np, 1);
+
+		return (np);
 	}
 
 	if (base->child_num == MAX_CHILD_NUM) {
-		fprintf(stderr, "grow_node: no free child slot\n");
+		syntax_error(rp, "grow_node: no free child slot\n");
 		return NULL;
 	}
 
 	/* create a child node */
-	if ((newp = malloc(sizeof(node_t))) == NULL) {
-		fprintf(stderr, "grow_node: malloc new node error\n");
+	if ((newp = arena_alloc(arena, sizeof(node_t))) == NULL) {
+		syntax_error(rp, "grow_node: malloc new node error\n");
 		return NULL;
 	}
 	memcpy(newp, node, sizeof(node_t));
@@ -1122,8 +2432,17 @@ grow_node(node_t *base, node_t *node, int view_mask, int do_flag)
 	if ((do_flag & UNDO_FLAG)) newp->undo_view_mask = view_mask;
 	newp->depth = base->depth + 1;
 	newp->parent = base;
+	newp->child_num = 0;
+	newp->leaf = NULL;
+	newp->key_num = newp->other_num = 0;
+	newp->keys = newp->others = NULL;
 	INIT_LIST_HEAD(&newp->child_list);
 
+	if (index_child(arena, base, newp) < 0) {
+		syntax_error(rp, "grow_node: no memory\n");
+		return NULL;
+	}
+
 	dprintf(DBG_TREE, "child[%d] ", base->child_num);
 	if ((debug_flag & DBG_TREE))
 		debug_node("+", newp, 1);
@@ -1136,16 +2455,39 @@ grow_node(node_t *base, node_t *node, int view_mask, int do_flag)
 }
 
 /*
- * get strings from node partialy matches with cmd
+ * get strings from node partialy matches with cmd, no parse memo
  */
 int
 get_node_matches(node_t *node, char *cmd, char **matches, int limit,
 		 int view, int do_flag)
+{
+	return get_node_matches_stat(node, cmd, matches, limit, view, do_flag,
+				     NULL);
+}
+
+/*
+ * get strings from node partialy matches with cmd, which is the last
+ * parsed arg of cmd_stat if cmd_stat present
+ */
+int
+get_node_matches_stat(node_t *node, char *cmd, char **matches, int limit,
+		      int view, int do_flag, cmd_stat_t *cmd_stat)
+{
+	struct arg_lex	al;
+
+	init_arg_lex(&al, cmd, cmd_stat, cmd_stat ? cmd_stat->last_argi : -1);
+	return node_matches(node, cmd, matches, limit, view, do_flag, &al);
+}
+
+static int
+node_matches(node_t *node, char *cmd, char **matches, int limit,
+	     int view, int do_flag, struct arg_lex *al)
 {
 	int	n_match = 0;
 	char	pfx[MAX_WORD_LEN];
 	struct cmd_tree *ent = NULL;
 	struct lex_ent *lex = NULL;
+	int	num;
 
 	/* node NULL, or manual arg var, list all matching commands */
 	if (node == NULL ||
@@ -1153,17 +2495,18 @@ get_node_matches(node_t *node, char *cmd, char **matches, int limit,
 	     NODE_IS_ALLOWED(node, view, do_flag) &&
 	     node->match_ent.var.lex_type == LEX_WORD &&
 	     strcmp(node->arg_name, MANUAL_ARG) == 0)) {
-		list_for_each_entry(ent, &cmd_tree_list, cmd_tree_list) {
+		pthread_rwlock_rdlock(&cmd_lock);
+		for (ent = first_cmd_tree(cmd, &num); num > 0;
+		     ent = next_cmd_tree(ent), num--) {
 			if (ent->tree != NULL &&
-			    NODE_IS_ALLOWED(ent->tree, view, do_flag) &&
-			    (!cmd || !cmd[0] ||
-			     strncmp(cmd, ent->cmd, strlen(cmd)) == 0)) {
+			    NODE_IS_ALLOWED(ent->tree, view, do_flag)) {
 				if (n_match < limit)
 					matches[n_match++] = strdup(ent->cmd);
 				else
 					break;
 			}
 		}
+		pthread_rwlock_unlock(&cmd_lock);
 		return n_match;
 	} 
 
@@ -1184,12 +2527,20 @@ get_node_matches(node_t *node, char *cmd, char **matches, int limit,
 	    NODE_IS_ALLOWED(node, view, do_flag) &&
 	    (lex = get_lex_ent(node->match_ent.var.lex_type))) {
 		if (cmd && cmd[0] && 
-		    !node->arg_helper && limit >= 1 &&
-		    lex->fun(cmd) == 1) {
+		    !node->arg_helper && !lex->set && limit >= 1 &&
+		    match_lex(cmd, node->match_ent.var.lex_type, al)) {
 			matches[0] = strdup(cmd);
 			return 1;
+		} else if (cmd && cmd[0] &&
+			   lex_partial(node->match_ent.var.lex_type, cmd) == 0) {
+			/* cmd can never become the type, skip helper */
+			return 0;
 		} else if (node->arg_helper && limit >= 1) {
 			return node->arg_helper(cmd, matches, limit);
+		} else if (lex->set && limit >= 1) {
+			/* enum values with the prefix */
+			return lex_enum_matches(node->match_ent.var.lex_type,
+						cmd, matches, limit);
 		} else if (lex->prefix[0] &&
 		           (!cmd || !cmd[0] ||
 		           strncmp(lex->prefix, cmd, strlen(cmd)) == 0)) {
@@ -1204,24 +2555,41 @@ get_node_matches(node_t *node, char *cmd, char **matches, int limit,
 }
 
 /*
- * get partially matched strings from all child nodes
+ * get partially matched strings from all child nodes, no parse memo
  */
 int
 get_node_next_matches(node_t *node, char *cmd, char **matches, int limit,
 		      int view, int do_flag)
+{
+	return get_node_next_matches_stat(node, cmd, matches, limit, view,
+					  do_flag, NULL);
+}
+
+/*
+ * get partially matched strings from all child nodes, cmd is the arg
+ * next to the last parsed one of cmd_stat if cmd_stat present
+ */
+int
+get_node_next_matches_stat(node_t *node, char *cmd, char **matches,
+			   int limit, int view, int do_flag, cmd_stat_t *cmd_stat)
 {
 	int	n_match = 0;
 	node_t	*opt = NULL;
 	struct cmd_tree *ent = NULL;
 	node_t	*np, *opt_np;
+	struct arg_lex	al;
 
 	if (!node) return 0;
 
+	init_arg_lex(&al, cmd, cmd_stat,
+		     cmd_stat ? cmd_stat->last_argi + 1 : -1);
+
 	/* if node is UNDO node, list matching commands support undo */
 	if (node->match_type == MATCH_KEYWORD &&
 	    NODE_IS_ALLOWED(node, view, do_flag) && IS_ROOT(node) &&
 	    strcmp(node->match_ent.keyword, UNDO_CMD) == 0 &&
 	    (!cmd || !cmd[0])) {
+		pthread_rwlock_rdlock(&cmd_lock);
 		list_for_each_entry(ent, &cmd_tree_list, cmd_tree_list) {
 			if (ent->tree != NULL &&
 			    NODE_IS_ALLOWED(ent->tree, view, do_flag) &&
@@ -1232,6 +2600,7 @@ get_node_next_matches(node_t *node, char *cmd, char **matches, int limit,
 					break;
 			}
 		}
+		pthread_rwlock_unlock(&cmd_lock);
 		return n_match;
 	}
 
@@ -1240,6 +2609,7 @@ get_node_next_matches(node_t *node, char *cmd, char **matches, int limit,
 	    NODE_IS_ALLOWED(node, view, do_flag) &&
 	    strcmp(node->match_ent.keyword, MANUAL_CMD) == 0 &&
 	    (!cmd || !cmd[0])) {
+		pthread_rwlock_rdlock(&cmd_lock);
 		list_for_each_entry(ent, &cmd_tree_list, cmd_tree_list) {
 			if (ent->tree != NULL &&
 			    NODE_IS_ALLOWED(ent->tree, view, do_flag)) {
@@ -1249,6 +2619,7 @@ get_node_next_matches(node_t *node, char *cmd, char **matches, int limit,
 					break;
 			}
 		}
+		pthread_rwlock_unlock(&cmd_lock);
 		return n_match;
 	}
 
@@ -1267,41 +2638,62 @@ get_node_next_matches(node_t *node, char *cmd, char **matches, int limit,
 
 		if (opt) {
 			list_for_each_entry(opt_np, &opt->child_list, sibling_list) {
-				if (opt_np->opt_mark)
+				if (opt_is_used(cmd_stat, opt_np))
 					continue;
 
-				n_match += get_node_matches(opt_np, cmd,
-							    &matches[n_match], limit - n_match,
-							    view, do_flag);
+				n_match += node_matches(opt_np, cmd,
+							&matches[n_match], limit - n_match,
+							view, do_flag, &al);
 			}
 		}
 
-		n_match += get_node_matches(np, cmd,
-					    &matches[n_match], limit - n_match,
-					    view, do_flag);
+		n_match += node_matches(np, cmd,
+					&matches[n_match], limit - n_match,
+					view, do_flag, &al);
 	}
 	return n_match;
 }
 
 /*
- * get help info from node partialy matches with cmd
+ * get help info from node partialy matches with cmd, no parse memo
  */
 int
 get_node_help(node_t *node, char *cmd, char *buf, int limit,
 	      int view, int do_flag)
+{
+	return get_node_help_stat(node, cmd, buf, limit, view, do_flag, NULL);
+}
+
+/*
+ * get help info from node partialy matches with cmd, which is the last
+ * parsed arg of cmd_stat if cmd_stat present
+ */
+int
+get_node_help_stat(node_t *node, char *cmd, char *buf, int limit,
+		   int view, int do_flag, cmd_stat_t *cmd_stat)
+{
+	struct arg_lex	al;
+
+	init_arg_lex(&al, cmd, cmd_stat, cmd_stat ? cmd_stat->last_argi : -1);
+	return node_help(node, cmd, buf, limit, view, do_flag, &al);
+}
+
+static int
+node_help(node_t *node, char *cmd, char *buf, int limit,
+	  int view, int do_flag, struct arg_lex *al)
 {
 	struct cmd_tree *ent = NULL;
 	struct lex_ent *lex = NULL;
 	char	*ptr = buf;
-	int	len = 0;
+	int	len = 0, num;
 
 	/* node NULL, list all matching commands */
 	if (node == NULL) {
-		list_for_each_entry(ent, &cmd_tree_list, cmd_tree_list) {
+		pthread_rwlock_rdlock(&cmd_lock);
+		for (ent = first_cmd_tree(cmd, &num); num > 0;
+		     ent = next_cmd_tree(ent), num--) {
 			if (ent->tree != NULL &&
-			    NODE_IS_ALLOWED(ent->tree, view, do_flag) &&
-			    (!cmd || !cmd[0] ||
-			     strncmp(cmd, ent->cmd, strlen(cmd)) == 0)) {
+			    NODE_IS_ALLOWED(ent->tree, view, do_flag)) {
 				len = snprintf(ptr, limit, "  %-22s - %s\n",
 					       ent->cmd, ent->tree->help);
 				ptr += len;
@@ -1309,6 +2701,7 @@ get_node_help(node_t *node, char *cmd, char *buf, int limit,
 				if (limit < 32) break;
 			}
 		}
+		pthread_rwlock_unlock(&cmd_lock);
 		return (ptr - buf);
 	} 
 
@@ -1329,9 +2722,10 @@ get_node_help(node_t *node, char *cmd, char *buf, int limit,
 	    NODE_IS_ALLOWED(node, view, do_flag) &&
 	    (lex = get_lex_ent(node->match_ent.var.lex_type))) {
 		if (!cmd || !cmd[0] ||
-		    lex->fun(cmd) == 1 ||
+		    match_lex(cmd, node->match_ent.var.lex_type, al) ||
 		    (lex->prefix[0] && 
-		     strncmp(cmd, lex->prefix, strlen(cmd)) == 0)) {
+		     strncmp(cmd, lex->prefix, strlen(cmd)) == 0) ||
+		    lex_partial(node->match_ent.var.lex_type, cmd) == 1) {
 			len = snprintf(ptr, limit, "  %-22s - %s\n",
 				       lex->help, node->help);
 			ptr += len;
@@ -1354,29 +2748,46 @@ get_node_help(node_t *node, char *cmd, char *buf, int limit,
 }
 
 /*
- * get help strings from all child nodes
+ * get help strings from all child nodes, no parse memo
  */
 int
 get_node_next_help(node_t *node, char *cmd, char *buf, int limit,
 		   int view, int do_flag)
+{
+	return get_node_next_help_stat(node, cmd, buf, limit, view,
+				       do_flag, NULL);
+}
+
+/*
+ * get help strings from all child nodes, cmd is the arg next to the
+ * last parsed one of cmd_stat if cmd_stat present
+ */
+int
+get_node_next_help_stat(node_t *node, char *cmd, char *buf, int limit,
+			int view, int do_flag, cmd_stat_t *cmd_stat)
 {
 	char	*ptr = buf;
-	int	len = 0;
+	int	len = 0, num;
+	int	end_listed = 0;
 	node_t	*opt = NULL;
 	struct cmd_tree *ent = NULL;
 	node_t	*np, *opt_np;
+	struct arg_lex	al;
 
 	if (!node) return 0;
 
+	init_arg_lex(&al, cmd, cmd_stat,
+		     cmd_stat ? cmd_stat->last_argi + 1 : -1);
+
 	/* if node is UNDO node, list matching commands support undo */
 	if (node->match_type == MATCH_KEYWORD &&
 	    NODE_IS_ALLOWED(node, view, do_flag) && IS_ROOT(node) &&
 	    strcmp(node->match_ent.keyword, UNDO_CMD) == 0) {
-		list_for_each_entry(ent, &cmd_tree_list, cmd_tree_list) {
+		pthread_rwlock_rdlock(&cmd_lock);
+		for (ent = first_cmd_tree(cmd, &num); num > 0;
+		     ent = next_cmd_tree(ent), num--) {
 			if (ent->tree != NULL &&
 			    NODE_IS_ALLOWED(ent->tree, view, do_flag) &&
-			    (!cmd || !cmd[0] ||
-			     strncmp(cmd, ent->cmd, strlen(cmd)) == 0) &&
 			    strcmp(ent->cmd, UNDO_CMD) != 0) {
 				len = snprintf(ptr, limit, "  %-22s - %s\n",
 					       ent->cmd, ent->tree->help);
@@ -1385,6 +2796,7 @@ get_node_next_help(node_t *node, char *cmd, char *buf, int limit,
 				if (limit < 32) break;
 			}
 		}
+		pthread_rwlock_unlock(&cmd_lock);
 		return (ptr - buf);
 	}
 
@@ -1392,31 +2804,31 @@ get_node_next_help(node_t *node, char *cmd, char *buf, int limit,
 		node = node->alt_head;
 
 	list_for_each_entry(np, &node->child_list, sibling_list) {
+		/* the opt group of an opt end is listed only once */
 		if (np->match_type == MATCH_OPT_HEAD)
 			opt = np;
-		else if (node->opt_head)
+		else if (node->opt_head && !end_listed++)
 			opt = node->opt_head;
 		else
 			opt = NULL;
 
 		if (opt) {
 			list_for_each_entry(opt_np, &opt->child_list, sibling_list) {
-				if (opt_np->opt_mark)
+				if (opt_is_used(cmd_stat, opt_np))
 					continue;
 
-				len = get_node_help(opt_np, cmd,
-						    ptr, limit,
-						    view, do_flag);
-				opt_np->opt_mark = 1;
+				len = node_help(opt_np, cmd,
+						ptr, limit,
+						view, do_flag, &al);
 				ptr += len;
 				limit -= len;
 				if (limit < 32) goto out;
 			}
 		}
 
-		len = get_node_help(np, cmd,
-				    ptr, limit,
-				    view, do_flag);
+		len = node_help(np, cmd,
+				ptr, limit,
+				view, do_flag, &al);
 		ptr += len;
 		limit -= len;
 		if (limit < 32) break;
@@ -1461,11 +2873,9 @@ node_has_leaf(node_t *node, int view, int do_flag)
 
 	/* search if given node has a matching leaf */
 	do {
-		list_for_each_entry(np, &node->child_list, sibling_list) {
-			if (IS_LEAF(np) &&
-			    NODE_IS_ALLOWED(np, view, do_flag)) {
-				return 1;
-			}
+		if ((np = node->leaf) != NULL &&
+		    NODE_IS_ALLOWED(np, view, do_flag)) {
+			return 1;
 		}
 	} while (--max_tries >= 1 && (node = node->alt_head) != NULL);
 
@@ -1489,6 +2899,11 @@ node_has_only_leaf(node_t *node, int view, int do_flag)
 	if (!NODE_IS_ALLOWED(node, view, do_flag))
 		return 0;
 
+	if (!node->leaf || !NODE_IS_ALLOWED(node->leaf, view, do_flag))
+		return 0;
+	if (node->child_num == 1)
+		return 1;
+
 	list_for_each_entry(np, &node->child_list, sibling_list) {
 		if (NODE_IS_ALLOWED(np, view, do_flag)) {
 			child_cnt++;
@@ -1504,295 +2919,1208 @@ node_has_only_leaf(node_t *node, int view, int do_flag)
 }
 
 /*
- * try to get next matching node
+ * match arg with children of parent, keywords by the index. at top level
+ * used children of an opt head are skipped, and opt head children are
+ * dived into to try their first layer. return 1 if a keyword matches
+ * exactly, which is set back to *first, else add up partial matches.
+ */
+static int
+match_children(node_t *parent, char *arg, int top, int view, int do_flag,
+	       struct arg_lex *al, cmd_stat_t *cmd_stat, node_t **first,
+	       node_t **candidate, int *n_match)
+{
+	node_t	*np, *exact;
+	int	i, len = strlen(arg);
+	int	is_opt = (parent->match_type == MATCH_OPT_HEAD);
+	int	skip = (top && is_opt);
+
+	exact = get_child_key(parent, arg);
+	if (exact && ((skip && opt_is_used(cmd_stat, exact)) ||
+		      !NODE_IS_ALLOWED(exact, view, do_flag)))
+		exact = NULL;
+
+	/* an opt group before the exact keyword may hold one too */
+	for (i = 0; i < parent->other_num; i++) {
+		np = parent->others[i];
+		if (exact && np->child_order > exact->child_order)
+			break;
+
+		if (np->match_type == MATCH_OPT_HEAD) {
+			if (top && match_children(np, arg, 0, view, do_flag,
+						  al, cmd_stat, first,
+						  candidate, n_match))
+				return 1;
+			continue;
+		}
+		if (skip && opt_is_used(cmd_stat, np))
+			continue;
+
+		if (match_node(np, arg, view, do_flag, al)) {
+			if (*first == NULL) {
+				*first = np;
+				if (is_opt)
+					*candidate = np;
+			}
+			(*n_match)++;
+		}
+	}
+
+	if (exact) {
+		*first = exact;
+		*candidate = NULL;
+		if (is_opt)
+			set_opt_used(cmd_stat, exact);
+		return 1;
+	}
+
+	/* keywords starting with arg */
+	for (i = key_lower(parent, arg); i < parent->key_num; i++) {
+		np = parent->keys[i];
+		if (strncmp(np->match_ent.keyword, arg, len) != 0)
+			break;
+		if ((skip && opt_is_used(cmd_stat, np)) ||
+		    !NODE_IS_ALLOWED(np, view, do_flag))
+			continue;
+
+		if (*first == NULL) {
+			*first = np;
+			if (is_opt)
+				*candidate = np;
+		}
+		(*n_match)++;
+	}
+	return 0;
+}
+
+/*
+ * try to get next matching node
+ */
+static int
+get_next_node(node_t *node, node_t **next, char *arg, int view, int do_flag,
+	      cmd_stat_t *cmd_stat, int argi)
+{
+	node_t	*first = NULL;
+	node_t	*candidate = NULL;
+	int	max_tries = 2;
+	int	n_match = 0;
+	struct arg_lex	al;
+
+	if (!node || !arg || !arg[0]) {
+		fprintf(stderr, "match_next_node: empty node\n");
+		return -1;
+	}
+
+	init_arg_lex(&al, arg, cmd_stat, argi);
+
+	/* for alt younger silbings, always backtrack to eldest */
+	if (node->alt_head)
+		node = node->alt_head;
+
+	/*
+	 * search if given node match a next slot.
+	 * 2 tries might be needed when going through option nodes.
+	 */
+	while (node && max_tries > 0) {
+		if (match_children(node, arg, 1, view, do_flag, &al, cmd_stat,
+				   &first, &candidate, &n_match)) {
+			n_match = 1;
+			goto out;
+		}
+
+		max_tries--;
+
+		/* for opt end node, backtrack to opt head and try one more loop */
+		if (!node->opt_head)
+			break;
+		else
+			node = node->opt_head;
+	}
+
+out:
+	/* partialy but uniquely matched option, mark used flag */
+	if (n_match == 1 && candidate) {
+		set_opt_used(cmd_stat, candidate);
+	}
+
+	*next = first;
+	return n_match;
+}
+
+/*
+ * display debug info of command trees. lazy trees are built first, with
+ * the write lock of cmd_lock held.
+ */
+void
+debug_cmd_tree(char *cmd)
+{
+	struct cmd_tree *ent;
+	struct manual *man;
+	node_t	*path[MAX_ARG_NUM + 1];
+	int	i = 0, lazy = 0;
+
+	fprintf(stderr, "cmd_tree = {\n");
+	pthread_rwlock_rdlock(&cmd_lock);
+	list_for_each_entry(ent, &cmd_tree_list, cmd_tree_list) {
+		if ((cmd == NULL || strcmp(cmd, ent->cmd) == 0) &&
+		    __atomic_load_n(&ent->lazy, __ATOMIC_ACQUIRE)) {
+			lazy = 1;
+			break;
+		}
+	}
+	if (lazy) {
+		pthread_rwlock_unlock(&cmd_lock);
+		pthread_rwlock_wrlock(&cmd_lock);
+	}
+
+	list_for_each_entry(ent, &cmd_tree_list, cmd_tree_list) {
+		if (cmd == NULL || strcmp(cmd, ent->cmd) == 0) {
+			fprintf(stderr, "[%d] %s\n",i,  ent->cmd);
+			list_for_each_entry(man,
+					    &ent->manual_list,
+					    manual_list) {
+				fprintf(stderr, "    %s\n", man->text);
+			}
+			fprintf(stderr, "    -->\n");
+			if (lazy) build_cmd_tree(ent);
+			debug_tree(ent->tree, &path[0], 0);
+			fprintf(stderr, "\n");
+			if (cmd) break;
+		}
+		i++;
+	}
+	pthread_rwlock_unlock(&cmd_lock);
+	fprintf(stderr, "}\n");
+}
+
+/*
+ * display debug info of one syntax tree node
+ */
+void
+debug_node(char *info, node_t *node, int less)
+{
+	struct lex_ent *lex;
+
+	if (node == NULL) return;
+
+	if (info && *info) fprintf(stderr, "%s: ", info);
+	fprintf(stderr, "node<%p>={", node);
+
+	if (node->match_type == MATCH_KEYWORD) {
+		fprintf(stderr, "key:%s=\'%s\',",
+			node->arg_name,
+			node->match_ent.keyword);
+	} else if (node->match_type == MATCH_VAR) {
+		lex = get_lex_ent(node->match_ent.var.lex_type);
+		fprintf(stderr, "var:%s=%s,",
+			node->arg_name,
+			lex ? lex->name:"N/A");
+		if (!less && node->match_ent.var.chk_range == RANGE_INT)
+			fprintf(stderr, "min=%lld,max=%lld,",
+				(long long) node->match_ent.var.min_ival.i,
+				(long long) node->match_ent.var.max_ival.i);
+		else if (!less && node->match_ent.var.chk_range == RANGE_UINT)
+			fprintf(stderr, "min=%llu,max=%llu,",
+				(unsigned long long) node->match_ent.var.min_ival.u,
+				(unsigned long long) node->match_ent.var.max_ival.u);
+		else if (!less && node->match_ent.var.chk_range)
+			fprintf(stderr, "min=%.2f,max=%.2f,",
+				node->match_ent.var.min_val,
+				node->match_ent.var.max_val);
+	} else if (node->match_type == MATCH_LEAF) {
+		fprintf(stderr, "leaf:=<LF>,");
+	} else if (node->match_type == MATCH_OPT_HEAD) {
+		fprintf(stderr, "opt:=<HEAD>,");
+	} else {
+		fprintf(stderr, "unknown<%d>,", node->match_type);
+	}
+
+	if (!less && node->help[0])
+		fprintf(stderr, "help=\'%s\',", node->help);
+
+	if (node->alt_order)
+		fprintf(stderr, "alt=%d,", node->alt_order);
+
+	if (node->opt_head)
+		fprintf(stderr, "opt=END,");
+
+	fprintf(stderr, "do_view=0x%x,undo_view=0x%x,depth=%d,bnum=%d}\n",
+		node->do_view_mask, node->undo_view_mask,
+		node->depth, node->child_num);
+}
+
+/*
+ * sprout nodes besides each leaf recursively
+ */
+static void
+sprout_tree(struct arena *arena, node_t *tree, node_t **nodes, int num,
+	    int view_mask, int do_flag, struct syn_report *rp)
+{
+	node_t	*base = NULL;
+	node_t	*np;
+
+	if (!tree) return;
+
+	/* search if given node has a leaf */
+	list_for_each_entry(np, &tree->child_list, sibling_list) {
+		if (IS_LEAF(np)) {
+			if (base == NULL)
+				base = tree;
+		} else {
+			sprout_tree(arena, np, nodes, num,
+				    view_mask, do_flag, rp);
+		}
+	}
+
+	/* only sprout for view_mask matching node */
+	if (base != NULL) {
+		if ((do_flag & DO_FLAG) && base->do_view_mask != view_mask)
+			return;
+		if ((do_flag & UNDO_FLAG) && tree->undo_view_mask != view_mask)
+			return;
+		grow_tree(arena, base, nodes, num, view_mask, do_flag, rp);
+	}
+}
+
+/*
+ * debug tree paths recursively
+ */
+static void
+debug_tree(node_t *tree, node_t **path, int len)
+{
+	int	i;
+	node_t	*node, *np;
+	struct lex_ent *lex;
+
+	if (!tree) return;
+
+	if (len < MAX_ARG_NUM) {
+		path[len++] = tree;
+	}
+
+	if (tree->alt_head) {
+		list_for_each_entry(np, &tree->alt_head->child_list, sibling_list) {
+			debug_tree(np, path, len);
+		}
+	} else if (tree->child_num == 0) {
+		fprintf(stderr, "    ");
+		for (i = 0; i < len; i++) {
+			if ((node = path[i]) == NULL)
+				continue;
+			if (node->match_type == MATCH_KEYWORD) {
+				fprintf(stderr, "%s ",
+					node->match_ent.keyword);
+			} else if (node->match_type == MATCH_VAR) {
+				lex = get_lex_ent(node->match_ent.var.lex_type);
+				fprintf(stderr, "%s ",
+					lex ? lex->name:"N/A");
+			} else if (node->match_type == MATCH_LEAF)
+				fprintf(stderr, "<LF>");
+
+			if (node->match_type == MATCH_OPT_HEAD)
+				fprintf(stderr, "[ ");
+			else if (node->opt_head)
+				fprintf(stderr, "] ");
+			else if (node->alt_head && node->alt_head->opt_head)
+				fprintf(stderr, "] ");
+		}
+		fprintf(stderr, "    \n");
+	} else {
+		list_for_each_entry(np, &tree->child_list, sibling_list) {
+			debug_tree(np, path, len);
+		}
+	}
+}
+
+/*
+ * count nodes and index entries of tree
+ */
+static void
+count_tree(node_t *tree, size_t *nodes, size_t *ents)
+{
+	node_t	*np;
+
+	*nodes += 1;
+	*ents += tree->key_num + tree->other_num;
+
+	list_for_each_entry(np, &tree->child_list, sibling_list) {
+		count_tree(np, nodes, ents);
+	}
+}
+
+/*
+ * copy tree depth first to *node_pos on. the parent of each source node
+ * is then set to its copy, for relink_tree() to follow.
+ */
+static node_t *
+copy_tree(node_t *tree, node_t *parent, node_t **node_pos)
+{
+	node_t	*newp = (*node_pos)++;
+	node_t	*np;
+
+	memcpy(newp, tree, sizeof(node_t));
+	newp->parent = parent;
+	INIT_LIST_HEAD(&newp->child_list);
+	if (parent)
+		list_add_tail(&newp->sibling_list, &parent->child_list);
+	else
+		INIT_LIST_HEAD(&newp->sibling_list);
+	tree->parent = newp;
+
+	list_for_each_entry(np, &tree->child_list, sibling_list) {
+		copy_tree(np, newp, node_pos);
+	}
+	return newp;
+}
+
+#define	COPY_OF(np)	((np) ? (np)->parent : NULL)
+
+/*
+ * point links of copied tree to the copies, and copy its index arrays
+ * to *ent_pos on
+ */
+static void
+relink_tree(node_t *tree, node_t ***ent_pos)
+{
+	node_t	*np;
+	int	i;
+
+	tree->opt_head = COPY_OF(tree->opt_head);
+	tree->alt_head = COPY_OF(tree->alt_head);
+	tree->leaf = COPY_OF(tree->leaf);
+
+	for (i = 0; i < tree->key_num; i++)
+		(*ent_pos)[i] = COPY_OF(tree->keys[i]);
+	tree->keys = tree->key_num ? *ent_pos : NULL;
+	*ent_pos += tree->key_num;
+
+	for (i = 0; i < tree->other_num; i++)
+		(*ent_pos)[i] = COPY_OF(tree->others[i]);
+	tree->others = tree->other_num ? *ent_pos : NULL;
+	*ent_pos += tree->other_num;
+
+	list_for_each_entry(np, &tree->child_list, sibling_list) {
+		relink_tree(np, ent_pos);
+	}
+}
+
+/*
+ * freeze syntax trees after all commands are registered. nodes of all
+ * trees are compacted into one image in depth first order, with their
+ * index arrays behind, the image is made read only, and the registration
+ * arenas are retired, to be freed after the parses which may hold their
+ * nodes are cleaned up. from then on commands, symbols, syntaxes and arg
+ * helpers are refused. it must not race with registration calls.
+ */
+int
+ocli_freeze(void)
+{
+	struct cmd_tree *ent, **husks = NULL;
+	size_t	nodes = 0, ents = 0, size;
+	node_t	*node_pos, **ent_pos;
+	node_t	*root;
+	char	*image = NULL;
+	int	i, num = 0;
+
+	if (!olic_core_init_ok) {
+		fprintf(stderr, "ocli_freeze: core not initialized\n");
+		return -1;
+	}
+	if (OCLI_FROZEN()) return 0;
+
+	/* a loaded image is compact already, functions are bound now */
+	if (ocli_loaded) {
+		if (reg_hash != image_reg_hash) {
+			fprintf(stderr, "ocli_freeze: commands registered differ "
+				"from the syntax image, image discarded, "
+				"register them again\n");
+			drop_image();
+			return -1;
+		}
+		if (mprotect(frozen_image, frozen_size, PROT_READ) < 0)
+			fprintf(stderr, "ocli_freeze: mprotect: %s\n",
+				strerror(errno));
+		ocli_loaded = 0;
+		__atomic_store_n(&ocli_frozen, 1, __ATOMIC_RELEASE);
+		return 0;
+	}
+
+	/* parses may go on, with lookups blocked until trees are swapped */
+	pthread_rwlock_wrlock(&cmd_lock);
+	list_for_each_entry(ent, &cmd_tree_list, cmd_tree_list) {
+		build_cmd_tree(ent);
+		count_tree(ent->tree, &nodes, &ents);
+		num++;
+	}
+
+	/* husks carry the arenas to rcu_retire() */
+	if (num > 0 &&
+	    (husks = calloc(num, sizeof(struct cmd_tree *))) == NULL)
+		goto no_mem;
+	for (i = 0; i < num; i++) {
+		if ((husks[i] = calloc(1, sizeof(struct cmd_tree))) == NULL)
+			goto no_mem;
+		INIT_LIST_HEAD(&husks[i]->manual_list);
+	}
+
+	size = nodes * sizeof(node_t) + ents * sizeof(node_t *);
+	if (size > 0) {
+		image = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (image == MAP_FAILED)
+			goto no_mem;
+	}
+
+	node_pos = (node_t *) image;
+	ent_pos = (node_t **) (image + nodes * sizeof(node_t));
+
+	/* copy_tree() marks source nodes by parent, not followed by parses */
+	i = 0;
+	list_for_each_entry(ent, &cmd_tree_list, cmd_tree_list) {
+		root = copy_tree(ent->tree, NULL, &node_pos);
+		relink_tree(root, &ent_pos);
+		memcpy(husks[i]->cmd, ent->cmd, MAX_WORD_LEN);
+		husks[i]->arena = ent->arena;
+		/* the image keeps the strings, until free_intern_strs() */
+		husks[i++]->arena.strs = NULL;
+		bzero(&ent->arena, sizeof(ent->arena));
+		INIT_LIST_HEAD(&ent->symbol_list);
+		/* a parse holding ent reads the old tree, or the new one */
+		__atomic_store_n(&ent->tree, root, __ATOMIC_RELEASE);
+	}
+	dprintf(DBG_TREE, "frozen %zu nodes, %zu bytes\n", nodes, size);
+
+	/* parsing never writes to trees, make a stray write fault */
+	if (image && mprotect(image, size, PROT_READ) < 0)
+		fprintf(stderr, "ocli_freeze: mprotect: %s\n", strerror(errno));
+
+	frozen_image = image;
+	frozen_size = size;
+	frozen_nodes = (node_t *) image;
+	frozen_node_num = nodes;
+	frozen_ent_num = ents;
+	__atomic_store_n(&ocli_frozen, 1, __ATOMIC_RELEASE);
+	pthread_rwlock_unlock(&cmd_lock);
+
+	for (i = 0; i < num; i++)
+		rcu_retire(husks[i]);
+	free(husks);
+	return 0;
+
+no_mem:
+	pthread_rwlock_unlock(&cmd_lock);
+	for (i = 0; husks && i < num; i++)
+		free(husks[i]);
+	free(husks);
+	fprintf(stderr, "ocli_freeze: no memory for %zu nodes\n", nodes);
+	return -1;
+}
+
+/*
+ * are syntax trees frozen ?
+ */
+int
+ocli_is_frozen(void)
+{
+	return OCLI_FROZEN();
+}
+
+/*
+ * syntax image file, the frozen nodes and index entries with pointers
+ * turned into offsets from the start of file, 0 for NULL:
+ *	header | commands | manuals | nodes | index entries | strings
+ */
+#define	IMAGE_MAGIC	"OCLIIMG"
+#define	IMAGE_VERSION	2
+#define	IMAGE_ORDER	0x01020304
+
+struct image_hdr {
+	char	magic[8];		/* IMAGE_MAGIC */
+	u_int	version;		/* IMAGE_VERSION */
+	u_int	byte_order;		/* IMAGE_ORDER of writer */
+	u_int	node_size;		/* sizeof(node_t) of writer */
+	u_int	ptr_size;		/* sizeof(void *) of writer */
+	u_int64_t grammar_hash;		/* given by application */
+	u_int64_t reg_hash;		/* of registration calls */
+	u_int64_t size;			/* size of image file */
+	u_int64_t cmd_off;		/* array of struct image_cmd */
+	u_int64_t cmd_num;
+	u_int64_t man_off;		/* array of struct image_man */
+	u_int64_t man_num;
+	u_int64_t node_off;		/* nodes, index entries behind */
+	u_int64_t node_num;
+	u_int64_t ent_num;
+	u_int64_t str_off;		/* string pool, NUL terminated */
+	u_int64_t str_size;
+};
+
+struct image_cmd {
+	char	cmd[MAX_WORD_LEN];	/* command name */
+	u_int64_t tree;			/* root node */
+	u_int64_t man_num;		/* manuals of command, in a row */
+};
+
+struct image_man {
+	u_int64_t text;			/* manual text in string pool */
+	u_int64_t view_mask;		/* the view mask of manual */
+};
+
+#define	IMAGE_ALIGN(x)	(((x) + ARENA_ALIGN - 1) & ~((u_int64_t) ARENA_ALIGN - 1))
+
+/*
+ * string pool of image, strings are interned or manual texts, so they
+ * are looked up by address
+ */
+struct image_strs {
+	const char **strs;		/* sorted by address */
+	u_int64_t *offs;		/* offset of each in pool */
+	size_t	num;
+	size_t	max;
+};
+
+static int
+image_str_cmp(const void *a, const void *b)
+{
+	const char *x = *(const char **) a, *y = *(const char **) b;
+
+	return (x < y) ? -1 : (x > y);
+}
+
+static int
+image_add_str(struct image_strs *is, const char *str)
+{
+	const char **strs;
+
+	if (!str) return 0;
+	if (is->num == is->max) {
+		is->max = is->max ? is->max * 2 : 256;
+		if ((strs = realloc(is->strs, is->max * sizeof(char *))) == NULL)
+			return -1;
+		is->strs = strs;
+	}
+	is->strs[is->num++] = str;
+	return 0;
+}
+
+static u_int64_t
+image_str_off(struct image_strs *is, const char *str)
+{
+	const char **pos;
+
+	if (!str) return 0;
+	pos = bsearch(&str, is->strs, is->num, sizeof(char *), image_str_cmp);
+	return pos ? is->offs[pos - is->strs] : 0;
+}
+
+/*
+ * save frozen syntax trees, with manuals, to a syntax image file. the
+ * file is written aside and renamed, so readers never see a partial one.
+ * return 0 if OK, or -1 on error.
+ */
+int
+ocli_save_image(char *path, u_int64_t grammar_hash)
+{
+	struct image_strs is;
+	struct image_hdr *hdr;
+	struct image_cmd *ic;
+	struct image_man *im;
+	struct cmd_tree *ent;
+	struct manual *man;
+	node_t	*np, **ents;
+	char	*image = NULL, *pool;
+	char	tmp[MAX_LINE_LEN];
+	size_t	i, j, n, size, ent_num, cmd_num = 0, man_num = 0;
+	FILE	*fp;
+	int	res = -1;
+
+	if (!path || !path[0]) {
+		fprintf(stderr, "ocli_save_image: bad parm\n");
+		return -1;
+	}
+	if (!OCLI_FROZEN()) {
+		fprintf(stderr, "ocli_save_image: syntax trees not frozen\n");
+		return -1;
+	}
+
+	bzero(&is, sizeof(is));
+	ents = (node_t **) (frozen_nodes + frozen_node_num);
+	ent_num = frozen_ent_num;
+
+	for (i = 0; i < frozen_node_num; i++) {
+		np = &frozen_nodes[i];
+		if ((np->match_type != MATCH_VAR &&
+		     image_add_str(&is, np->match_ent.keyword) < 0) ||
+		    image_add_str(&is, np->arg_name) < 0 ||
+		    image_add_str(&is, np->help) < 0)
+			goto nomem;
+	}
+	list_for_each_entry(ent, &cmd_tree_list, cmd_tree_list) {
+		cmd_num++;
+		list_for_each_entry(man, &ent->manual_list, manual_list) {
+			if (image_add_str(&is, man->text) < 0)
+				goto nomem;
+			man_num++;
+		}
+	}
+
+	/* unique strings, and lay out the pool */
+	if (is.num)
+		qsort(is.strs, is.num, sizeof(char *), image_str_cmp);
+	for (i = j = 0; i < is.num; i++) {
+		if (j == 0 || is.strs[i] != is.strs[j - 1])
+			is.strs[j++] = is.strs[i];
+	}
+	is.num = j;
+	if (is.num && (is.offs = malloc(is.num * sizeof(u_int64_t))) == NULL)
+		goto nomem;
+
+	size = IMAGE_ALIGN(sizeof(struct image_hdr));
+	size += IMAGE_ALIGN(cmd_num * sizeof(struct image_cmd));
+	size += IMAGE_ALIGN(man_num * sizeof(struct image_man));
+	n = size;	/* node_off */
+	size += frozen_node_num * sizeof(node_t) + ent_num * sizeof(node_t *);
+	for (i = 0; i < is.num; i++) {
+		is.offs[i] = size;
+		size += strlen(is.strs[i]) + 1;
+	}
+
+	if ((image = malloc(size)) == NULL)
+		goto nomem;
+	bzero(image, size);
+
+	hdr = (struct image_hdr *) image;
+	memcpy(hdr->magic, IMAGE_MAGIC, sizeof(hdr->magic));
+	hdr->version = IMAGE_VERSION;
+	hdr->byte_order = IMAGE_ORDER;
+	hdr->node_size = sizeof(node_t);
+	hdr->ptr_size = sizeof(void *);
+	hdr->grammar_hash = grammar_hash;
+	hdr->reg_hash = reg_hash;
+	hdr->size = size;
+	hdr->cmd_off = IMAGE_ALIGN(sizeof(struct image_hdr));
+	hdr->cmd_num = cmd_num;
+	hdr->man_off = hdr->cmd_off +
+		       IMAGE_ALIGN(cmd_num * sizeof(struct image_cmd));
+	hdr->man_num = man_num;
+	hdr->node_off = n;
+	hdr->node_num = frozen_node_num;
+	hdr->ent_num = ent_num;
+	hdr->str_off = n + frozen_node_num * sizeof(node_t) +
+		       ent_num * sizeof(node_t *);
+	hdr->str_size = size - hdr->str_off;
+
+#define	IMAGE_OFF(p)	((p) ? (u_int64_t) ((char *) (p) - \
+			 (char *) frozen_nodes) + hdr->node_off : 0)
+#define	IMAGE_PTR(t, off)	((t) (uintptr_t) (off))
+
+	ic = (struct image_cmd *) (image + hdr->cmd_off);
+	im = (struct image_man *) (image + hdr->man_off);
+	list_for_each_entry(ent, &cmd_tree_list, cmd_tree_list) {
+		memcpy(ic->cmd, ent->cmd, MAX_WORD_LEN);
+		ic->tree = IMAGE_OFF(ent->tree);
+		list_for_each_entry(man, &ent->manual_list, manual_list) {
+			im->text = image_str_off(&is, man->text);
+			im->view_mask = man->view_mask;
+			ic->man_num++;
+			im++;
+		}
+		ic++;
+	}
+
+	np = (node_t *) (image + hdr->node_off);
+	memcpy(np, frozen_nodes, frozen_node_num * sizeof(node_t));
+	for (i = 0; i < frozen_node_num; i++, np++) {
+		if (np->match_type != MATCH_VAR)
+			np->match_ent.keyword = IMAGE_PTR(const char *,
+				image_str_off(&is, np->match_ent.keyword));
+		np->arg_name = IMAGE_PTR(const char *,
+					 image_str_off(&is, np->arg_name));
+		np->help = IMAGE_PTR(const char *, image_str_off(&is, np->help));
+		np->arg_helper = NULL;
+		np->opt_head = IMAGE_PTR(node_t *, IMAGE_OFF(np->opt_head));
+		np->alt_head = IMAGE_PTR(node_t *, IMAGE_OFF(np->alt_head));
+		np->keys = IMAGE_PTR(node_t **, IMAGE_OFF(np->keys));
+		np->others = IMAGE_PTR(node_t **, IMAGE_OFF(np->others));
+		np->leaf = IMAGE_PTR(node_t *, IMAGE_OFF(np->leaf));
+		np->parent = IMAGE_PTR(node_t *, IMAGE_OFF(np->parent));
+		np->child_list.next = IMAGE_PTR(struct list_head *,
+						IMAGE_OFF(np->child_list.next));
+		np->child_list.prev = IMAGE_PTR(struct list_head *,
+						IMAGE_OFF(np->child_list.prev));
+		np->sibling_list.next = IMAGE_PTR(struct list_head *,
+						IMAGE_OFF(np->sibling_list.next));
+		np->sibling_list.prev = IMAGE_PTR(struct list_head *,
+						IMAGE_OFF(np->sibling_list.prev));
+	}
+	for (i = 0; i < ent_num; i++)
+		((node_t **) np)[i] = IMAGE_PTR(node_t *, IMAGE_OFF(ents[i]));
+
+	pool = image + hdr->str_off;
+	for (i = 0; i < is.num; i++) {
+		n = strlen(is.strs[i]) + 1;
+		memcpy(pool, is.strs[i], n);
+		pool += n;
+	}
+
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int) getpid());
+	if ((fp = fopen(tmp, "w")) == NULL) {
+		fprintf(stderr, "ocli_save_image: open %s: %s\n",
+			tmp, strerror(errno));
+		goto out;
+	}
+	n = fwrite(image, size, 1, fp);
+	if (fclose(fp) != 0 || n != 1) {
+		fprintf(stderr, "ocli_save_image: write %s: %s\n",
+			tmp, strerror(errno));
+		unlink(tmp);
+		goto out;
+	}
+	if (rename(tmp, path) < 0) {
+		fprintf(stderr, "ocli_save_image: rename %s: %s\n",
+			path, strerror(errno));
+		unlink(tmp);
+		goto out;
+	}
+	dprintf(DBG_TREE, "saved %zu nodes, %zu bytes to %s\n",
+		frozen_node_num, size, path);
+	res = 0;
+	goto out;
+
+nomem:
+	fprintf(stderr, "ocli_save_image: no memory\n");
+out:
+	free(image);
+	free(is.strs);
+	free(is.offs);
+	return res;
+}
+
+/*
+ * address in image of offset, which must be 0 for NULL, or inside
+ * [lo, hi) at skew of unit. *bad is set if not.
  */
-static int
-get_next_node(node_t *node, node_t **next, char *arg, int view, int do_flag)
+static char *
+image_addr(char *image, u_int64_t off, u_int64_t lo, u_int64_t hi,
+	   size_t unit, size_t skew, int *bad)
 {
-	int	res;
-	node_t	*first = NULL, *opt = NULL;
-	int	*mark_candidate = NULL;
-	int	max_tries = 2;
-	int	n_match = 0;
-	node_t	*np, *opt_np;
-
-	if (!node || !arg || !arg[0]) {
-		fprintf(stderr, "match_next_node: empty node\n");
-		return -1;
+	if (off == 0) return NULL;
+	if (off < lo || off >= hi || (off - lo) % unit != skew) {
+		*bad = 1;
+		return NULL;
 	}
+	return image + off;
+}
 
-	/* for alt younger silbings, always backtrack to eldest */
-	if (node->alt_head)
-		node = node->alt_head;
+/*
+ * address in image of list head, which is the child_list or the
+ * sibling_list of a node in [lo, hi). *bad is set if not.
+ */
+static struct list_head *
+image_list(char *image, u_int64_t off, u_int64_t lo, u_int64_t hi, int *bad)
+{
+	size_t	skew;
 
-	/*
-	 * search if given node match a next slot.
-	 * 2 tries might be needed when going through option nodes.
-	 */
-	while (node && max_tries > 0) {
+	if (off < lo || off >= hi) {
+		*bad = 1;
+		return NULL;
+	}
+	skew = (off - lo) % sizeof(node_t);
+	if (skew != offsetof(node_t, child_list) &&
+	    skew != offsetof(node_t, sibling_list)) {
+		*bad = 1;
+		return NULL;
+	}
+	return (struct list_head *) (image + off);
+}
 
-		list_for_each_entry(np, &node->child_list, sibling_list) {
-			/*
-			 * opt head matched, dive down to try first layer of option match
-			 */
-			if (np->match_type == MATCH_OPT_HEAD) {
-				opt = np;
-				list_for_each_entry(opt_np, &opt->child_list, sibling_list) {
-					if ((res = match_node(opt_np, arg, view, do_flag))) {
-						if (res == MATCH_EXACTLY) {
-							first = opt_np;
-							n_match = 1;
-							opt_np->opt_mark = 1;
-							align_opt_mark(opt_np);
-							goto out;
-						} else {
-							if (first == NULL) {
-								first = opt_np;
-								mark_candidate = &opt_np->opt_mark;
-							}
-							n_match++;
-						}
-					}
-				}
-				continue;
-			}
+/*
+ * check header of image of size bytes, for this build and grammar
+ */
+static int
+image_hdr_ok(struct image_hdr *hdr, size_t size, u_int64_t grammar_hash)
+{
+	u_int64_t node_end;
 
-			/* skip parsed child in opt head node */
-			if (node->match_type == MATCH_OPT_HEAD) {
-				if (np->opt_mark)
-					continue;
-			}
+	if (size < sizeof(struct image_hdr) ||
+	    memcmp(hdr->magic, IMAGE_MAGIC, sizeof(hdr->magic)) != 0 ||
+	    hdr->version != IMAGE_VERSION || hdr->byte_order != IMAGE_ORDER ||
+	    hdr->node_size != sizeof(node_t) || hdr->ptr_size != sizeof(void *))
+		return 0;
+	if (hdr->grammar_hash != grammar_hash)
+		return 0;
 
-			if ((res = match_node(np, arg, view, do_flag))) {
-				if (res == MATCH_EXACTLY) {
-					first = np;
-					n_match = 1;
-					if (node->match_type == MATCH_OPT_HEAD) {
-						np->opt_mark = 1;
-						align_opt_mark(np);
-					}
-					goto out;
-				} else {
-					if (first == NULL) {
-						first = np;
-						if (node->match_type == MATCH_OPT_HEAD) {
-							mark_candidate = &np->opt_mark;
-						}
-					}
-					n_match++;
-				}
-			}
-		}
+	if (hdr->size != size || hdr->cmd_off > size || hdr->man_off > size ||
+	    hdr->node_off > size || hdr->str_off > size ||
+	    hdr->cmd_num > size / sizeof(struct image_cmd) ||
+	    hdr->man_num > size / sizeof(struct image_man) ||
+	    hdr->node_num > size / sizeof(node_t) ||
+	    hdr->ent_num > size / sizeof(node_t *))
+		return 0;
 
-		max_tries--;
+	node_end = hdr->node_off + hdr->node_num * sizeof(node_t);
+	return (hdr->cmd_off >= sizeof(struct image_hdr) &&
+		hdr->cmd_off + hdr->cmd_num * sizeof(struct image_cmd) <=
+		hdr->man_off &&
+		hdr->man_off + hdr->man_num * sizeof(struct image_man) <=
+		hdr->node_off &&
+		hdr->node_off % ARENA_ALIGN == 0 &&
+		node_end + hdr->ent_num * sizeof(node_t *) == hdr->str_off &&
+		hdr->str_off + hdr->str_size == size &&
+		(hdr->str_size == 0 || ((char *) hdr)[size - 1] == '\0'));
+}
 
-		/* for opt end node, backtrack to opt head and try one more loop */
-		if (!node->opt_head)
-			break;
-		else
-			node = node->opt_head;
+/*
+ * point offsets of image to addresses, checking each of them
+ */
+static int
+relocate_image(char *image, struct image_hdr *hdr)
+{
+	u_int64_t nlo = hdr->node_off;
+	u_int64_t nhi = nlo + hdr->node_num * sizeof(node_t);
+	u_int64_t ehi = nhi + hdr->ent_num * sizeof(node_t *);
+	u_int64_t slo = hdr->str_off, shi = hdr->size;
+	node_t	*np = (node_t *) (image + nlo);
+	node_t	**ent = (node_t **) (image + nhi);
+	u_int64_t i;
+	int	bad = 0;
+
+#define	RELOC(p, lo, hi, unit)	((p) = (void *) image_addr(image, \
+				 (uintptr_t) (p), lo, hi, unit, 0, &bad))
+#define	RELOC_LIST(p)		((p) = image_list(image, \
+				 (uintptr_t) (p), nlo, nhi, &bad))
+#define	ENTS_OK(p, num)		((num) >= 0 && (num) <= MAX_CHILD_NUM && \
+				 ((uintptr_t) (p) == 0) == ((num) == 0) && \
+				 (uintptr_t) (p) + (num) * sizeof(node_t *) <= ehi)
+
+	for (i = 0; i < hdr->node_num; i++, np++) {
+		if (np->match_type < MATCH_KEYWORD ||
+		    np->match_type > MATCH_ALT_OR ||
+		    !ENTS_OK(np->keys, np->key_num) ||
+		    !ENTS_OK(np->others, np->other_num))
+			return -1;
+		if (np->match_type != MATCH_VAR)
+			RELOC(np->match_ent.keyword, slo, shi, 1);
+		RELOC(np->arg_name, slo, shi, 1);
+		RELOC(np->help, slo, shi, 1);
+		np->arg_helper = NULL;
+		RELOC(np->opt_head, nlo, nhi, sizeof(node_t));
+		RELOC(np->alt_head, nlo, nhi, sizeof(node_t));
+		RELOC(np->keys, nhi, ehi, sizeof(node_t *));
+		RELOC(np->others, nhi, ehi, sizeof(node_t *));
+		RELOC(np->leaf, nlo, nhi, sizeof(node_t));
+		RELOC(np->parent, nlo, nhi, sizeof(node_t));
+		RELOC_LIST(np->child_list.next);
+		RELOC_LIST(np->child_list.prev);
+		RELOC_LIST(np->sibling_list.next);
+		RELOC_LIST(np->sibling_list.prev);
+		if (bad) return -1;
+		/* keywords are matched by name, and names and helps are
+		 * interned, never NULL */
+		if ((np->match_type == MATCH_KEYWORD &&
+		     !np->match_ent.keyword) || !np->arg_name || !np->help)
+			return -1;
 	}
 
-out:
-	/* partialy but uniquely matched option, mark used flag */
-	if (n_match == 1 && mark_candidate) {
-		*mark_candidate = 1;
+	/* index entries are never NULL */
+	for (i = 0; i < hdr->ent_num; i++, ent++) {
+		if (*ent == NULL) return -1;
+		RELOC(*ent, nlo, nhi, sizeof(node_t));
 	}
+	if (bad) return -1;
 
-	*next = first;
-	return n_match;
+	return image_tree_ok((node_t *) (image + nlo), hdr->node_num) ? 0 : -1;
 }
 
 /*
- * display debug info of command trees
+ * check child and parent links of relocated nodes form trees. nodes are
+ * laid out depth first, so a parent always comes before its children,
+ * and each node but the roots is in the child_list of its parent once.
  */
-void
-debug_cmd_tree(char *cmd)
+static int
+image_tree_ok(node_t *nodes, u_int64_t num)
 {
-	struct cmd_tree *ent;
-	struct manual *man;
-	node_t	*path[MAX_ARG_NUM + 1];
-	int	i = 0;
+	struct list_head *pos, *head;
+	node_t	*np;
+	u_int64_t i, n, children = 0, roots = 0;
 
-	fprintf(stderr, "cmd_tree = {\n");
-	list_for_each_entry(ent, &cmd_tree_list, cmd_tree_list) {
-		if (cmd == NULL || strcmp(cmd, ent->cmd) == 0) {
-			fprintf(stderr, "[%d] %s\n",i,  ent->cmd);
-			list_for_each_entry(man,
-					    &ent->manual_list,
-					    manual_list) {
-				fprintf(stderr, "    %s\n", man->text);
-			}
-			fprintf(stderr, "    -->\n");
-			debug_tree(ent->tree, &path[0], 0);
-			fprintf(stderr, "\n");
-			if (cmd) break;
+	for (i = 0; i < num; i++) {
+		np = &nodes[i];
+		if (np->parent == NULL)
+			roots++;
+		else if (np->parent >= np)
+			return 0;
+
+		head = &np->child_list;
+		for (pos = head->next, n = 0; pos != head; pos = pos->next) {
+			if (n++ >= num || pos->next->prev != pos ||
+			    ((char *) pos - (char *) nodes) % sizeof(node_t) !=
+			    offsetof(node_t, sibling_list) ||
+			    list_entry(pos, node_t, sibling_list)->parent != np)
+				return 0;
 		}
-		i++;
+		if (head->next->prev != head)
+			return 0;
+		children += n;
 	}
-	fprintf(stderr, "}\n");
+	return (children + roots == num);
 }
 
 /*
- * display debug info of one syntax tree node
+ * load syntax trees and manuals of all commands from a syntax image file
+ * saved by ocli_save_image() with the same grammar_hash. call it instead
+ * of registering commands, or before, then registration calls only bind
+ * command functions and arg helpers by name, until ocli_freeze().
+ * return 0 if OK, or -1 if the image is absent, stale or bad.
  */
-void
-debug_node(char *info, node_t *node, int less)
+int
+ocli_load_image(char *path, u_int64_t grammar_hash)
 {
-	struct lex_ent *lex;
-
-	if (node == NULL) return;
-
-	if (info && *info) fprintf(stderr, "%s: ", info);
-	fprintf(stderr, "node<%p>={", node);
+	struct image_hdr *hdr;
+	struct image_cmd *ic;
+	struct image_man *im;
+	struct cmd_tree *cmd_tree;
+	struct stat st;
+	char	*image, *text;
+	u_int64_t i, j, man_i = 0;
+	int	fd, bad = 0;
+
+	if (!olic_core_init_ok) {
+		fprintf(stderr, "ocli_load_image: core not initialized\n");
+		return -1;
+	}
+	if (OCLI_FROZEN() || ocli_loaded || !list_empty(&cmd_tree_list)) {
+		fprintf(stderr, "ocli_load_image: commands registered\n");
+		return -1;
+	}
+	if (!path || !path[0]) {
+		fprintf(stderr, "ocli_load_image: bad parm\n");
+		return -1;
+	}
 
-	if (node->match_type == MATCH_KEYWORD) {
-		fprintf(stderr, "key:%s=\'%s\',",
-			node->arg_name,
-			node->match_ent.keyword);
-	} else if (node->match_type == MATCH_VAR) {
-		lex = get_lex_ent(node->match_ent.var.lex_type);
-		fprintf(stderr, "var:%s=%s,",
-			node->arg_name,
-			lex ? lex->name:"N/A");
-		if (!less && node->match_ent.var.chk_range)
-			fprintf(stderr, "min=%.2f,max=%.2f,",
-				node->match_ent.var.min_val,
-				node->match_ent.var.max_val);
-	} else if (node->match_type == MATCH_LEAF) {
-		fprintf(stderr, "leaf:=<LF>,");
-	} else if (node->match_type == MATCH_OPT_HEAD) {
-		fprintf(stderr, "opt:=<HEAD>,");
-	} else {
-		fprintf(stderr, "unknown<%d>,", node->match_type);
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		/* no image yet, not an error */
+		if (errno != ENOENT)
+			fprintf(stderr, "ocli_load_image: open %s: %s\n",
+				path, strerror(errno));
+		return -1;
+	}
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(struct image_hdr)) {
+		fprintf(stderr, "ocli_load_image: bad image %s\n", path);
+		close(fd);
+		return -1;
+	}
+	image = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		     fd, 0);
+	close(fd);
+	if (image == MAP_FAILED) {
+		fprintf(stderr, "ocli_load_image: mmap %s: %s\n",
+			path, strerror(errno));
+		return -1;
 	}
 
-	if (!less && node->help[0])
-		fprintf(stderr, "help=\'%s\',", node->help);
+	hdr = (struct image_hdr *) image;
+	if (!image_hdr_ok(hdr, st.st_size, grammar_hash)) {
+		fprintf(stderr, "ocli_load_image: %s is stale or bad\n", path);
+		munmap(image, st.st_size);
+		return -1;
+	}
+	if (relocate_image(image, hdr) < 0) {
+		fprintf(stderr, "ocli_load_image: bad image %s\n", path);
+		munmap(image, st.st_size);
+		return -1;
+	}
 
-	if (node->alt_order)
-		fprintf(stderr, "alt=%d,", node->alt_order);
+	ic = (struct image_cmd *) (image + hdr->cmd_off);
+	im = (struct image_man *) (image + hdr->man_off);
+	for (i = 0; i < hdr->cmd_num; i++, ic++) {
+		if (!ic->cmd[0] || ic->cmd[MAX_WORD_LEN - 1] ||
+		    get_cmd_tree(ic->cmd) ||
+		    ic->man_num > hdr->man_num - man_i)
+			goto bad;
+
+		if ((cmd_tree = malloc(sizeof(struct cmd_tree))) == NULL)
+			goto nomem;
+		bzero(cmd_tree, sizeof(struct cmd_tree));
+		memcpy(cmd_tree->cmd, ic->cmd, MAX_WORD_LEN);
+		INIT_LIST_HEAD(&cmd_tree->manual_list);
+		INIT_LIST_HEAD(&cmd_tree->symbol_list);
+		INIT_LIST_HEAD(&cmd_tree->syntax_list);
+		cmd_tree->tree = (node_t *) image_addr(image, ic->tree,
+				hdr->node_off, hdr->str_off - hdr->ent_num *
+				sizeof(node_t *), sizeof(node_t), 0, &bad);
+		if (trie_insert(cmd_tree) < 0) {
+			free(cmd_tree);
+			goto nomem;
+		}
+		if (bad || !cmd_tree->tree || cmd_tree->tree->parent)
+			goto bad;
+
+		for (j = 0; j < ic->man_num; j++, im++, man_i++) {
+			text = image_addr(image, im->text, hdr->str_off,
+					  hdr->size, 1, 0, &bad);
+			if (bad || !text)
+				goto bad;
+			if (add_manual(cmd_tree, text, im->view_mask) < 0)
+				goto nomem;
+		}
+	}
 
-	if (node->opt_head)
-		fprintf(stderr, "opt=END,");
+	frozen_image = image;
+	frozen_size = st.st_size;
+	frozen_nodes = (node_t *) (image + hdr->node_off);
+	frozen_node_num = hdr->node_num;
+	frozen_ent_num = hdr->ent_num;
+	image_reg_hash = hdr->reg_hash;
+	ocli_loaded = 1;
+	dprintf(DBG_TREE, "loaded %zu nodes of %zu commands from %s\n",
+		(size_t) hdr->node_num, (size_t) hdr->cmd_num, path);
+	return 0;
 
-	fprintf(stderr, "do_view=0x%x,undo_view=0x%x,depth=%d,bnum=%d}\n",
-		node->do_view_mask, node->undo_view_mask,
-		node->depth, node->child_num);
+bad:
+	fprintf(stderr, "ocli_load_image: bad image %s\n", path);
+	goto out;
+nomem:
+	fprintf(stderr, "ocli_load_image: no memory\n");
+out:
+	drop_cmd_trees();
+	munmap(image, st.st_size);
+	return -1;
 }
 
 /*
- * sprout nodes besides each leaf recursively
+ * free all command trees with the frozen or loaded image, and start the
+ * registration over
  */
 static void
-sprout_tree(node_t *tree, node_t **nodes, int num, int view_mask, int do_flag)
+drop_image(void)
 {
-	node_t	*base = NULL;
-	node_t	*np;
-
-	if (!tree) return;
-
-	/* search if given node has a leaf */
-	list_for_each_entry(np, &tree->child_list, sibling_list) {
-		if (IS_LEAF(np)) {
-			if (base == NULL)
-				base = tree;
-		} else {
-			sprout_tree(np, nodes, num,
-				    view_mask, do_flag);
-		}
-	}
-
-	/* only sprout for view_mask matching node */
-	if (base != NULL) {
-		if ((do_flag & DO_FLAG) && base->do_view_mask != view_mask)
-			return;
-		if ((do_flag & UNDO_FLAG) && tree->undo_view_mask != view_mask)
-			return;
-		grow_tree(base, nodes, num, view_mask, do_flag);
-	}
+	drop_cmd_trees();
+
+	if (frozen_image)
+		munmap(frozen_image, frozen_size);
+	frozen_image = NULL;
+	frozen_size = 0;
+	frozen_nodes = NULL;
+	frozen_node_num = 0;
+	frozen_ent_num = 0;
+	ocli_loaded = 0;
+	reg_hash = REG_HASH_INIT;
 }
 
 /*
- * debug tree paths recursively
+ * free command tree. nodes and symbols are freed with the arena, or
+ * with the frozen image.
  */
 static void
-debug_tree(node_t *tree, node_t **path, int len)
+free_cmd_tree(struct cmd_tree *cmd_tree)
 {
-	int	i;
-	node_t	*node, *np;
-	struct lex_ent *lex;
+	dprintf(DBG_TREE, "free tree [%s]\n", cmd_tree->cmd);
+	cleanup_manuals(&cmd_tree->manual_list);
+	arena_free(&cmd_tree->arena);
+	free(cmd_tree);
+}
 
-	if (!tree) return;
+/*
+ * free all command trees and their index, and the retired trees, with
+ * no parse in flight
+ */
+static void
+drop_cmd_trees(void)
+{
+	struct cmd_tree *ent, *tmp;
 
-	if (len < MAX_ARG_NUM) {
-		path[len++] = tree;
+	list_for_each_entry_safe(ent, tmp, &cmd_tree_list, cmd_tree_list) {
+		free_cmd_tree(ent);
 	}
+	INIT_LIST_HEAD(&cmd_tree_list);
+	trie_free(&cmd_trie);
+	bzero(&cmd_trie, sizeof(cmd_trie));
 
-	if (tree->alt_head) {
-		list_for_each_entry(np, &tree->alt_head->child_list, sibling_list) {
-			debug_tree(np, path, len);
-		}
-	} else if (tree->child_num == 0) {
-		fprintf(stderr, "    ");
-		for (i = 0; i < len; i++) {
-			if ((node = path[i]) == NULL)
-				continue;
-			if (node->match_type == MATCH_KEYWORD) {
-				fprintf(stderr, "%s ",
-					node->match_ent.keyword);
-			} else if (node->match_type == MATCH_VAR) {
-				lex = get_lex_ent(node->match_ent.var.lex_type);
-				fprintf(stderr, "%s ",
-					lex ? lex->name:"N/A");
-			} else if (node->match_type == MATCH_LEAF)
-				fprintf(stderr, "<LF>");
+	list_for_each_entry_safe(ent, tmp, &rcu_retired, cmd_tree_list) {
+		free_cmd_tree(ent);
+	}
+	INIT_LIST_HEAD(&rcu_retired);
+	rcu_retired_num = 0;
+	rcu_epoch = 0;
+	bzero(rcu_readers, sizeof(rcu_readers));
+}
 
-			if (node->match_type == MATCH_OPT_HEAD)
-				fprintf(stderr, "[ ");
-			else if (node->opt_head)
-				fprintf(stderr, "] ");
-			else if (node->alt_head && node->alt_head->opt_head)
-				fprintf(stderr, "] ");
-		}
-		fprintf(stderr, "    \n");
-	} else {
-		list_for_each_entry(np, &tree->child_list, sibling_list) {
-			debug_tree(np, path, len);
-		}
+/*
+ * count a parse in the current epoch, return the slot of rcu_readers[]
+ */
+static int
+rcu_enter(void)
+{
+	u_int	epoch;
+
+	for (;;) {
+		epoch = __atomic_load_n(&rcu_epoch, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&rcu_readers[epoch & 1], 1,
+				   __ATOMIC_SEQ_CST);
+		/* the epoch moved on, the count may be missed */
+		if (__atomic_load_n(&rcu_epoch, __ATOMIC_SEQ_CST) == epoch)
+			return (epoch & 1);
+		__atomic_sub_fetch(&rcu_readers[epoch & 1], 1,
+				   __ATOMIC_SEQ_CST);
 	}
 }
 
 /*
- * free tree nodes recursively
+ * a parse is cleaned up, free the trees no more in use if the reclaim
+ * is not busy elsewhere
  */
 static void
-free_tree(node_t *tree)
+rcu_leave(int slot)
 {
-	node_t	*np;
+	__atomic_sub_fetch(&rcu_readers[slot], 1, __ATOMIC_SEQ_CST);
 
-	if (!tree) return;
-	list_for_each_entry(np, &tree->child_list, sibling_list) {
-		free_tree(np);
+	if (__atomic_load_n(&rcu_retired_num, __ATOMIC_SEQ_CST) > 0 &&
+	    pthread_mutex_trylock(&rcu_lock) == 0) {
+		rcu_reclaim();
+		pthread_mutex_unlock(&rcu_lock);
 	}
+}
 
-	if ((debug_flag & DBG_TREE))
-		debug_node("free", tree, 1);
-
-	free(tree);
+/*
+ * queue an unlinked tree to be freed
+ */
+static void
+rcu_retire(struct cmd_tree *cmd_tree)
+{
+	pthread_mutex_lock(&rcu_lock);
+	cmd_tree->retired = __atomic_load_n(&rcu_epoch, __ATOMIC_SEQ_CST);
+	list_add_tail(&cmd_tree->cmd_tree_list, &rcu_retired);
+	__atomic_add_fetch(&rcu_retired_num, 1, __ATOMIC_SEQ_CST);
+	rcu_reclaim();
+	pthread_mutex_unlock(&rcu_lock);
 }
 
 /*
- * free command tree
+ * advance the epoch as far as readers allow, and free the trees retired
+ * two epochs ago or earlier, with rcu_lock held. never waits.
  */
 static void
-free_cmd_tree(struct cmd_tree *cmd_tree)
+rcu_reclaim(void)
 {
-	dprintf(DBG_TREE, "free tree [%s]\n", cmd_tree->cmd);
-	cleanup_manuals(&cmd_tree->manual_list);
-	cleanup_symbols(&cmd_tree->symbol_list);
-	free_tree(cmd_tree->tree);
-	free(cmd_tree);
+	struct cmd_tree *ent, *tmp;
+	u_int	epoch;
+	int	i;
+
+	for (i = 0; i < 2; i++) {
+		epoch = __atomic_load_n(&rcu_epoch, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&rcu_readers[(epoch - 1) & 1],
+				    __ATOMIC_SEQ_CST) > 0)
+			break;
+		__atomic_store_n(&rcu_epoch, epoch + 1, __ATOMIC_SEQ_CST);
+	}
+
+	epoch = __atomic_load_n(&rcu_epoch, __ATOMIC_SEQ_CST);
+	list_for_each_entry_safe(ent, tmp, &rcu_retired, cmd_tree_list) {
+		if (epoch - ent->retired < 2)
+			break;
+		list_del(&ent->cmd_tree_list);
+		__atomic_sub_fetch(&rcu_retired_num, 1, __ATOMIC_SEQ_CST);
+		free_cmd_tree(ent);
+	}
 }
 
 /*
@@ -1800,9 +4128,10 @@ free_cmd_tree(struct cmd_tree *cmd_tree)
  * return 1 if set OK else return 0;
  */
 static int
-set_cmd_arg(node_t *node, char *str, cmd_arg_t *cmd_arg)
+set_cmd_arg(node_t *node, char *str, cmd_arg_t *cmd_arg,
+	    cmd_stat_t *cmd_stat, int argi)
 {
-	struct lex_ent *lex;
+	struct arg_lex	al;
 
 	if (!node || !str || !str[0]) return 0;
 	if (!node->arg_name[0] || !cmd_arg) return 0;
@@ -1816,8 +4145,9 @@ set_cmd_arg(node_t *node, char *str, cmd_arg_t *cmd_arg)
 		return 1;
 	}
 
-	if ((lex = get_lex_ent(node->match_ent.var.lex_type)) &&
-	    lex->fun(str) == 1) {
+	init_arg_lex(&al, str, cmd_stat, argi);
+	if (get_lex_ent(node->match_ent.var.lex_type) &&
+	    match_lex(str, node->match_ent.var.lex_type, &al)) {
 		cmd_arg->value = strdup(str);
 		return 1;
 	}
@@ -1851,7 +4181,17 @@ set_arg_helper(node_t *tree, char *arg_name, arg_helper_t helper)
 void
 set_cmd_arg_helper(struct cmd_tree *cmd_tree, char *arg_name, arg_helper_t helper)
 {
-	if (cmd_tree && cmd_tree->tree)
+	if (OCLI_FROZEN()) {
+		fprintf(stderr, "set_cmd_arg_helper: syntax trees are frozen\n");
+		return;
+	}
+	/* the helper itself is bound again on every start */
+	hash_reg_str("set_cmd_arg_helper");
+	hash_reg_str(cmd_tree ? cmd_tree->cmd : NULL);
+	hash_reg_str(arg_name);
+	if (cmd_tree && cmd_tree->lazy && arg_name && helper)
+		record_syntax(cmd_tree, SYN_HELPER, arg_name, 0, 0, helper);
+	else if (cmd_tree && cmd_tree->tree)
 		set_arg_helper(cmd_tree->tree, arg_name, helper);
 }
 
@@ -1941,6 +4281,9 @@ cleanup_cmd_stat(struct cmd_stat *cmd_stat)
 	if (cmd_stat->last_arg) free(cmd_stat->last_arg);
 	if (cmd_stat->err_arg) free(cmd_stat->err_arg);
 	if (cmd_stat->cmd_arg) free_cmd_arg(cmd_stat->cmd_arg);
+	if (cmd_stat->args) free_argv(cmd_stat->args);
+	if (cmd_stat->rcu_slot) rcu_leave(cmd_stat->rcu_slot - 1);
+	cmd_stat->rcu_slot = 0;
 }
 
 /*
@@ -1970,11 +4313,23 @@ ocli_set_debug(int flag)
 int
 ocli_core_init(void)
 {
+	pthread_rwlockattr_t attr;
+
 	if (olic_core_init_ok) return 0;
 
 	lex_init();
 	symbol_init();
 	INIT_LIST_HEAD(&cmd_tree_list);
+	bzero(&cmd_trie, sizeof(cmd_trie));
+
+	/* a replacement must not starve behind busy completions */
+	pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+	pthread_rwlockattr_setkind_np(&attr,
+		PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+	pthread_rwlock_init(&cmd_lock, &attr);
+	pthread_rwlockattr_destroy(&attr);
 
 	olic_core_init_ok = 1;
 	return 0;
@@ -1987,13 +4342,13 @@ ocli_core_init(void)
 void
 ocli_core_exit(void)
 {
-	struct cmd_tree *ent, *tmp;
+	drop_image();
+	__atomic_store_n(&ocli_frozen, 0, __ATOMIC_RELEASE);
 
-	list_for_each_entry_safe(ent, tmp, &cmd_tree_list, cmd_tree_list) {
-		free_cmd_tree(ent);
-	}
+	pthread_rwlock_destroy(&cmd_lock);
 
 	symbol_exit();
+	free_intern_strs();
 	lex_exit();
 	olic_core_init_ok = 0;
 }
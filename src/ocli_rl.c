@@ -173,23 +173,26 @@ ocli_rl_prepare(char *text, int start, int end)
 	if (cmd_stat.last_argi == argi) {
 		dprintf(DBG_RL, "res %d,last[%d]=argi[%d]\n",
 			res, cmd_stat.last_argi, argi);
-		tok_num = get_node_matches(cmd_stat.last_node, text,
-					   &pending_toks[0], MAX_TOK_NUM,
-					   cur_view, cmd_stat.do_flag);
+		tok_num = get_node_matches_stat(cmd_stat.last_node, text,
+						&pending_toks[0], MAX_TOK_NUM,
+						cur_view, cmd_stat.do_flag,
+						&cmd_stat);
 	} else if (cmd_stat.last_node != NULL &&
 		   cmd_stat.last_argi == (argi - 1)) {
 		dprintf(DBG_RL, "res %d,last[%d]=argi[%d]-1\n",
 			res, cmd_stat.last_argi, argi);
-		tok_num = get_node_next_matches(cmd_stat.last_node, text,
-						&pending_toks[0], MAX_TOK_NUM,
-						cur_view, cmd_stat.do_flag);
+		tok_num = get_node_next_matches_stat(cmd_stat.last_node, text,
+						     &pending_toks[0], MAX_TOK_NUM,
+						     cur_view, cmd_stat.do_flag,
+						     &cmd_stat);
 	} else if (cmd_stat.last_node != NULL &&
 		   cmd_stat.last_argi == (arg_num - 1) && argi == -1) {
 		dprintf(DBG_RL, "res %d, after last[%d]\n",
 			res, cmd_stat.last_argi);
-		tok_num = get_node_next_matches(cmd_stat.last_node, NULL,
-						&pending_toks[0], MAX_TOK_NUM,
-						cur_view, cmd_stat.do_flag);
+		tok_num = get_node_next_matches_stat(cmd_stat.last_node, NULL,
+						     &pending_toks[0], MAX_TOK_NUM,
+						     cur_view, cmd_stat.do_flag,
+						     &cmd_stat);
 	} else {
 		dprintf(DBG_RL, "NULL, res %d last[%d] argi[%d]\n",
 			res, cmd_stat.last_argi, argi);
@@ -306,23 +309,25 @@ ocli_rl_help(int count, int key)
 	if (cmd_stat.last_argi == argi) {
 		dprintf(DBG_RL, "res %d,last[%d]=argi[%d]\n",
 			res, cmd_stat.last_argi, argi);
-		len = get_node_help(cmd_stat.last_node, args[argi],
-				    help_buf, HELP_BUF_SIZE,
-				    cur_view, cmd_stat.do_flag);
+		len = get_node_help_stat(cmd_stat.last_node, args[argi],
+					 help_buf, HELP_BUF_SIZE,
+					 cur_view, cmd_stat.do_flag, &cmd_stat);
 	} else if (cmd_stat.last_node != NULL &&
 		   cmd_stat.last_argi == (argi - 1)) {
 		dprintf(DBG_RL, "res %d,last[%d]=argi[%d]-1\n",
 			res, cmd_stat.last_argi, argi);
-		len = get_node_next_help(cmd_stat.last_node, args[argi],
-					 help_buf, HELP_BUF_SIZE,
-					 cur_view, cmd_stat.do_flag);
+		len = get_node_next_help_stat(cmd_stat.last_node, args[argi],
+					      help_buf, HELP_BUF_SIZE,
+					      cur_view, cmd_stat.do_flag,
+					      &cmd_stat);
 	} else if (cmd_stat.last_node != NULL &&
 		   cmd_stat.last_argi == (arg_num - 1) && argi == -1) {
 		dprintf(DBG_RL, "res %d, after last[%d]\n",
 			res, cmd_stat.last_argi);
-		len = get_node_next_help(cmd_stat.last_node, NULL,
-					 help_buf, HELP_BUF_SIZE,
-					 cur_view, cmd_stat.do_flag);
+		len = get_node_next_help_stat(cmd_stat.last_node, NULL,
+					      help_buf, HELP_BUF_SIZE,
+					      cur_view, cmd_stat.do_flag,
+					      &cmd_stat);
 	} else {
 		dprintf(DBG_RL, "NULL, res %d last[%d] argi[%d]\n",
 			res, cmd_stat.last_argi, argi);
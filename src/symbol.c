@@ -26,7 +26,6 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <string.h>
-#include <pcre.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -55,13 +54,36 @@ int sym_init_ok = 0;
 struct list_head sym_reserv_list;
 
 /*
- * set node data for a symbol
+ * allocate from arena if given, otherwise by malloc
+ */
+static void *
+sym_alloc(struct arena *arena, size_t size)
+{
+	void	*ptr;
+
+	if (arena)
+		return arena_alloc(arena, size);
+	if ((ptr = malloc(size)) != NULL)
+		bzero(ptr, size);
+	return ptr;
+}
+
+static char *
+sym_strdup(struct arena *arena, const char *str)
+{
+	return arena ? arena_strdup(arena, str) : strdup(str);
+}
+
+/*
+ * set node data for a symbol, node is allocated from arena if given
  */
 int
-set_symbol_node(symbol_t *symbol)
+set_symbol_node(symbol_t *symbol, struct arena *arena)
 {
 	node_t *node;
 	struct lex_ent *lex;
+	char	help[MAX_TEXT_LEN];
+	const char *arg_name;
 
 	if (symbol->lex_type != -1 && symbol->lex_type != -2 &&
 	   !IS_VALID_LEX_TYPE(symbol->lex_type)) {
@@ -70,13 +92,11 @@ set_symbol_node(symbol_t *symbol)
 		return -1;
 	}
 
-	if ((node = malloc(sizeof(node_t))) == NULL) {
+	if ((node = sym_alloc(arena, sizeof(node_t))) == NULL) {
 		fprintf(stderr, "set_symbol_node: malloc failed\n");
 		return -1;
 	}
 
-	bzero(node, sizeof(node_t));
-
 	if (symbol->lex_type == -2) {
 		if (strcmp(symbol->name, "[") == 0)
 			node->match_type = MATCH_OPT_HEAD;
@@ -96,19 +116,21 @@ set_symbol_node(symbol_t *symbol)
 			return -1;
 		}
 
-		strncpy(node->match_ent.keyword, symbol->name, MAX_WORD_LEN-1);
+		node->match_ent.keyword = arena_intern(arena, symbol->name,
+						       MAX_WORD_LEN);
 
 	} else if (symbol->lex_type == -1) {
 		node->match_type = MATCH_KEYWORD;
-		strncpy(node->match_ent.keyword, symbol->name, MAX_WORD_LEN-1);
+		node->match_ent.keyword = arena_intern(arena, symbol->name,
+						       MAX_WORD_LEN);
 
 	} else {
 		node->match_type = MATCH_VAR;
 		node->match_ent.var.lex_type = symbol->lex_type;
 
-		if (symbol->chk_range &&
+		if (symbol->chk_range == RANGE_FLOAT &&
 		    IS_NUMERIC_LEX_TYPE(symbol->lex_type)) {
-			node->match_ent.var.chk_range = 1;
+			node->match_ent.var.chk_range = RANGE_FLOAT;
 			if (symbol->min_val <= symbol->max_val) {
 				node->match_ent.var.min_val = symbol->min_val;
 				node->match_ent.var.max_val = symbol->max_val;
@@ -116,35 +138,79 @@ set_symbol_node(symbol_t *symbol)
 				node->match_ent.var.min_val = symbol->max_val;
 				node->match_ent.var.max_val = symbol->min_val;
 			}
+		} else if (symbol->chk_range == RANGE_INT &&
+			   IS_INTEGER_LEX_TYPE(symbol->lex_type)) {
+			node->match_ent.var.chk_range = RANGE_INT;
+			if (symbol->min_ival.i <= symbol->max_ival.i) {
+				node->match_ent.var.min_ival = symbol->min_ival;
+				node->match_ent.var.max_ival = symbol->max_ival;
+			} else {
+				node->match_ent.var.min_ival = symbol->max_ival;
+				node->match_ent.var.max_ival = symbol->min_ival;
+			}
+		} else if (symbol->chk_range == RANGE_UINT &&
+			   IS_INTEGER_LEX_TYPE(symbol->lex_type) &&
+			   symbol->lex_type != LEX_SINT) {
+			node->match_ent.var.chk_range = RANGE_UINT;
+			if (symbol->min_ival.u <= symbol->max_ival.u) {
+				node->match_ent.var.min_ival = symbol->min_ival;
+				node->match_ent.var.max_ival = symbol->max_ival;
+			} else {
+				node->match_ent.var.min_ival = symbol->max_ival;
+				node->match_ent.var.max_ival = symbol->min_ival;
+			}
 		}
 	}
 
 	/* for var node, generate help if symbol->help is NULL */
+	help[0] = '\0';
 	if (symbol->help && symbol->help[0]) {
-		strncpy(node->help, symbol->help, MAX_TEXT_LEN-1);
+		snprintf(help, MAX_TEXT_LEN, "%s", symbol->help);
 	} else if (symbol->help == NULL && symbol->lex_type != -1) {
-		if (symbol->chk_range) {
-			if (symbol->lex_type == LEX_INT)
-				snprintf(node->help, MAX_TEXT_LEN, "%d~%d",
+		if (node->match_ent.var.chk_range == RANGE_INT) {
+			snprintf(help, MAX_TEXT_LEN, "%lld~%lld",
+				 (long long) node->match_ent.var.min_ival.i,
+				 (long long) node->match_ent.var.max_ival.i);
+		} else if (node->match_ent.var.chk_range == RANGE_UINT) {
+			snprintf(help, MAX_TEXT_LEN,
+				 (symbol->lex_type == LEX_HEX) ?
+					"0x%llx~0x%llx" : "%llu~%llu",
+				 (unsigned long long) node->match_ent.var.min_ival.u,
+				 (unsigned long long) node->match_ent.var.max_ival.u);
+		} else if (symbol->chk_range) {
+			if (symbol->lex_type == LEX_INT ||
+			    symbol->lex_type == LEX_SINT)
+				snprintf(help, MAX_TEXT_LEN, "%d~%d",
 					 (int) node->match_ent.var.min_val,
 					 (int) node->match_ent.var.max_val);
 			else if (symbol->lex_type == LEX_DECIMAL)
-				snprintf(node->help, MAX_TEXT_LEN, "%.3f~%.3f",
+				snprintf(help, MAX_TEXT_LEN, "%.3f~%.3f",
 					 node->match_ent.var.min_val,
 					 node->match_ent.var.max_val);
 		} else {
 			if ((lex = get_lex_ent(symbol->lex_type)) != NULL) {
-				strncpy(node->help, lex->help,
-					MAX_TEXT_LEN-1);
+				snprintf(help, MAX_TEXT_LEN, "%s", lex->help);
 			}
 		}
 	}
 
 	/* for var node, set name as arg_name if symbol->arg_name is NULL */
 	if (symbol->arg_name && symbol->arg_name[0]) {
-		strncpy(node->arg_name, symbol->arg_name, MAX_WORD_LEN-1);
+		arg_name = symbol->arg_name;
 	} else if (symbol->arg_name == NULL && symbol->lex_type != -1) {
-		strncpy(node->arg_name, symbol->name, MAX_WORD_LEN-1);
+		arg_name = symbol->name;
+	} else {
+		arg_name = NULL;
+	}
+
+	/* strings of node live in the pool shared by all trees */
+	node->help = arena_intern(arena, help, MAX_TEXT_LEN);
+	node->arg_name = arena_intern(arena, arg_name, MAX_WORD_LEN);
+	if (!node->help || !node->arg_name ||
+	    (node->match_type != MATCH_VAR && !node->match_ent.keyword)) {
+		fprintf(stderr, "set_symbol_node: no memory for strings\n");
+		if (!arena) free(node);
+		return -1;
 	}
 
 	if (debug_flag) debug_node("set_symbol_node", node, 0);
@@ -186,26 +252,28 @@ get_node_by_name(struct list_head *sym_list, char *name)
 }
 
 /*
- * batch add and set symbols
+ * batch add and set symbols. with an arena given, symbols and their nodes
+ * are allocated from it and freed with it, not by cleanup_symbols().
  */
 int
-prepare_symbols(struct list_head *sym_list, symbol_t *sym_table, int limit)
+prepare_symbols(struct list_head *sym_list, symbol_t *sym_table, int limit,
+		struct arena *arena)
 {
 	symbol_t *ent = NULL, *ptr = sym_table;
 
 	while (ptr && limit > 0 &&
 	       ptr->name && ptr->name[0] && ptr->node == NULL) {
 
-		if ((ent = malloc(sizeof(symbol_t))) == NULL) {
+		if ((ent = sym_alloc(arena, sizeof(symbol_t))) == NULL) {
 			fprintf(stderr, "prepare_symbol: malloc failed\n");
 			return -1;
 		}
 		memcpy(ent, ptr, sizeof(symbol_t));
-		ent->name = strdup(ptr->name);
-		if (ptr->help) ent->help = strdup(ptr->help);
-		if (ptr->arg_name) ent->arg_name = strdup(ptr->arg_name);
+		ent->name = sym_strdup(arena, ptr->name);
+		if (ptr->help) ent->help = sym_strdup(arena, ptr->help);
+		if (ptr->arg_name) ent->arg_name = sym_strdup(arena, ptr->arg_name);
 
-		if (set_symbol_node(ent) < 0)
+		if (set_symbol_node(ent, arena) < 0)
 			return -1;
 
 		list_add_tail(&ent->list, sym_list);
@@ -247,7 +315,7 @@ symbol_init()
 	INIT_LIST_HEAD(&sym_reserv_list);
 
 	if (prepare_symbols(&sym_reserv_list, &sym_reserv[0],
-			    SYM_NUM(sym_reserv)) < 0) {
+			    SYM_NUM(sym_reserv), NULL) < 0) {
 		fprintf(stderr, "symbol_init: failed to init sym_reserv_list");
 		return -1;
 	}
@@ -38,6 +38,7 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <pthread.h>
 #include <readline/readline.h>
 
 #include "lex.h"
@@ -176,6 +177,280 @@ free_argv(char **argv)
 	free(argv);
 }
 
+/*
+ * arena, memory carved in order from a list of blocks, freed at once
+ */
+struct arena_blk {
+	struct arena_blk *next;		/* older block */
+	size_t		size;		/* bytes of data */
+	size_t		used;		/* bytes carved */
+	char		data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+/* a reference to an interned string, held by an arena */
+struct arena_str {
+	struct arena_str *next;
+	const char	*str;
+};
+
+/*
+ * allocate size bytes of zeroed memory from arena
+ */
+void *
+arena_alloc(struct arena *arena, size_t size)
+{
+	struct arena_blk *blk = arena->blk;
+	size_t	bsize;
+	void	*ptr;
+
+	size = (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+
+	if (blk == NULL || blk->size - blk->used < size) {
+		bsize = (size > ARENA_BLK_SIZE) ? size : ARENA_BLK_SIZE;
+		if ((blk = malloc(sizeof(struct arena_blk) + bsize)) == NULL)
+			return NULL;
+		blk->size = bsize;
+		blk->used = 0;
+
+		/* an oversized block goes below, the current one stays open */
+		if (arena->blk && bsize > ARENA_BLK_SIZE) {
+			blk->next = arena->blk->next;
+			arena->blk->next = blk;
+		} else {
+			blk->next = arena->blk;
+			arena->blk = blk;
+		}
+	}
+
+	ptr = blk->data + blk->used;
+	blk->used += size;
+	arena->used += size;
+	bzero(ptr, size);
+	return ptr;
+}
+
+/*
+ * duplicate str into arena
+ */
+char *
+arena_strdup(struct arena *arena, const char *str)
+{
+	char	*ptr;
+	size_t	len = strlen(str);
+
+	if ((ptr = arena_alloc(arena, len + 1)) != NULL)
+		memcpy(ptr, str, len);
+	return ptr;
+}
+
+static void release_str(const char *str);
+
+/*
+ * free all blocks of arena, and release the interned strings it holds
+ */
+void
+arena_free(struct arena *arena)
+{
+	struct arena_blk *blk, *next;
+	struct arena_str *as;
+
+	for (as = arena->strs; as; as = as->next)
+		release_str(as->str);
+	arena->strs = NULL;
+
+	for (blk = arena->blk; blk; blk = next) {
+		next = blk->next;
+		free(blk);
+	}
+	arena->blk = NULL;
+	arena->used = 0;
+}
+
+/*
+ * pool of interned strings, shared by the syntax nodes of all trees. an
+ * entry is freed when the last arena holding it is freed. parses free
+ * retired trees, so the pool is locked against registration.
+ */
+struct str_ent {
+	struct str_ent	*next;		/* next entry of hash bucket */
+	int		ref;		/* references held */
+	char		str[];		/* the string */
+};
+
+#define	STR_POOL_MIN	256	/* initial number of hash buckets */
+
+static struct str_ent **str_pool = NULL;
+static int	str_pool_size = 0;
+static int	str_pool_num = 0;
+static char	str_empty[1] = "";
+static pthread_mutex_t str_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static u_int
+str_hashval(const char *str, int len)
+{
+	u_int	h = 2166136261u;
+	int	i;
+
+	for (i = 0; i < len; i++)
+		h = (h ^ (u_char) str[i]) * 16777619u;
+	return h;
+}
+
+/*
+ * double hash buckets of the pool
+ */
+static int
+grow_str_pool(void)
+{
+	struct str_ent **pool, *ent, *next;
+	int	size, i;
+	u_int	h;
+
+	size = str_pool_size ? str_pool_size * 2 : STR_POOL_MIN;
+	if ((pool = calloc(size, sizeof(struct str_ent *))) == NULL)
+		return -1;
+
+	for (i = 0; i < str_pool_size; i++) {
+		for (ent = str_pool[i]; ent; ent = next) {
+			next = ent->next;
+			h = str_hashval(ent->str, strlen(ent->str)) & (size - 1);
+			ent->next = pool[h];
+			pool[h] = ent;
+		}
+	}
+	free(str_pool);
+	str_pool = pool;
+	str_pool_size = size;
+	return 0;
+}
+
+/*
+ * get the pooled copy of str, truncated to size-1 chars if size > 0,
+ * and hold a reference to it. equal strings share one copy.
+ * NULL or empty str gets a static "", return NULL if out of memory.
+ */
+static const char *
+hold_str(const char *str, int size)
+{
+	struct str_ent *ent;
+	int	len;
+	u_int	h;
+
+	if (!str || !str[0]) return str_empty;
+
+	len = (size > 0) ? strnlen(str, size - 1) : strlen(str);
+
+	pthread_mutex_lock(&str_lock);
+	if (str_pool_num >= str_pool_size && grow_str_pool() < 0)
+		goto no_mem;
+
+	h = str_hashval(str, len) & (str_pool_size - 1);
+	for (ent = str_pool[h]; ent; ent = ent->next) {
+		if (strncmp(ent->str, str, len) == 0 && ent->str[len] == '\0')
+			goto out;
+	}
+
+	if ((ent = malloc(sizeof(struct str_ent) + len + 1)) == NULL)
+		goto no_mem;
+	memcpy(ent->str, str, len);
+	ent->str[len] = '\0';
+	ent->ref = 0;
+	ent->next = str_pool[h];
+	str_pool[h] = ent;
+	str_pool_num++;
+out:
+	ent->ref++;
+	pthread_mutex_unlock(&str_lock);
+	return ent->str;
+
+no_mem:
+	pthread_mutex_unlock(&str_lock);
+	fprintf(stderr, "intern_str: no memory\n");
+	return NULL;
+}
+
+/*
+ * drop a reference to an interned string, free it if it is the last one
+ */
+static void
+release_str(const char *str)
+{
+	struct str_ent *ent, **pp;
+	u_int	h;
+
+	if (str == str_empty) return;
+
+	pthread_mutex_lock(&str_lock);
+	h = str_hashval(str, strlen(str)) & (str_pool_size - 1);
+	for (pp = &str_pool[h]; (ent = *pp) != NULL; pp = &ent->next) {
+		if (ent->str != str)
+			continue;
+		if (--ent->ref == 0) {
+			*pp = ent->next;
+			str_pool_num--;
+			free(ent);
+		}
+		break;
+	}
+	pthread_mutex_unlock(&str_lock);
+}
+
+/*
+ * get the pooled copy of str as by hold_str(), which lives until
+ * free_intern_strs()
+ */
+const char *
+intern_str(const char *str, int size)
+{
+	return hold_str(str, size);
+}
+
+/*
+ * get the pooled copy of str for a node allocated from arena, which lives
+ * until the arena is freed. without an arena, as by intern_str().
+ */
+const char *
+arena_intern(struct arena *arena, const char *str, int size)
+{
+	struct arena_str *as;
+	const char *p;
+
+	if (!arena)
+		return intern_str(str, size);
+	if ((p = hold_str(str, size)) == NULL || p == str_empty)
+		return p;
+
+	if ((as = arena_alloc(arena, sizeof(struct arena_str))) == NULL) {
+		release_str(p);
+		fprintf(stderr, "arena_intern: no memory\n");
+		return NULL;
+	}
+	as->str = p;
+	as->next = arena->strs;
+	arena->strs = as;
+	return p;
+}
+
+/*
+ * free all interned strings
+ */
+void
+free_intern_strs(void)
+{
+	struct str_ent *ent, *next;
+	int	i;
+
+	for (i = 0; i < str_pool_size; i++) {
+		for (ent = str_pool[i]; ent; ent = next) {
+			next = ent->next;
+			free(ent);
+		}
+	}
+	free(str_pool);
+	str_pool = NULL;
+	str_pool_size = str_pool_num = 0;
+}
+
 /*
  * display buf text by pages adapt to current screen width and height
  * This function is copyied from more.c of busybox prject
@@ -0,0 +1,122 @@
+/*
+ * cross check the vector scanners of mac and hex against the
+ * scalar scanners and the pcre patterns. build it with -fsanitize=address
+ * so that any read past the end of a token is reported.
+ */
+#include "../src/lex.c"
+
+#define	ROUNDS	200000
+
+static const char *alpha = "0123456789abcdefABCDEFxX.:-/\n zg";
+
+static const char *seeds[] = {
+	"1.2.3.4", "255.255.255.255", "256.1.1.1", "01.2.3.4", "1.2.3.4\n",
+	"00:11:22:33:44:55", "00-11-22-33-44-55", "001122334455",
+	"0x1f", "0XABCDEF0123456789", "ffffffffffffffff", "0x",
+	"1.2.3.4.5.6.7.8.9.10.11.12.13.14.15.16"
+};
+
+#define	SEED_NUM	(sizeof(seeds) / sizeof(seeds[0]))
+
+/* a random token, or a mutated seed */
+static void
+rand_token(char *buf, int size)
+{
+	int	len, n, op, pos, an = strlen(alpha);
+
+	if (rand() % 2) {
+		len = rand() % (size - 1);
+		for (n = 0; n < len; n++)
+			buf[n] = alpha[rand() % an];
+		buf[len] = '\0';
+		return;
+	}
+
+	snprintf(buf, size, "%s", seeds[rand() % SEED_NUM]);
+	len = strlen(buf);
+	for (n = rand() % 3; n >= 0; n--) {
+		op = rand() % 3;
+		pos = len ? rand() % len : 0;
+		if (op == 0 && len) {
+			buf[pos] = alpha[rand() % an];
+		} else if (op == 1 && len < size - 1) {
+			memmove(buf + pos + 1, buf + pos, len - pos + 1);
+			buf[pos] = alpha[rand() % an];
+			len++;
+		} else if (len) {
+			memmove(buf + pos, buf + pos + 1, len - pos);
+			len--;
+		}
+	}
+}
+
+struct scanner {
+	char	*name;
+	int	(*native)(char *);
+	int	(*is_xxx)(char *);
+};
+
+static struct scanner scanners[] = {
+	{ "mac_addr", native_mac_addr, is_mac_addr },
+	{ "hex", native_hex, is_hex },
+};
+
+#define	SCANNER_NUM	(sizeof(scanners) / sizeof(scanners[0]))
+
+int
+main(void)
+{
+	char	buf[48], *tok;
+	int	i, k, scalar, pcre, bad = 0;
+#ifdef LEX_SIMD
+	tok_mask_fun_t kern[2];
+	int	v, kern_num = 0;
+#endif
+
+	lex_init();
+#ifdef LEX_SIMD
+	if (__builtin_cpu_supports("avx2"))
+		kern[kern_num++] = tok_mask_avx2;
+	if (__builtin_cpu_supports("sse4.2"))
+		kern[kern_num++] = tok_mask_sse42;
+	printf("lex_simd: %d vector kernels\n", kern_num);
+#else
+	printf("lex_simd: built without vector kernels\n");
+#endif
+	srand(1);
+
+	for (i = 0; i < ROUNDS; i++) {
+		rand_token(buf, sizeof(buf));
+		/* exact size on heap, an over-read hits the redzone */
+		if ((tok = strdup(buf)) == NULL)
+			return 1;
+
+		for (k = 0; k < SCANNER_NUM; k++) {
+#ifdef LEX_SIMD
+			tok_mask_fun = NULL;
+#endif
+			scalar = scanners[k].native(tok);
+			lex_native = 0;
+			pcre = scanners[k].is_xxx(tok);
+			lex_native = 1;
+			if (scalar != pcre && bad++ < 20)
+				printf("%s(\"%s\"): scalar %d, pcre %d\n",
+				       scanners[k].name, tok, scalar, pcre);
+#ifdef LEX_SIMD
+			for (v = 0; v < kern_num; v++) {
+				tok_mask_fun = kern[v];
+				if (scanners[k].native(tok) != scalar &&
+				    bad++ < 20)
+					printf("%s(\"%s\"): kernel %d differs "
+					       "from scalar %d\n",
+					       scanners[k].name, tok, v, scalar);
+			}
+#endif
+		}
+		free(tok);
+	}
+
+	lex_exit();
+	printf("lex_simd: %d tokens, %d mismatches\n", ROUNDS, bad);
+	return (bad != 0);
+}
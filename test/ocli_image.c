@@ -0,0 +1,155 @@
+/*
+ * save a syntax image, then load copies of it with one string offset of
+ * a node zeroed. each damaged copy must be rejected by the loader, and
+ * the intact one must load and parse.
+ */
+#include "../src/ocli_core.c"
+
+#define	IMAGE_PATH	"/tmp/ocli_image_test.img"
+#define	BAD_PATH	"/tmp/ocli_image_test.bad"
+
+static symbol_t ping_syms[] = {
+	DEF_KEY("ping", "Ping"),
+	DEF_KEY("-c", "Count"),
+	DEF_VAR_RANGE("COUNT", "<1-100> count", LEX_INT, ARG(COUNT), 1, 100),
+	DEF_VAR("HOST", "Destination", LEX_IP_ADDR, ARG(HOST)),
+};
+
+static int
+cmd_ping(cmd_arg_t *cmd_arg, int do_flag)
+{
+	return 0;
+}
+
+static int
+save_image(void)
+{
+	struct cmd_tree *cmd_tree;
+
+	ocli_core_init();
+	if ((cmd_tree = create_cmd_tree("ping", SYM_TABLE(ping_syms),
+					cmd_ping)) == NULL ||
+	    add_cmd_syntax(cmd_tree, "ping [ -c COUNT ] HOST",
+			   BASIC_VIEW, DO_FLAG) < 0 ||
+	    ocli_freeze() < 0 ||
+	    ocli_save_image(IMAGE_PATH, 1) < 0)
+		return -1;
+	ocli_core_exit();
+	return 0;
+}
+
+static char *
+read_image(size_t *size)
+{
+	struct stat st;
+	char	*buf;
+	int	fd;
+
+	if ((fd = open(IMAGE_PATH, O_RDONLY)) < 0)
+		return NULL;
+	if (fstat(fd, &st) < 0 || (buf = malloc(st.st_size)) == NULL ||
+	    read(fd, buf, st.st_size) != st.st_size) {
+		close(fd);
+		return NULL;
+	}
+	close(fd);
+	*size = st.st_size;
+	return buf;
+}
+
+/*
+ * load a copy of image with the field at off of node i zeroed, or the
+ * intact image if off is negative. return result of ocli_load_image().
+ */
+static int
+load_damaged(char *image, size_t size, u_int64_t i, long off)
+{
+	struct image_hdr *hdr = (struct image_hdr *) image;
+	char	*buf, *np;
+	int	fd;
+
+	if ((buf = malloc(size)) == NULL)
+		return -2;
+	memcpy(buf, image, size);
+	np = buf + hdr->node_off + i * sizeof(node_t);
+	if (off >= 0)
+		bzero(np + off, sizeof(void *));
+
+	if ((fd = open(BAD_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0 ||
+	    write(fd, buf, size) != (ssize_t) size) {
+		free(buf);
+		return -2;
+	}
+	close(fd);
+	free(buf);
+
+	ocli_core_init();
+	return ocli_load_image(BAD_PATH, 1);
+}
+
+int
+main(void)
+{
+	struct image_hdr *hdr;
+	cmd_stat_t cmd_stat;
+	node_t	*nodes;
+	char	*image;
+	size_t	size;
+	u_int64_t i;
+	int	n = 0, bad = 0;
+
+	if (save_image() < 0 || (image = read_image(&size)) == NULL) {
+		printf("ocli_image: failed to save image\n");
+		return 1;
+	}
+	hdr = (struct image_hdr *) image;
+	nodes = (node_t *) (image + hdr->node_off);
+
+	for (i = 0; i < hdr->node_num; i++) {
+		if (nodes[i].match_type == MATCH_KEYWORD) {
+			n++;
+			if (load_damaged(image, size, i,
+			    offsetof(node_t, match_ent.keyword)) != -1) {
+				printf("ocli_image: node[%lu] NULL keyword "
+				       "loaded\n", (u_long) i);
+				bad++;
+			}
+			ocli_core_exit();
+		}
+		if (nodes[i].match_type != MATCH_KEYWORD &&
+		    nodes[i].match_type != MATCH_VAR)
+			continue;
+
+		n += 2;
+		if (load_damaged(image, size, i,
+				 offsetof(node_t, arg_name)) != -1) {
+			printf("ocli_image: node[%lu] NULL arg_name loaded\n",
+			       (u_long) i);
+			bad++;
+		}
+		ocli_core_exit();
+		if (load_damaged(image, size, i,
+				 offsetof(node_t, help)) != -1) {
+			printf("ocli_image: node[%lu] NULL help loaded\n",
+			       (u_long) i);
+			bad++;
+		}
+		ocli_core_exit();
+	}
+
+	/* the intact image still loads and parses */
+	bzero(&cmd_stat, sizeof(cmd_stat));
+	if (load_damaged(image, size, 0, -1) != 0 ||
+	    check_cmd_syntax("ping -c 5 1.2.3.4", BASIC_VIEW, &cmd_stat) != 0) {
+		printf("ocli_image: intact image failed\n");
+		bad++;
+	}
+	cleanup_cmd_stat(&cmd_stat);
+	ocli_core_exit();
+
+	unlink(IMAGE_PATH);
+	unlink(BAD_PATH);
+	free(image);
+	printf("ocli_image: %d damaged images, %d loaded\n", n, bad);
+	return (bad != 0);
+}
@@ -0,0 +1,235 @@
+/*
+ * parse commands from several threads while one thread replaces and
+ * deletes commands. some commands are lazy, and all the threads parse
+ * them at once. built with -fsanitize=address a tree freed under a parse
+ * is reported, and with -fsanitize=thread a tree built under one. each
+ * replaced command has a new help, whose string must leave the pool with
+ * the old tree.
+ */
+#include "../src/utils.c"
+
+#define	CMD_NUM		64
+#define	LAZY_NUM	64
+#define	WORD_NUM	32	/* syntaxes of a lazy command */
+#define	READER_NUM	4
+#define	ROUNDS		20000
+#define	WRITES		2000
+
+static symbol_t cmd_syms[] = {
+	DEF_KEY("cmd", "Command"),
+	DEF_KEY("-c", "Count"),
+	DEF_VAR_RANGE("COUNT", "<1-100> count", LEX_INT, ARG(COUNT), 1, 100),
+	DEF_KEY("-s", "Size"),
+	DEF_VAR_RANGE("SIZE", "<1-1500> size", LEX_INT, ARG(SIZE), 1, 1500),
+	DEF_VAR("HOST", "Destination", LEX_IP_ADDR, ARG(HOST)),
+};
+
+#define	SYM_NUM	(sizeof(cmd_syms) / sizeof(cmd_syms[0]))
+
+/* both of them take "-c 5 1.2.3.4" */
+static char *syntaxes[] = {
+	"%s [ -c COUNT ] HOST",
+	"%s [ -s SIZE ] [ -c COUNT ] HOST",
+};
+
+static int	done = 0;
+static pthread_barrier_t start;
+
+static int
+cmd_fun(cmd_arg_t *cmd_arg, int do_flag)
+{
+	return 0;
+}
+
+/*
+ * publish a command named cmd with syntax variant i % 2, and help of i,
+ * in place of the one of the same name if any. growing a published tree
+ * is not thread safe, so it is prepared first.
+ */
+static struct cmd_tree *
+new_cmd(char *cmd, int i)
+{
+	symbol_t syms[SYM_NUM];
+	struct cmd_tree *cmd_tree;
+	char	syntax[MAX_LINE_LEN], help[MAX_TEXT_LEN];
+
+	memcpy(syms, cmd_syms, sizeof(syms));
+	snprintf(help, sizeof(help), "Command %d", i);
+	syms[0].name = cmd;
+	syms[0].help = help;
+	if ((cmd_tree = prepare_cmd_tree(cmd, syms, SYM_NUM, cmd_fun)) == NULL)
+		return NULL;
+
+	snprintf(syntax, sizeof(syntax), syntaxes[i % 2], cmd);
+	if (add_cmd_syntax(cmd_tree, syntax, BASIC_VIEW, DO_FLAG) < 0 ||
+	    replace_cmd_tree(cmd_tree) < 0) {
+		delete_cmd_tree(cmd_tree);
+		return NULL;
+	}
+	return cmd_tree;
+}
+
+/*
+ * a lazy command with syntaxes "lazyN wI HOST" for each word, so only a
+ * fully built tree takes the last word
+ */
+static int
+new_lazy_cmd(int n)
+{
+	symbol_t syms[WORD_NUM + 2];
+	struct cmd_tree *cmd_tree;
+	char	names[WORD_NUM + 1][MAX_WORD_LEN], syntax[MAX_LINE_LEN];
+	int	i;
+
+	snprintf(names[WORD_NUM], MAX_WORD_LEN, "lazy%d", n);
+	syms[0] = (symbol_t) DEF_KEY(names[WORD_NUM], "Lazy command");
+	for (i = 0; i < WORD_NUM; i++) {
+		snprintf(names[i], MAX_WORD_LEN, "w%d", i);
+		syms[i + 1] = (symbol_t) DEF_KEY(names[i], "Word");
+	}
+	syms[WORD_NUM + 1] = cmd_syms[SYM_NUM - 1];
+
+	if ((cmd_tree = create_cmd_tree(names[WORD_NUM], syms, WORD_NUM + 2,
+					cmd_fun)) == NULL)
+		return -1;
+	for (i = 0; i < WORD_NUM; i++) {
+		snprintf(syntax, sizeof(syntax), "lazy%d w%d HOST", n, i);
+		if (add_cmd_syntax(cmd_tree, syntax, BASIC_VIEW, DO_FLAG) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * parse one line, and walk the next nodes of its last node as completion
+ * does, with the trees held until cleanup
+ */
+static int
+parse(char *line)
+{
+	cmd_stat_t cmd_stat;
+	char	*matches[16];
+	int	i, n, res;
+
+	bzero(&cmd_stat, sizeof(cmd_stat));
+	res = check_cmd_syntax(line, BASIC_VIEW, &cmd_stat);
+	n = get_node_next_matches_stat(cmd_stat.last_node, NULL, matches, 16,
+				       BASIC_VIEW, cmd_stat.do_flag, &cmd_stat);
+	for (i = 0; i < n; i++)
+		free(matches[i]);
+	cleanup_cmd_stat(&cmd_stat);
+	return res;
+}
+
+static void *
+reader(void *arg)
+{
+	char	line[MAX_LINE_LEN];
+	long	bad = 0;
+	u_int	seed = (u_int) (long) arg;
+	int	i, k;
+
+	for (i = 0; i < ROUNDS; i++) {
+		/* all readers resolve each lazy command at once */
+		if (i < LAZY_NUM) {
+			pthread_barrier_wait(&start);
+			snprintf(line, sizeof(line), "lazy%d w%d 1.2.3.4",
+				 i, WORD_NUM - 1);
+			if (parse(line) != 0 && bad++ < 10)
+				printf("ocli_mt: '%s' failed\n", line);
+		}
+
+		/* replaced commands always parse */
+		k = rand_r(&seed) % CMD_NUM;
+		snprintf(line, sizeof(line), "cmd%d -c 5 1.2.3.4", k);
+		if (parse(line) != 0 && bad++ < 10)
+			printf("ocli_mt: '%s' failed\n", line);
+
+		/* deleted ones come and go */
+		snprintf(line, sizeof(line), "tmp%d 1.2.3.4", k % 4);
+		parse(line);
+	}
+	return (void *) bad;
+}
+
+static void *
+writer(void *arg)
+{
+	struct cmd_tree *tmp[4] = { NULL };
+	char	cmd[MAX_WORD_LEN];
+	long	bad = 0;
+	int	i, k;
+
+	for (i = 0; i < WRITES && !__atomic_load_n(&done, __ATOMIC_ACQUIRE);
+	     i++) {
+		k = i % CMD_NUM;
+		snprintf(cmd, sizeof(cmd), "cmd%d", k);
+		if (new_cmd(cmd, i) == NULL)
+			bad++;
+
+		k = i % 4;
+		if (tmp[k]) {
+			if (delete_cmd_tree(tmp[k]) < 0)
+				bad++;
+			tmp[k] = NULL;
+		} else {
+			snprintf(cmd, sizeof(cmd), "tmp%d", k);
+			if ((tmp[k] = new_cmd(cmd, i * 2)) == NULL)
+				bad++;
+		}
+	}
+	return (void *) bad;
+}
+
+int
+main(void)
+{
+	pthread_t readers[READER_NUM], wr;
+	char	cmd[MAX_WORD_LEN];
+	void	*res;
+	long	bad = 0;
+	int	i;
+
+	ocli_core_init();
+
+	for (i = 0; i < CMD_NUM; i++) {
+		snprintf(cmd, sizeof(cmd), "cmd%d", i);
+		if (new_cmd(cmd, 0) == NULL)
+			return 1;
+	}
+
+	/* trees are built by the first parses, in reader threads */
+	ocli_set_lazy(1);
+	for (i = 0; i < LAZY_NUM; i++) {
+		if (new_lazy_cmd(i) < 0)
+			return 1;
+	}
+	ocli_set_lazy(0);
+
+	pthread_barrier_init(&start, NULL, READER_NUM);
+	for (i = 0; i < READER_NUM; i++)
+		pthread_create(&readers[i], NULL, reader, (void *) (long) i);
+	pthread_create(&wr, NULL, writer, NULL);
+
+	for (i = 0; i < READER_NUM; i++) {
+		pthread_join(readers[i], &res);
+		bad += (long) res;
+	}
+	__atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+	pthread_join(wr, &res);
+	bad += (long) res;
+	pthread_barrier_destroy(&start);
+
+	/* helps of the trees freed so far are gone, not one per write */
+	if (str_pool_num >= WRITES) {
+		printf("ocli_mt: %d strings interned after %d writes\n",
+		       str_pool_num, WRITES);
+		bad++;
+	}
+
+	/* all the retired trees are freed with no parse in flight */
+	ocli_core_exit();
+	printf("ocli_mt: %d parses by %d threads, %ld failures\n",
+	       (ROUNDS * 2 + LAZY_NUM) * READER_NUM, READER_NUM, bad);
+	return (bad != 0);
+}